@@ -0,0 +1,6 @@
+require("_common")
+
+pluginsConfig.InterpreterAnalyzer = {
+    hlstrategy = "cov",
+    llstrategy = "topo"
+}
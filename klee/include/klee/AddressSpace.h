@@ -14,6 +14,7 @@
 
 #include "klee/Expr.h"
 #include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/Internal/ADT/ImmutableRadixMap.h"
 
 #include "klee/BitfieldSimplifier.h"
 
@@ -34,7 +35,20 @@ namespace klee {
     bool operator()(const MemoryObject *a, const MemoryObject *b) const;
   };
   
+  /// Function object giving the position of a MemoryObject in a radix map.
+  struct MemoryObjectAddress {
+    uint64_t operator()(const MemoryObject *mo) const;
+  };
+
+  // Address lookups are on the path of every symbolic memory access, the
+  // radix map answers them without walking a tree of MemoryObject
+  // pointers. Define KLEE_AVL_MEMORY_MAP to go back to the balanced tree.
+#ifdef KLEE_AVL_MEMORY_MAP
   typedef ImmutableMap<const MemoryObject*, ObjectHolder, MemoryObjectLT> MemoryMap;
+#else
+  typedef ImmutableRadixMap<const MemoryObject*, ObjectHolder,
+                            MemoryObjectAddress> MemoryMap;
+#endif
   
   class AddressSpace {
   private:
@@ -57,6 +71,11 @@ namespace klee {
     /// ExecutionState that owns this AddressSpace
     ExecutionState *state;
 
+    /// XOR of the hashes of the bound memory objects, maintained on every
+    /// bind and unbind. Address spaces with the same objects (but possibly
+    /// different contents) have the same value.
+    uint64_t bindingsHash;
+
     /// Extracts known expression patterns from the symbolic
     /// address to quickly resolve the object.
     /// Supported patterns:
@@ -68,9 +87,11 @@ namespace klee {
                                       bool *inBounds);
 
   public:
-    AddressSpace(ExecutionState* _state) : cowKey(1), state(_state) {}
+    AddressSpace(ExecutionState* _state)
+      : cowKey(1), state(_state), bindingsHash(0) {}
     AddressSpace(const AddressSpace &b) :
-            cowKey(++b.cowKey), objects(b.objects), state(NULL) { }
+            cowKey(++b.cowKey), objects(b.objects), state(NULL),
+            bindingsHash(b.bindingsHash) { }
     ~AddressSpace() {}
 
     /// Resolve address to an ObjectPair in result.
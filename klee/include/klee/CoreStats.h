@@ -16,6 +16,7 @@ namespace klee {
 namespace stats {
 
   extern Statistic allocations;
+  extern Statistic deallocations;
   extern Statistic resolveTime;
   extern Statistic instructions;
   extern Statistic instructionTime;
@@ -27,6 +28,13 @@ namespace stats {
   extern Statistic forkTime;
   extern Statistic solverTime;
 
+  /// Straight-line concrete regions run as native code, the instructions
+  /// they covered, and the times a symbolic input sent a region back to
+  /// the interpreter.
+  extern Statistic concreteRegions;
+  extern Statistic concreteRegionInstructions;
+  extern Statistic concreteRegionBailouts;
+
   /// The number of process forks.
   extern Statistic forks;
 
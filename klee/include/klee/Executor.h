@@ -47,6 +47,7 @@ namespace llvm {
 
 namespace klee {
   class Array;
+  class ConcreteRegionJIT;
   struct Cell;
   class ExecutionState;
   class ExternalDispatcher;
@@ -106,6 +107,7 @@ protected:
   Searcher *searcher;
 
   ExternalDispatcher *externalDispatcher;
+  ConcreteRegionJIT *concreteRegionJIT;
   SolverFactory *solverFactory;
   TimingSolver *solver;
   MemoryManager *memory;
@@ -213,6 +215,12 @@ protected:
   void initializeGlobals(ExecutionState &state);
 
   void stepInstruction(ExecutionState &state);
+
+  /// Runs the concrete region starting at the current instruction as
+  /// native code and steps over it. Returns the number of instructions
+  /// run, or 0, leaving the state untouched, if there is no such region
+  /// or one of its inputs is symbolic.
+  unsigned executeConcreteRegion(ExecutionState &state);
   void updateStates(ExecutionState *current);
   void transferToBasicBlock(llvm::BasicBlock *dst,
 			    llvm::BasicBlock *src,
@@ -272,10 +280,10 @@ protected:
                    ref<Expr> address,
                    KInstruction *target = 0);
 
-  void executeCall(ExecutionState &state,
-                   KInstruction *ki,
-                   llvm::Function *f,
-                   std::vector< ref<Expr> > &arguments);
+  virtual void executeCall(ExecutionState &state,
+                           KInstruction *ki,
+                           llvm::Function *f,
+                           std::vector< ref<Expr> > &arguments);
 
   // do address resolution / object binding / out of bounds checking
   // and perform the operation
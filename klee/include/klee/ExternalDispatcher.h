@@ -47,6 +47,8 @@ namespace klee {
      */
     virtual bool executeCall(llvm::Function *function, llvm::Instruction *i, uint64_t *args);
     virtual void *resolveSymbol(const std::string &name);
+
+    llvm::ExecutionEngine *getExecutionEngine() { return executionEngine; }
   };  
 }
 
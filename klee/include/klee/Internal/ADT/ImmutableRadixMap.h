@@ -0,0 +1,513 @@
+//===-- ImmutableRadixMap.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_IMMUTABLERADIXMAP_H__
+#define __UTIL_IMMUTABLERADIXMAP_H__
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+#include <stdint.h>
+
+namespace klee {
+
+  /// Persistent map from keys with an integer projection (e.g. memory
+  /// objects by address) to values, with the same interface as
+  /// ImmutableMap.
+  ///
+  /// Keys are stored in a radix trie consuming 4 bits per level. The trie
+  /// is only as tall as the largest key needs, so a lookup is a fixed
+  /// number of pointer hops that does not depend on the number of
+  /// elements and never dereferences the keys. Updates copy the path to
+  /// the modified leaf and share everything else, which keeps copies of
+  /// the map (forks) constant time.
+  ///
+  /// KeyOf maps a key_type to its uint64_t position in the trie; distinct
+  /// keys must have distinct positions.
+  template<class K, class D, class KeyOf>
+  class ImmutableRadixMap {
+  public:
+    typedef K key_type;
+    typedef std::pair<K,D> value_type;
+
+  private:
+    static const unsigned DigitBits = 4;
+    static const unsigned Fanout = 1 << DigitBits;
+    static const unsigned MaxLevels = 64 / DigitBits;
+
+    struct Leaf {
+      unsigned refCount;
+      value_type value;
+
+      Leaf(const value_type &_value) : refCount(0), value(_value) {}
+    };
+
+    struct Node {
+      unsigned refCount;
+      /// Level 0 nodes point to leaves, level n to level n-1 nodes
+      unsigned level;
+      /// Number of non-null slots, empty nodes are never kept
+      unsigned used;
+      void *slots[Fanout];
+
+      Node(unsigned _level) : refCount(0), level(_level), used(0) {
+        for (unsigned i = 0; i < Fanout; ++i)
+          slots[i] = 0;
+      }
+
+      Node *child(unsigned i) const { return static_cast<Node*>(slots[i]); }
+      Leaf *leaf(unsigned i) const { return static_cast<Leaf*>(slots[i]); }
+    };
+
+    Node *root;
+    /// Number of levels of the trie, root->level + 1
+    unsigned height;
+    size_t elements;
+
+    static unsigned digit(uint64_t key, unsigned level) {
+      return (key >> (level * DigitBits)) & (Fanout - 1);
+    }
+
+    static bool fits(uint64_t key, unsigned height) {
+      return height >= MaxLevels || !(key >> (height * DigitBits));
+    }
+
+    static void retain(Node *n) { ++n->refCount; }
+
+    static void release(Node *n) {
+      if (--n->refCount)
+        return;
+      for (unsigned i = 0; i < Fanout; ++i) {
+        if (!n->slots[i])
+          continue;
+        if (n->level == 0) {
+          Leaf *l = n->leaf(i);
+          if (--l->refCount == 0)
+            delete l;
+        } else {
+          release(n->child(i));
+        }
+      }
+      delete n;
+    }
+
+    /// Returns a copy of n (or an empty node if n is null) owned by the
+    /// caller, sharing all of n's children.
+    static Node *copy(const Node *n, unsigned level) {
+      Node *c = new Node(level);
+      c->refCount = 1;
+      if (!n)
+        return c;
+      c->used = n->used;
+      for (unsigned i = 0; i < Fanout; ++i) {
+        c->slots[i] = n->slots[i];
+        if (!c->slots[i])
+          continue;
+        if (level == 0)
+          ++n->leaf(i)->refCount;
+        else
+          retain(n->child(i));
+      }
+      return c;
+    }
+
+    static Node *assign(const Node *n, unsigned level, uint64_t key,
+                        Leaf *l, bool &existed) {
+      Node *c = copy(n, level);
+      unsigned d = digit(key, level);
+      if (level == 0) {
+        if (Leaf *old = c->leaf(d)) {
+          existed = true;
+          if (--old->refCount == 0)
+            delete old;
+        } else {
+          ++c->used;
+        }
+        ++l->refCount;
+        c->slots[d] = l;
+      } else {
+        Node *old = c->child(d);
+        c->slots[d] = assign(old, level - 1, key, l, existed);
+        if (old)
+          release(old);
+        else
+          ++c->used;
+      }
+      return c;
+    }
+
+    /// Removes a key known to be present. Returns null when the copy of n
+    /// would be empty.
+    static Node *erase(const Node *n, uint64_t key) {
+      Node *c = copy(n, n->level);
+      unsigned d = digit(key, n->level);
+      if (n->level == 0) {
+        Leaf *old = c->leaf(d);
+        if (--old->refCount == 0)
+          delete old;
+        c->slots[d] = 0;
+        --c->used;
+      } else {
+        Node *old = c->child(d);
+        c->slots[d] = erase(old, key);
+        release(old);
+        if (!c->slots[d])
+          --c->used;
+      }
+      if (!c->used) {
+        release(c);
+        return 0;
+      }
+      return c;
+    }
+
+    static const Leaf *minLeaf(const Node *n) {
+      for (;;) {
+        unsigned i = 0;
+        while (!n->slots[i])
+          ++i;
+        if (n->level == 0)
+          return n->leaf(i);
+        n = n->child(i);
+      }
+    }
+
+    static const Leaf *maxLeaf(const Node *n) {
+      for (;;) {
+        unsigned i = Fanout - 1;
+        while (!n->slots[i])
+          --i;
+        if (n->level == 0)
+          return n->leaf(i);
+        n = n->child(i);
+      }
+    }
+
+    /// Largest element with a position <= key
+    static const Leaf *findLE(const Node *n, uint64_t key) {
+      unsigned d = digit(key, n->level);
+      if (n->level == 0) {
+        for (int i = d; i >= 0; --i)
+          if (n->slots[i])
+            return n->leaf(i);
+        return 0;
+      }
+      if (n->slots[d])
+        if (const Leaf *l = findLE(n->child(d), key))
+          return l;
+      for (int i = d - 1; i >= 0; --i)
+        if (n->slots[i])
+          return maxLeaf(n->child(i));
+      return 0;
+    }
+
+    ImmutableRadixMap(Node *_root, unsigned _height, size_t _elements)
+      : root(_root), height(_height), elements(_elements) {}
+
+  public:
+    class iterator {
+      friend class ImmutableRadixMap;
+
+      /// Retained, so that the map may be updated while iterating over it
+      Node *root;
+      unsigned height;
+      bool atEnd;
+      /// path[l] is the level l node on the way to the current element,
+      /// slot[l] the slot taken in it
+      const Node *path[MaxLevels];
+      unsigned slot[MaxLevels];
+
+      iterator(Node *_root, unsigned _height)
+        : root(_root), height(_height), atEnd(true) {
+        if (root)
+          retain(root);
+      }
+
+      const Leaf *current() const { return path[0]->leaf(slot[0]); }
+
+      void descendMin(unsigned level) {
+        for (;;) {
+          const Node *n = path[level];
+          unsigned i = 0;
+          while (!n->slots[i])
+            ++i;
+          slot[level] = i;
+          if (level == 0)
+            break;
+          path[--level] = n->child(i);
+        }
+      }
+
+      void descendMax(unsigned level) {
+        for (;;) {
+          const Node *n = path[level];
+          unsigned i = Fanout - 1;
+          while (!n->slots[i])
+            --i;
+          slot[level] = i;
+          if (level == 0)
+            break;
+          path[--level] = n->child(i);
+        }
+      }
+
+      /// Positions on the smallest element >= key below n
+      bool seek(const Node *n, uint64_t key) {
+        unsigned level = n->level;
+        unsigned d = digit(key, level);
+        path[level] = n;
+        if (level == 0) {
+          for (unsigned i = d; i < Fanout; ++i) {
+            if (n->slots[i]) {
+              slot[0] = i;
+              return true;
+            }
+          }
+          return false;
+        }
+        if (n->slots[d]) {
+          slot[level] = d;
+          if (seek(n->child(d), key))
+            return true;
+        }
+        for (unsigned i = d + 1; i < Fanout; ++i) {
+          if (n->slots[i]) {
+            slot[level] = i;
+            path[level - 1] = n->child(i);
+            descendMin(level - 1);
+            return true;
+          }
+        }
+        return false;
+      }
+
+    public:
+      iterator() : root(0), height(0), atEnd(true) {}
+      iterator(const iterator &b) : root(0) { *this = b; }
+      ~iterator() {
+        if (root)
+          release(root);
+      }
+
+      iterator &operator=(const iterator &b) {
+        if (b.root)
+          retain(b.root);
+        if (root)
+          release(root);
+        root = b.root;
+        height = b.height;
+        atEnd = b.atEnd;
+        for (unsigned l = 0; !atEnd && l < height; ++l) {
+          path[l] = b.path[l];
+          slot[l] = b.slot[l];
+        }
+        return *this;
+      }
+
+      const value_type &operator*() const { return current()->value; }
+      const value_type *operator->() const { return &current()->value; }
+
+      bool operator==(const iterator &b) const {
+        if (atEnd || b.atEnd)
+          return atEnd == b.atEnd;
+        return current() == b.current();
+      }
+      bool operator!=(const iterator &b) const { return !(*this == b); }
+
+      iterator &operator++() {
+        assert(!atEnd && "incrementing end iterator");
+        for (unsigned level = 0; level < height; ++level) {
+          const Node *n = path[level];
+          for (unsigned i = slot[level] + 1; i < Fanout; ++i) {
+            if (n->slots[i]) {
+              slot[level] = i;
+              if (level > 0) {
+                path[level - 1] = n->child(i);
+                descendMin(level - 1);
+              }
+              return *this;
+            }
+          }
+        }
+        atEnd = true;
+        return *this;
+      }
+
+      iterator &operator--() {
+        if (atEnd) {
+          assert(root && "decrementing begin iterator");
+          atEnd = false;
+          path[height - 1] = root;
+          descendMax(height - 1);
+          return *this;
+        }
+        for (unsigned level = 0; level < height; ++level) {
+          const Node *n = path[level];
+          for (int i = (int) slot[level] - 1; i >= 0; --i) {
+            if (n->slots[i]) {
+              slot[level] = i;
+              if (level > 0) {
+                path[level - 1] = n->child(i);
+                descendMax(level - 1);
+              }
+              return *this;
+            }
+          }
+        }
+        assert(0 && "decrementing begin iterator");
+        return *this;
+      }
+    };
+
+    ImmutableRadixMap() : root(0), height(0), elements(0) {}
+    ImmutableRadixMap(const ImmutableRadixMap &b)
+      : root(b.root), height(b.height), elements(b.elements) {
+      if (root)
+        retain(root);
+    }
+    ~ImmutableRadixMap() {
+      if (root)
+        release(root);
+    }
+
+    ImmutableRadixMap &operator=(const ImmutableRadixMap &b) {
+      if (b.root)
+        retain(b.root);
+      if (root)
+        release(root);
+      root = b.root;
+      height = b.height;
+      elements = b.elements;
+      return *this;
+    }
+
+    bool empty() const { return !elements; }
+    size_t size() const { return elements; }
+    size_t count(const key_type &key) const { return lookup(key) ? 1 : 0; }
+
+    const value_type *lookup(const key_type &k) const {
+      uint64_t key = KeyOf()(k);
+      if (!root || !fits(key, height))
+        return 0;
+      const Node *n = root;
+      while (n->level) {
+        n = n->child(digit(key, n->level));
+        if (!n)
+          return 0;
+      }
+      const Leaf *l = n->leaf(digit(key, 0));
+      return l ? &l->value : 0;
+    }
+
+    /// Returns the element with the largest key not greater than k
+    const value_type *lookup_previous(const key_type &k) const {
+      if (!root)
+        return 0;
+      uint64_t key = KeyOf()(k);
+      const Leaf *l = fits(key, height) ? findLE(root, key) : maxLeaf(root);
+      return l ? &l->value : 0;
+    }
+
+    const value_type &min() const {
+      assert(root && "min of empty map");
+      return minLeaf(root)->value;
+    }
+    const value_type &max() const {
+      assert(root && "max of empty map");
+      return maxLeaf(root)->value;
+    }
+
+    ImmutableRadixMap insert(const value_type &value) const {
+      if (lookup(value.first))
+        return *this;
+      return replace(value);
+    }
+
+    ImmutableRadixMap replace(const value_type &value) const {
+      uint64_t key = KeyOf()(value.first);
+
+      // Grow the trie until the key fits, the old root becoming the
+      // leftmost child of the new one.
+      Node *base = root;
+      unsigned newHeight = height;
+      if (base)
+        retain(base);
+      else
+        newHeight = 1;
+      while (!fits(key, newHeight)) {
+        if (base) {
+          Node *n = new Node(newHeight);
+          n->refCount = 1;
+          n->slots[0] = base;
+          n->used = 1;
+          base = n;
+        }
+        ++newHeight;
+      }
+
+      Leaf *l = new Leaf(value);
+      bool existed = false;
+      Node *newRoot = assign(base, newHeight - 1, key, l, existed);
+      if (base)
+        release(base);
+
+      return ImmutableRadixMap(newRoot, newHeight,
+                               existed ? elements : elements + 1);
+    }
+
+    ImmutableRadixMap remove(const key_type &k) const {
+      if (!lookup(k))
+        return *this;
+      Node *newRoot = erase(root, KeyOf()(k));
+      return ImmutableRadixMap(newRoot, newRoot ? height : 0, elements - 1);
+    }
+
+    iterator begin() const {
+      iterator it(root, height);
+      if (root) {
+        it.atEnd = false;
+        it.path[height - 1] = root;
+        it.descendMin(height - 1);
+      }
+      return it;
+    }
+
+    iterator end() const {
+      return iterator(root, height);
+    }
+
+    /// First element with a key not less than k
+    iterator lower_bound(const key_type &k) const {
+      iterator it(root, height);
+      uint64_t key = KeyOf()(k);
+      if (root && fits(key, height) && it.seek(root, key))
+        it.atEnd = false;
+      return it;
+    }
+
+    /// First element with a key greater than k
+    iterator upper_bound(const key_type &k) const {
+      iterator it = lower_bound(k);
+      if (it != end() && KeyOf()(it->first) == KeyOf()(k))
+        ++it;
+      return it;
+    }
+
+    iterator find(const key_type &k) const {
+      iterator it = lower_bound(k);
+      if (it != end() && KeyOf()(it->first) == KeyOf()(k))
+        return it;
+      return end();
+    }
+  };
+
+}
+
+#endif
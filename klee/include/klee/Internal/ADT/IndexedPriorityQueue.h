@@ -0,0 +1,145 @@
+//===-- IndexedPriorityQueue.h ----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_INDEXEDPRIORITYQUEUE_H__
+#define __UTIL_INDEXEDPRIORITYQUEUE_H__
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <cassert>
+#include <functional>
+#include <vector>
+
+namespace klee {
+
+  /// Binary heap of distinct items that also tracks the position of each
+  /// item, so that the priority of any item can be changed or the item
+  /// removed in O(log n), without scanning the queue.
+  ///
+  /// top() is the item with the greatest priority according to Compare.
+  /// Items must be usable as DenseMap keys (e.g. pointers).
+  template<class T, class Priority, class Compare = std::less<Priority> >
+  class IndexedPriorityQueue {
+    struct Entry {
+      T item;
+      Priority priority;
+    };
+
+    std::vector<Entry> heap;
+    llvm::DenseMap<T, unsigned> positions;
+    Compare compare;
+
+    void place(unsigned pos, const Entry &entry) {
+      heap[pos] = entry;
+      positions[entry.item] = pos;
+    }
+
+    void siftUp(unsigned pos) {
+      Entry entry = heap[pos];
+      while (pos > 0) {
+        unsigned parent = (pos - 1) / 2;
+        if (!compare(heap[parent].priority, entry.priority))
+          break;
+        place(pos, heap[parent]);
+        pos = parent;
+      }
+      place(pos, entry);
+    }
+
+    void siftDown(unsigned pos) {
+      Entry entry = heap[pos];
+      unsigned size = heap.size();
+      for (;;) {
+        unsigned child = 2 * pos + 1;
+        if (child >= size)
+          break;
+        if (child + 1 < size &&
+            compare(heap[child].priority, heap[child + 1].priority))
+          ++child;
+        if (!compare(entry.priority, heap[child].priority))
+          break;
+        place(pos, heap[child]);
+        pos = child;
+      }
+      place(pos, entry);
+    }
+
+    void removeAt(unsigned pos) {
+      positions.erase(heap[pos].item);
+      Entry last = heap.back();
+      heap.pop_back();
+      if (pos == heap.size())
+        return;
+      place(pos, last);
+      siftDown(pos);
+      siftUp(positions[last.item]);
+    }
+
+  public:
+    IndexedPriorityQueue(const Compare &_compare = Compare())
+      : compare(_compare) {}
+
+    bool empty() const { return heap.empty(); }
+    unsigned size() const { return heap.size(); }
+
+    bool contains(const T &item) const { return positions.count(item); }
+
+    const T &top() const {
+      assert(!empty() && "top() on an empty queue");
+      return heap[0].item;
+    }
+
+    const Priority &getPriority(const T &item) const {
+      typename llvm::DenseMap<T, unsigned>::const_iterator it =
+        positions.find(item);
+      assert(it != positions.end() && "item not in the queue");
+      return heap[it->second].priority;
+    }
+
+    /// Inserts the item, or changes its priority if it is already queued.
+    void update(const T &item, const Priority &priority) {
+      typename llvm::DenseMap<T, unsigned>::iterator it = positions.find(item);
+      if (it == positions.end()) {
+        Entry entry = { item, priority };
+        heap.push_back(entry);
+        positions[item] = heap.size() - 1;
+        siftUp(heap.size() - 1);
+        return;
+      }
+
+      unsigned pos = it->second;
+      bool increased = compare(heap[pos].priority, priority);
+      heap[pos].priority = priority;
+      if (increased)
+        siftUp(pos);
+      else
+        siftDown(pos);
+    }
+
+    /// Removes the item if it is queued.
+    void erase(const T &item) {
+      typename llvm::DenseMap<T, unsigned>::iterator it = positions.find(item);
+      if (it != positions.end())
+        removeAt(it->second);
+    }
+
+    void pop() {
+      assert(!empty() && "pop() on an empty queue");
+      removeAt(0);
+    }
+
+    void clear() {
+      heap.clear();
+      positions.clear();
+    }
+  };
+
+}
+
+#endif
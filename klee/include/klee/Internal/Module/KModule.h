@@ -39,6 +39,12 @@ namespace klee {
 
   struct KModulePrivate;
 
+  /// Code the executor derived from a function, dropped along with it.
+  class KFunctionSpecialization {
+  public:
+    virtual ~KFunctionSpecialization() {}
+  };
+
   struct KFunction {
     llvm::Function *function;
 
@@ -54,6 +60,9 @@ namespace klee {
     /// "coverable" for statistics and search heuristics.
     bool trackCoverage;
 
+    /// Owned by the function, see ConcreteRegionJIT
+    KFunctionSpecialization *specialization;
+
   private:
     KFunction(const KFunction&);
     KFunction &operator=(const KFunction&);
@@ -0,0 +1,110 @@
+//===-- SlabAllocator.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SLABALLOCATOR_H
+#define KLEE_SLABALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace klee {
+
+  /// Size-classed allocator for the small, short-lived blocks that make up
+  /// the symbolic memory model (memory objects, object states, their
+  /// concrete stores and byte masks).
+  ///
+  /// Requests are rounded up to a power of two between MinBlockSize and
+  /// MaxBlockSize and served from 64KB slabs aligned on their own size, so
+  /// the slab of a block is found by masking its address. A slab is given
+  /// back to the system as soon as its last block is freed, except for one
+  /// empty slab kept per size class to absorb alloc/free ping-pong. Larger
+  /// requests go straight to malloc.
+  ///
+  /// Callers must pass the original request size back to deallocate().
+  class SlabAllocator {
+  public:
+    static const unsigned MinBlockShift = 4;
+    static const unsigned MaxBlockShift = 12;
+    static const size_t MinBlockSize = 1 << MinBlockShift;
+    static const size_t MaxBlockSize = 1 << MaxBlockShift;
+    static const size_t SlabSize = 64 * 1024;
+
+    struct Stats {
+      /// Number of allocate() and deallocate() calls so far
+      uint64_t allocations;
+      uint64_t deallocations;
+      /// Bytes currently handed out, rounded up to the size class
+      uint64_t liveBytes;
+      /// Bytes currently held in slabs, whether in use or not
+      uint64_t slabBytes;
+      /// Bytes currently handed out through malloc for large requests
+      uint64_t largeBytes;
+      /// Number of slabs obtained from and returned to the system
+      uint64_t slabsAllocated;
+      uint64_t slabsReleased;
+    };
+
+  private:
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    struct Slab {
+      Slab *prev, *next;
+      FreeBlock *freeList;
+      /// Start of the never allocated tail of the slab
+      char *bump;
+      unsigned liveCount;
+      unsigned sizeClass;
+    };
+
+    static const unsigned NumClasses = MaxBlockShift - MinBlockShift + 1;
+    static const size_t SlabHeaderSize = 64;
+
+    /// Slabs with at least one free block, per size class
+    Slab *partial[NumClasses];
+    /// Slabs with every block in use, per size class
+    Slab *full[NumClasses];
+    /// Number of completely empty slabs on each partial list
+    unsigned emptySlabs[NumClasses];
+    unsigned blocksPerSlab[NumClasses];
+
+    Stats stats;
+
+    static unsigned getSizeClass(size_t size);
+    static Slab *getSlab(void *p) {
+      return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(p) &
+                                     ~(uintptr_t) (SlabSize - 1));
+    }
+
+    Slab *&getList(Slab *slab);
+    Slab *newSlab(unsigned sizeClass);
+    void releaseSlab(Slab *slab);
+    void unlink(Slab *slab);
+    void pushFront(Slab *slab);
+
+    SlabAllocator(const SlabAllocator&);
+    void operator=(const SlabAllocator&);
+
+  public:
+    SlabAllocator();
+    ~SlabAllocator();
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    const Stats &getStats() const { return stats; }
+
+    /// Process-wide allocator used by the memory model.
+    static SlabAllocator &get();
+  };
+
+} // End klee namespace
+
+#endif
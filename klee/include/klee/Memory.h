@@ -35,6 +35,9 @@ class MemoryObject {
 private:
   static int counter;
 
+  /// Number of object states and stack frames referring to this object
+  mutable unsigned refCount;
+
 public:
   unsigned id;
   uint64_t address;
@@ -66,6 +69,11 @@ public:
   /// True if the object value can be ignored in local consistency
   bool isValueIgnored;
 
+  /// True if the object (and the memory at its address) is given back to
+  /// the MemoryManager once nothing refers to it anymore. Globals and
+  /// fixed objects live as long as the manager.
+  bool isReclaimable;
+
   /// "Location" for which this memory object was allocated. This
   /// should be either the allocating instruction or the global object
   /// it was allocated for (or whatever else makes sense).
@@ -85,17 +93,20 @@ public:
   // XXX this is just a temp hack, should be removed
   explicit
   MemoryObject(uint64_t _address) 
-    : id(counter++),
+    : refCount(0),
+      id(counter++),
       address(_address),
       size(0),
       isFixed(true),
+      isReclaimable(false),
       allocSite(0) {
   }
 
   MemoryObject(uint64_t _address, unsigned _size, 
                bool _isLocal, bool _isGlobal, bool _isFixed,
                const llvm::Value *_allocSite) 
-    : id(counter++),
+    : refCount(0),
+      id(counter++),
       address(_address),
       size(_size),
       name("unnamed"),
@@ -105,11 +116,19 @@ public:
       fake_object(false),
       isUserSpecified(false),
       isSharedConcrete(false),
+      isReclaimable(false),
       allocSite(_allocSite) {
   }
 
   ~MemoryObject();
 
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
+  void retain() const { ++refCount; }
+  /// Drops a reference, reclaiming the object when it was the last one.
+  void release() const;
+
   /// Get an identifying string for this allocation.
   void getAllocInfo(std::string &result) const;
 
@@ -196,6 +215,9 @@ public:
   ObjectState(const ObjectState &os);
   ~ObjectState();
 
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   inline const MemoryObject *getObject() const { return object; }
 
   void setReadOnly(bool ro) { readOnly = ro; }
@@ -232,15 +254,7 @@ public:
   bool isAllConcrete() const;
 
   inline bool isConcrete(unsigned offset, Expr::Width width) const {
-    if (!concreteMask)
-        return true;
-
-    unsigned size = Expr::getMinBytesForWidth(width);
-    for(unsigned i = 0; i < size; ++i) {
-      if(!isByteConcrete(offset + i))
-        return false;
-    }
-    return true;
+    return isRangeConcrete(offset, Expr::getMinBytesForWidth(width));
   }
 
   const uint8_t *getConcreteStore(bool allowSymbolic = false) const;
@@ -257,6 +271,10 @@ private:
   void write8(unsigned offset, ref<Expr> value);
   void write8(ref<Expr> offset, ref<Expr> value);
 
+  ref<Expr> readWholeSymbolic(unsigned offset, unsigned bytes,
+                              Expr::Width width) const;
+  void writeConcrete(unsigned offset, uint64_t value, unsigned bytes);
+
   void fastRangeCheckOffset(ref<Expr> offset, unsigned *base_r, 
                             unsigned *size_r) const;
   void flushRangeForRead(unsigned rangeBase, unsigned rangeSize) const;
@@ -266,6 +284,10 @@ private:
     return !concreteMask || concreteMask->get(offset);
   }
 
+  inline bool isRangeConcrete(unsigned offset, unsigned bytes) const {
+    return !concreteMask || concreteMask->isRangeAllOnes(offset, bytes);
+  }
+
   inline bool isByteFlushed(unsigned offset) const {
       return flushMask && !flushMask->get(offset);
   }
@@ -150,6 +150,10 @@ namespace klee {
     //
     // FIXME: This should go into a helper class, and should handle failure.
     virtual std::pair< ref<Expr>, ref<Expr> > getRange(const Query&);
+
+    /// setCoreSolverTimeout - Set the timeout of the core solver behind
+    /// this solver to the given value (in seconds); 0 is off.
+    void setCoreSolverTimeout(double timeout);
   };
 
   /// STPSolver - A complete solver based on STP.
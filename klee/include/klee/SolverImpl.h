@@ -56,6 +56,10 @@ namespace klee {
                                       std::vector< std::vector<unsigned char> > 
                                         &values,
                                       bool &hasSolution) = 0;  
+
+    /// setCoreSolverTimeout - Set the timeout of the core solver behind this
+    /// implementation, if any. The default implementation ignores it.
+    virtual void setCoreSolverTimeout(double timeout) {}
 };
 
 }
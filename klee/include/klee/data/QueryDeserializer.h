@@ -38,6 +38,7 @@
 #include "klee/Constraints.h"
 
 #include <istream>
+#include <vector>
 
 
 namespace klee {
@@ -56,6 +57,8 @@ public:
     ~QueryDeserializer();
 
     bool Deserialize(const std::string &blob, Query &query);
+    bool Deserialize(const std::string &blob, Query &query,
+            std::vector<const Array*> &objects);
 
 private:
     typedef std::map<uint64_t, ConditionNodeRef> ConditionNodeMap;
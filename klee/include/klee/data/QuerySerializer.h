@@ -40,6 +40,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 
 namespace klee {
@@ -55,6 +56,9 @@ public:
 
     std::pair<uint64_t, uint64_t> Serialize(const Query &query,
             std::string &blob);
+    // Also records the arrays to compute initial values for
+    std::pair<uint64_t, uint64_t> Serialize(const Query &query,
+            const std::vector<const Array*> &objects, std::string &blob);
 
 private:
     typedef std::map<ConditionNodeRef, uint64_t> ConditionNodeMap;
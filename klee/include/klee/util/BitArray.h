@@ -10,38 +10,110 @@
 #ifndef KLEE_UTIL_BITARRAY_H
 #define KLEE_UTIL_BITARRAY_H
 
+#include "klee/Internal/Support/SlabAllocator.h"
+
+#include <string.h>
+
 namespace klee {
 
-  // XXX would be nice not to have
-  // two allocations here for allocated
-  // BitArrays
+  // Both the object and its bits come from the slab allocator, BitArrays
+  // are created and dropped with every ObjectState copy.
 class BitArray {
 private:
   // XXX(s2e) for now we keep this first to access from C code
   // (yes, we do need to access if really fast)
   uint32_t *bits;
-  
+  unsigned words;
+
+  uint32_t *allocBits() {
+    return static_cast<uint32_t*>(
+        SlabAllocator::get().allocate(sizeof(*bits)*words));
+  }
+
+  /// Mask of the bits of [idx, idx+count) that fall in the word of idx
+  static uint32_t rangeMask(unsigned idx, unsigned count) {
+    unsigned bit = idx & 0x1F;
+    unsigned n = count < 32 - bit ? count : 32 - bit;
+    return (n == 32 ? 0xffffffff : ((1U << n) - 1)) << bit;
+  }
+
+  static void advance(unsigned &idx, unsigned &count) {
+    unsigned n = 32 - (idx & 0x1F);
+    if (n > count)
+      n = count;
+    idx += n;
+    count -= n;
+  }
+
 protected:
   static uint32_t length(unsigned size) { return (size+31)/32; }
 
 public:
-  BitArray(unsigned size, bool value = false) : bits(new uint32_t[length(size)]) {
-    memset(bits, value?0xFF:0, sizeof(*bits)*length(size));
+  BitArray(unsigned size, bool value = false)
+    : words(length(size)) {
+    bits = allocBits();
+    memset(bits, value?0xFF:0, sizeof(*bits)*words);
+  }
+  BitArray(const BitArray &b, unsigned size)
+    : words(length(size)) {
+    bits = allocBits();
+    memcpy(bits, b.bits, sizeof(*bits)*words);
+  }
+  ~BitArray() { SlabAllocator::get().deallocate(bits, sizeof(*bits)*words); }
+
+  static void *operator new(size_t size) {
+    return SlabAllocator::get().allocate(size);
   }
-  BitArray(const BitArray &b, unsigned size) : bits(new uint32_t[length(size)]) {
-    memcpy(bits, b.bits, sizeof(*bits)*length(size));
+  static void operator delete(void *p, size_t size) {
+    SlabAllocator::get().deallocate(p, size);
   }
-  ~BitArray() { delete[] bits; }
 
   inline bool get(unsigned idx) { return (bool) ((bits[idx/32]>>(idx&0x1F))&1); }
   inline void set(unsigned idx) { bits[idx/32] |= 1<<(idx&0x1F); }
   inline void unset(unsigned idx) { bits[idx/32] &= ~(1<<(idx&0x1F)); }
   inline void set(unsigned idx, bool value) { if (value) set(idx); else unset(idx); }
 
+  // Range operations work on a whole 32-bit word at a time, so checking
+  // the mask of a 4 or 8 byte access touches at most two words.
+  inline bool isRangeAllOnes(unsigned idx, unsigned count) {
+    while (count) {
+      uint32_t mask = rangeMask(idx, count);
+      if ((bits[idx/32] & mask) != mask)
+        return false;
+      advance(idx, count);
+    }
+    return true;
+  }
+
+  inline bool isRangeAllZeros(unsigned idx, unsigned count) {
+    while (count) {
+      if (bits[idx/32] & rangeMask(idx, count))
+        return false;
+      advance(idx, count);
+    }
+    return true;
+  }
+
+  inline void setRange(unsigned idx, unsigned count) {
+    while (count) {
+      bits[idx/32] |= rangeMask(idx, count);
+      advance(idx, count);
+    }
+  }
+
+  inline void unsetRange(unsigned idx, unsigned count) {
+    while (count) {
+      bits[idx/32] &= ~rangeMask(idx, count);
+      advance(idx, count);
+    }
+  }
+
   bool isAllZeros(unsigned size) {
     for(unsigned i = 0; i < size/32; ++i)
       if(bits[i] != 0)
         return false;
+    if (!(size&0x1F))
+      return true;
     uint32_t mask = (1 << (size&0x1F)) - 1;
     return (bits[size/32] & mask) == 0;
   }
@@ -50,6 +122,8 @@ public:
     for(unsigned i = 0; i < size/32; ++i)
       if(bits[i] != 0xffffffff)
         return false;
+    if (!(size&0x1F))
+      return true;
     uint32_t mask = (1 << (size&0x1F)) - 1;
     return (bits[size/32] & mask) == mask;
   }
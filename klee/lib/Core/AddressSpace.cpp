@@ -20,10 +20,15 @@ using namespace klee;
 
 ///
 
+static uint64_t hashBinding(const MemoryObject *mo) {
+  return (uint64_t) mo->id * 0x9e3779b97f4a7c15ULL;
+}
+
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   assert(state);
   const ObjectState *oldOS = findObject(mo);
   if(oldOS) state->addressSpaceChange(mo, oldOS, NULL);
+  else bindingsHash ^= hashBinding(mo);
   state->addressSpaceChange(mo, NULL, os);
 
   assert(os->copyOnWriteOwner==0 && "object already has owner");
@@ -34,7 +39,10 @@ void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
 void AddressSpace::unbindObject(const MemoryObject *mo) {
   assert(state);
   const ObjectState *os = findObject(mo);
-  if(os) state->addressSpaceChange(mo, os, NULL);
+  if(os) {
+    state->addressSpaceChange(mo, os, NULL);
+    bindingsHash ^= hashBinding(mo);
+  }
 
   objects = objects.remove(mo);
 }
@@ -421,3 +429,7 @@ bool MemoryObjectLT::operator()(const MemoryObject *a, const MemoryObject *b) co
   return a->address < b->address;
 }
 
+uint64_t MemoryObjectAddress::operator()(const MemoryObject *mo) const {
+  return mo->address;
+}
+
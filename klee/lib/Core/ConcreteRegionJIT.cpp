@@ -0,0 +1,304 @@
+//===-- ConcreteRegionJIT.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ConcreteRegionJIT.h"
+
+#include "klee/Context.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+
+#include "llvm/BasicBlock.h"
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/IRBuilder.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+
+#include <map>
+
+using namespace llvm;
+using namespace klee;
+
+namespace klee {
+  /// The regions of one function, keyed by their first instruction.
+  class KRegionCache : public KFunctionSpecialization {
+  public:
+    struct Entry {
+      /// Null if no region starts at the instruction
+      ConcreteRegion *region;
+      /// Number of times the instruction was reached, until Decided
+      unsigned hits;
+
+      Entry() : region(0), hits(0) {}
+    };
+
+    static const unsigned Decided = ~0U;
+
+    ConcreteRegionJIT *jit;
+    DenseMap<const KInstruction*, Entry> entries;
+
+    KRegionCache(ConcreteRegionJIT *_jit) : jit(_jit) {
+      jit->caches.insert(this);
+    }
+
+    void releaseAll() {
+      for (DenseMap<const KInstruction*, Entry>::iterator
+             it = entries.begin(), ie = entries.end(); it != ie; ++it)
+        if (it->second.region)
+          jit->release(it->second.region);
+      entries.clear();
+    }
+
+    ~KRegionCache() {
+      if (!jit)
+        return;
+      releaseAll();
+      jit->caches.erase(this);
+    }
+  };
+}
+
+static bool isSupportedType(Type *t) {
+  if (t->isPointerTy())
+    return true;
+  return t->isIntegerTy() && cast<IntegerType>(t)->getBitWidth() <= 64;
+}
+
+static Expr::Width getWidth(Type *t) {
+  if (t->isPointerTy())
+    return Context::get().getPointerWidth();
+  return cast<IntegerType>(t)->getBitWidth();
+}
+
+/// Side-effect free instructions whose native semantics are exactly those
+/// of the interpreter on concrete values. Divisions (which the interpreter
+/// checks for zero divisors) and shifts by a variable amount (which are
+/// masked by the hardware) stay interpreted.
+bool ConcreteRegionJIT::isSupported(const Instruction *inst) {
+  if (!isSupportedType(inst->getType()))
+    return false;
+  for (unsigned i = 0, e = inst->getNumOperands(); i != e; ++i)
+    if (!isSupportedType(inst->getOperand(i)->getType()))
+      return false;
+
+  switch (inst->getOpcode()) {
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Mul:
+  case Instruction::And:
+  case Instruction::Or:
+  case Instruction::Xor:
+  case Instruction::ICmp:
+  case Instruction::Select:
+  case Instruction::Trunc:
+  case Instruction::ZExt:
+  case Instruction::SExt:
+  case Instruction::PtrToInt:
+  case Instruction::IntToPtr:
+  case Instruction::BitCast:
+    return true;
+
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr: {
+    const ConstantInt *amount = dyn_cast<ConstantInt>(inst->getOperand(1));
+    return amount && amount->getValue().ult(getWidth(inst->getType()));
+  }
+
+  default:
+    return false;
+  }
+}
+
+ConcreteRegionJIT::ConcreteRegionJIT(ExecutionEngine *_engine,
+                                     unsigned _minRegionSize,
+                                     unsigned _hotCount)
+  : engine(_engine), module(0), minRegionSize(_minRegionSize),
+    hotCount(_hotCount) {
+}
+
+ConcreteRegionJIT::~ConcreteRegionJIT() {
+  for (std::set<KRegionCache*>::iterator it = caches.begin(),
+         ie = caches.end(); it != ie; ++it) {
+    (*it)->releaseAll();
+    (*it)->jit = 0;
+  }
+
+  if (module) {
+    engine->removeModule(module);
+    delete module;
+  }
+}
+
+const ConcreteRegion *ConcreteRegionJIT::getRegion(KInstruction *ki) {
+  KFunction *kf = ki->owner;
+  KRegionCache *cache = static_cast<KRegionCache*>(kf->specialization);
+  if (!cache)
+    kf->specialization = cache = new KRegionCache(this);
+
+  // Compiling costs far more than interpreting a few instructions, so only
+  // the hot spots get a region
+  KRegionCache::Entry &entry = cache->entries[ki];
+  if (entry.hits != KRegionCache::Decided) {
+    if (++entry.hits < hotCount)
+      return 0;
+    entry.hits = KRegionCache::Decided;
+    entry.region = buildRegion(kf, ki);
+    if (entry.region)
+      compile(entry.region);
+  }
+  return entry.region;
+}
+
+void ConcreteRegionJIT::bailout(const ConcreteRegion *region) {
+  KRegionCache *cache =
+    static_cast<KRegionCache*>(region->instructions[0]->owner->specialization);
+
+  // Otherwise each of them would get a shorter region in turn, which would
+  // most likely bail out on the same input
+  for (unsigned i = 1; i < region->instructions.size(); ++i) {
+    KRegionCache::Entry &entry = cache->entries[region->instructions[i]];
+    if (entry.region)
+      release(entry.region);
+    entry.region = 0;
+    entry.hits = KRegionCache::Decided;
+  }
+}
+
+ConcreteRegion *ConcreteRegionJIT::buildRegion(KFunction *kf,
+                                               KInstruction *ki) {
+  std::vector<KInstruction*> instructions;
+  BasicBlock *bb = ki->inst->getParent();
+  for (BasicBlock::iterator it = ki->inst, ie = bb->end();
+       it != ie && isSupported(it); ++it)
+    instructions.push_back(kf->instrMap[it]);
+
+  if (instructions.size() < minRegionSize)
+    return 0;
+
+  ConcreteRegion *region = new ConcreteRegion;
+  region->instructions = instructions;
+  region->function = 0;
+  region->native = 0;
+
+  std::map<const Value*, unsigned> defined, inputs;
+  for (unsigned i = 0; i < instructions.size(); ++i) {
+    Instruction *inst = instructions[i]->inst;
+    for (unsigned j = 0, e = inst->getNumOperands(); j != e; ++j) {
+      Value *op = inst->getOperand(j);
+      if (defined.count(op) || isa<ConstantInt>(op) || inputs.count(op))
+        continue;
+      inputs[op] = region->inputs.size();
+      ConcreteRegion::Input input = { i, j };
+      region->inputs.push_back(input);
+    }
+    defined[inst] = i;
+  }
+
+  for (unsigned i = 0; i < instructions.size(); ++i) {
+    Instruction *inst = instructions[i]->inst;
+    for (Value::use_iterator it = inst->use_begin(), ie = inst->use_end();
+         it != ie; ++it) {
+      if (!defined.count(*it)) {
+        ConcreteRegion::Output output = { i, getWidth(inst->getType()) };
+        region->outputs.push_back(output);
+        break;
+      }
+    }
+  }
+
+  return region;
+}
+
+static Value *fromWord(IRBuilder<> &builder, Value *word, Type *t) {
+  if (t->isPointerTy())
+    return builder.CreateIntToPtr(word, t);
+  if (cast<IntegerType>(t)->getBitWidth() < 64)
+    return builder.CreateTrunc(word, t);
+  return word;
+}
+
+static Value *toWord(IRBuilder<> &builder, Value *v) {
+  Type *i64 = builder.getInt64Ty();
+  if (v->getType()->isPointerTy())
+    return builder.CreatePtrToInt(v, i64);
+  if (cast<IntegerType>(v->getType())->getBitWidth() < 64)
+    return builder.CreateZExt(v, i64);
+  return v;
+}
+
+void ConcreteRegionJIT::compile(ConcreteRegion *region) {
+  LLVMContext &ctx = region->instructions[0]->inst->getContext();
+  if (!module) {
+    module = new Module("ConcreteRegions", ctx);
+    engine->addModule(module);
+  }
+
+  Type *i64 = Type::getInt64Ty(ctx);
+  std::vector<Type*> params(1, PointerType::getUnqual(i64));
+  Function *f = Function::Create(
+      FunctionType::get(Type::getVoidTy(ctx), params, false),
+      GlobalValue::ExternalLinkage, "", module);
+
+  IRBuilder<> builder(BasicBlock::Create(ctx, "entry", f));
+  Value *io = f->arg_begin();
+
+  std::map<Value*, Value*> values;
+  for (unsigned i = 0; i < region->inputs.size(); ++i) {
+    const ConcreteRegion::Input &input = region->inputs[i];
+    Value *op = region->instructions[input.instruction]->inst->
+      getOperand(input.operand);
+    Value *word = builder.CreateLoad(builder.CreateConstGEP1_32(io, i));
+    values[op] = fromWord(builder, word, op->getType());
+  }
+
+  for (unsigned i = 0; i < region->instructions.size(); ++i) {
+    Instruction *inst = region->instructions[i]->inst;
+    Instruction *clone = inst->clone();
+
+    // Debug locations refer to the metadata of the original module
+    SmallVector<std::pair<unsigned, MDNode*>, 4> metadata;
+    clone->getAllMetadata(metadata);
+    for (unsigned j = 0; j < metadata.size(); ++j)
+      clone->setMetadata(metadata[j].first, 0);
+
+    for (unsigned j = 0, e = clone->getNumOperands(); j != e; ++j) {
+      std::map<Value*, Value*>::iterator it =
+        values.find(clone->getOperand(j));
+      if (it != values.end())
+        clone->setOperand(j, it->second);
+    }
+    builder.Insert(clone);
+    values[inst] = clone;
+  }
+
+  unsigned base = region->inputs.size();
+  for (unsigned i = 0; i < region->outputs.size(); ++i) {
+    Instruction *inst =
+      region->instructions[region->outputs[i].instruction]->inst;
+    builder.CreateStore(toWord(builder, values[inst]),
+                        builder.CreateConstGEP1_32(io, base + i));
+  }
+  builder.CreateRetVoid();
+
+  region->function = f;
+  region->native = (ConcreteRegion::NativeFunction)
+    (uintptr_t) engine->getPointerToFunction(f);
+}
+
+void ConcreteRegionJIT::release(ConcreteRegion *region) {
+  engine->freeMachineCodeForFunction(region->function);
+  region->function->eraseFromParent();
+  delete region;
+}
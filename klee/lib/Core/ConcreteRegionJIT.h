@@ -0,0 +1,95 @@
+//===-- ConcreteRegionJIT.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONCRETEREGIONJIT_H
+#define KLEE_CONCRETEREGIONJIT_H
+
+#include "klee/Expr.h"
+
+#include <set>
+#include <vector>
+#include <stdint.h>
+
+namespace llvm {
+  class ExecutionEngine;
+  class Function;
+  class Instruction;
+  class Module;
+}
+
+namespace klee {
+  struct KFunction;
+  struct KInstruction;
+  class KRegionCache;
+
+  /// A run of consecutive side-effect free integer instructions of a basic
+  /// block, compiled to native code taking its inputs and producing its
+  /// outputs through an array of 64-bit words.
+  struct ConcreteRegion {
+    struct Input {
+      /// Instruction of the region and operand index to evaluate
+      unsigned instruction, operand;
+    };
+
+    struct Output {
+      unsigned instruction;
+      Expr::Width width;
+    };
+
+    typedef void (*NativeFunction)(uint64_t *io);
+
+    /// The instructions of the region, in execution order
+    std::vector<KInstruction*> instructions;
+    /// Stored in io[0 .. inputs.size()), each input must be concrete
+    std::vector<Input> inputs;
+    /// Values used after the region, in io[inputs.size() ...]
+    std::vector<Output> outputs;
+
+    llvm::Function *function;
+    NativeFunction native;
+  };
+
+  /// Per-function cache of the concrete regions starting at each
+  /// instruction, compiled once the instruction has been reached hotCount
+  /// times.
+  class ConcreteRegionJIT {
+    friend class KRegionCache;
+
+    llvm::ExecutionEngine *engine;
+    llvm::Module *module;
+    unsigned minRegionSize;
+    unsigned hotCount;
+
+    /// Caches of live functions, detached if the JIT goes away first
+    std::set<KRegionCache*> caches;
+
+    ConcreteRegion *buildRegion(KFunction *kf, KInstruction *ki);
+    void compile(ConcreteRegion *region);
+    void release(ConcreteRegion *region);
+
+  public:
+    ConcreteRegionJIT(llvm::ExecutionEngine *_engine, unsigned _minRegionSize,
+                      unsigned _hotCount);
+    ~ConcreteRegionJIT();
+
+    /// Returns the region starting at ki, or null if ki does not start a
+    /// region worth running natively (yet).
+    const ConcreteRegion *getRegion(KInstruction *ki);
+
+    /// Records that region could not run because an input was symbolic.
+    /// The interpreter then steps through the region, so its other
+    /// instructions are never tried as region entry points.
+    void bailout(const ConcreteRegion *region);
+
+    static bool isSupported(const llvm::Instruction *inst);
+  };
+
+} // End klee namespace
+
+#endif
@@ -12,7 +12,11 @@
 using namespace klee;
 
 Statistic stats::allocations("Allocations", "Alloc");
+Statistic stats::concreteRegionBailouts("ConcreteRegionBailouts", "CRbail");
+Statistic stats::concreteRegionInstructions("ConcreteRegionInstructions", "CRinst");
+Statistic stats::concreteRegions("ConcreteRegions", "CRegions");
 Statistic stats::coveredInstructions("CoveredInstructions", "Icov");
+Statistic stats::deallocations("Deallocations", "Dealloc");
 Statistic stats::falseBranches("FalseBranches", "Bf");
 Statistic stats::forkTime("ForkTime", "Ftime");
 Statistic stats::forks("Forks", "Forks");
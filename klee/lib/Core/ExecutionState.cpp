@@ -53,10 +53,17 @@ StackFrame::StackFrame(const StackFrame &s)
   locals = new Cell[s.kf->numRegisters];
   for (unsigned i=0; i<s.kf->numRegisters; i++)
     locals[i] = s.locals[i];
+  for (std::vector<const MemoryObject*>::iterator it = allocas.begin(),
+         ie = allocas.end(); it != ie; ++it)
+    (*it)->retain();
 }
 
 StackFrame::~StackFrame() { 
   delete[] locals; 
+  // Released last: popFrame() still looks the allocas up to unbind them
+  for (std::vector<const MemoryObject*>::iterator it = allocas.begin(),
+         ie = allocas.end(); it != ie; ++it)
+    (*it)->release();
 }
 
 /***/
@@ -92,6 +99,10 @@ ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
 
 ExecutionState::~ExecutionState() {
   while (!stack.empty()) popFrame();
+
+  for (std::vector<std::pair<const MemoryObject*, const Array*> >::iterator
+         it = symbolics.begin(), ie = symbolics.end(); it != ie; ++it)
+    it->first->release();
 }
 
 ExecutionState* ExecutionState::clone() {
@@ -111,12 +122,24 @@ ExecutionState *ExecutionState::branch() {
   falseState->coveredNew = false;
   falseState->coveredLines.clear();
 
+  // The copied symbolics list holds its own references
+  for (std::vector<std::pair<const MemoryObject*, const Array*> >::iterator
+         it = symbolics.begin(), ie = symbolics.end(); it != ie; ++it)
+    it->first->retain();
+
   weight *= .5;
   falseState->weight -= weight;
 
   return falseState;
 }
 
+void ExecutionState::addSymbolic(const MemoryObject *mo, const Array *array) {
+  // Symbolic objects are needed for test cases until the very end, the
+  // reference is dropped when the state is destroyed
+  mo->retain();
+  symbolics.push_back(std::make_pair(mo, array));
+}
+
 void ExecutionState::pushFrame(KInstIterator caller, KFunction *kf) {
   stack.push_back(StackFrame(caller,kf));
 }
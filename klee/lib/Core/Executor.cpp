@@ -14,6 +14,7 @@
 #include "klee/Context.h"
 #include "klee/CoreStats.h"
 #include "klee/ExternalDispatcher.h"
+#include "ConcreteRegionJIT.h"
 #include "ImpliedValue.h"
 #include "klee/Memory.h"
 #include "MemoryManager.h"
@@ -232,6 +233,21 @@ namespace {
             cl::desc("Checks that the simplification algorithm produced correct expressions"),
             cl::init(false));
 
+  cl::opt<bool>
+  JITConcreteRegions("jit-concrete-regions",
+            cl::desc("Run straight-line integer code with concrete inputs as native code"),
+            cl::init(false));
+
+  cl::opt<unsigned>
+  ConcreteRegionMinSize("concrete-region-min-size",
+            cl::desc("Minimum number of instructions of a natively run region (default=3)"),
+            cl::init(3));
+
+  cl::opt<unsigned>
+  ConcreteRegionHotCount("concrete-region-hot-count",
+            cl::desc("Number of times an instruction is reached before a region starting there is compiled (default=16)"),
+            cl::init(16));
+
   cl::opt<bool>
   EnableSpeculativeForking("enable-speculative-forking",
             cl::desc("Enable speculative forking for concolic execution"),
@@ -281,8 +297,7 @@ void Executor::initializeSolver()
 
     Solver *solver = solverFactory->decorateSolver(endSolver);
 
-    this->solver = new TimingSolver(solver,
-            dynamic_cast<STPSolver*>(endSolver));
+    this->solver = new TimingSolver(solver, endSolver);
 }
 
 Executor::Executor(const InterpreterOptions &opts, InterpreterHandler *ih,
@@ -293,6 +308,7 @@ Executor::Executor(const InterpreterOptions &opts, InterpreterHandler *ih,
     interpreterHandler(ih),
     searcher(0),
     externalDispatcher(new ExternalDispatcher(engine)),
+    concreteRegionJIT(0),
     solverFactory(solver_factory),
     statsTracker(0),
     eventLogger(event_logger),
@@ -325,6 +341,11 @@ Executor::Executor(const InterpreterOptions &opts, InterpreterHandler *ih,
 
   //Mandatory for AddressSpace
   exprSimplifier = new BitfieldSimplifier;
+
+  if (JITConcreteRegions)
+    concreteRegionJIT = new ConcreteRegionJIT(
+        externalDispatcher->getExecutionEngine(), ConcreteRegionMinSize,
+        ConcreteRegionHotCount);
 }
 
 
@@ -359,6 +380,8 @@ const Module *Executor::setModule(llvm::Module *module,
 
 Executor::~Executor() {
   delete memory;
+  // Regions live in the dispatcher's execution engine
+  delete concreteRegionJIT;
   delete externalDispatcher;
   if (processTree)
     delete processTree;
@@ -1381,6 +1404,42 @@ void Executor::stepInstruction(ExecutionState &state) {
     haltExecution = true;
 }
 
+unsigned Executor::executeConcreteRegion(ExecutionState &state) {
+  const ConcreteRegion *region = concreteRegionJIT->getRegion(state.pc);
+  if (!region)
+    return 0;
+
+  unsigned numInputs = region->inputs.size();
+  SmallVector<uint64_t, 16> io(numInputs + region->outputs.size());
+  for (unsigned i = 0; i < numInputs; ++i) {
+    const ConcreteRegion::Input &input = region->inputs[i];
+    ref<Expr> value = eval(region->instructions[input.instruction],
+                           input.operand, state).value;
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(value);
+    if (!ce) {
+      ++stats::concreteRegionBailouts;
+      concreteRegionJIT->bailout(region);
+      return 0;
+    }
+    io[i] = ce->getZExtValue();
+  }
+
+  region->native(io.begin());
+
+  for (unsigned i = 0; i < region->instructions.size(); ++i)
+    stepInstruction(state);
+
+  for (unsigned i = 0; i < region->outputs.size(); ++i) {
+    const ConcreteRegion::Output &output = region->outputs[i];
+    bindLocal(region->instructions[output.instruction], state,
+              ConstantExpr::create(io[numInputs + i], output.width));
+  }
+
+  ++stats::concreteRegions;
+  stats::concreteRegionInstructions += region->instructions.size();
+  return region->instructions.size();
+}
+
 void Executor::executeCall(ExecutionState &state, 
                            KInstruction *ki,
                            Function *f,
@@ -2708,6 +2767,11 @@ void Executor::run(ExecutionState &initialState) {
 
   while (!states.empty() && !haltExecution) {
     ExecutionState &state = searcher->selectState();
+    if (concreteRegionJIT && executeConcreteRegion(state)) {
+      processTimers(&state, MaxInstructionTime);
+      continue;
+    }
+
     KInstruction *ki = state.pc;
     stepInstruction(state);
 
@@ -3098,8 +3162,10 @@ ObjectState *Executor::bindObjectInState(ExecutionState &state,
   // will put multiple copies on this list, but it doesn't really
   // matter because all we use this list for is to unbind the object
   // on function return.
-  if (isLocal)
+  if (isLocal) {
+    mo->retain();
     state.stack.back().allocas.push_back(mo);
+  }
 
   return os;
 }
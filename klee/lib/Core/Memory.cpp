@@ -15,8 +15,10 @@
 #include "klee/Expr.h"
 #include "klee/Solver.h"
 #include "klee/util/BitArray.h"
+#include "klee/Internal/Support/SlabAllocator.h"
 
 #include "klee/ObjectHolder.h"
+#include "MemoryManager.h"
 
 #include <llvm/Function.h>
 #include <llvm/Instruction.h>
@@ -65,6 +67,20 @@ int MemoryObject::counter = 0;
 MemoryObject::~MemoryObject() {
 }
 
+void *MemoryObject::operator new(size_t size) {
+  return SlabAllocator::get().allocate(size);
+}
+
+void MemoryObject::operator delete(void *p, size_t size) {
+  SlabAllocator::get().deallocate(p, size);
+}
+
+void MemoryObject::release() const {
+  assert(refCount > 0 && "releasing unreferenced memory object");
+  if (--refCount == 0 && isReclaimable)
+    MemoryManager::deallocate(this);
+}
+
 void MemoryObject::getAllocInfo(std::string &result) const {
   llvm::raw_string_ostream info(result);
 
@@ -94,13 +110,15 @@ ObjectState::ObjectState(const MemoryObject *mo)
     copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteStore(static_cast<uint8_t*>(
+        SlabAllocator::get().allocate(mo->size))),
     flushMask(0),
     knownSymbolics(0),
     updates(0, 0),
     size(mo->size),
     readOnly(false)
      {
+  mo->retain();
   if (!UseConstantArrays) {
     // FIXME: Leaked.
     static unsigned id = 0;
@@ -115,13 +133,15 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
     copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteStore(static_cast<uint8_t*>(
+        SlabAllocator::get().allocate(mo->size))),
     flushMask(0),
     knownSymbolics(0),
     updates(array, 0),
     size(mo->size),
     readOnly(false)
  {
+  mo->retain();
   makeSymbolic();
 }
 
@@ -130,7 +150,8 @@ ObjectState::ObjectState(const ObjectState &os)
     copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
+    concreteStore(static_cast<uint8_t*>(
+        SlabAllocator::get().allocate(os.size))),
     flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
     knownSymbolics(0),
     updates(os.updates),
@@ -138,6 +159,7 @@ ObjectState::ObjectState(const ObjectState &os)
     readOnly(false)
      {
   assert(!os.readOnly && "no need to copy read only object?");
+  object->retain();
 
   if (os.knownSymbolics) {
     knownSymbolics = new ref<Expr>[size];
@@ -152,7 +174,16 @@ ObjectState::~ObjectState() {
   if (concreteMask) delete concreteMask;
   if (flushMask) delete flushMask;
   if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  SlabAllocator::get().deallocate(concreteStore, size);
+  object->release();
+}
+
+void *ObjectState::operator new(size_t size) {
+  return SlabAllocator::get().allocate(size);
+}
+
+void ObjectState::operator delete(void *p, size_t size) {
+  SlabAllocator::get().deallocate(p, size);
 }
 
 /***/
@@ -480,9 +511,37 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid write size!");
+
+  if (NumBytes <= 8) {
+    // Fast path: all bytes are concrete, assemble the value directly
+    // instead of concatenating byte constants.
+    const uint8_t *store = 0;
+    if (object->isSharedConcrete)
+      store = (const uint8_t*) object->address;
+    else if (isRangeConcrete(offset, NumBytes))
+      store = concreteStore;
+
+    if (store) {
+      bool littleEndian = Context::get().isLittleEndian();
+      uint64_t value = 0;
+      for (unsigned i = 0; i != NumBytes; ++i) {
+        unsigned idx = littleEndian ? i : (NumBytes - i - 1);
+        value |= (uint64_t) store[offset + idx] << (8 * i);
+      }
+      return ConstantExpr::create(value, width);
+    }
+
+    // Fast path: the word was last written as one symbolic value
+    if (knownSymbolics) {
+      ref<Expr> Res = readWholeSymbolic(offset, NumBytes, width);
+      if (!Res.isNull())
+        return Res;
+    }
+  }
+
+  // Otherwise, follow the slow general case.
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -553,28 +612,68 @@ void ObjectState::write(unsigned offset, ref<Expr> value) {
   }
 } 
 
-void ObjectState::write16(unsigned offset, uint16_t value) {
-  unsigned NumBytes = 2;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
+/// Returns the expression the bytes at [offset, offset+bytes) were
+/// extracted from when they were written as a single symbolic value of the
+/// given width, or null if they were not.
+ref<Expr> ObjectState::readWholeSymbolic(unsigned offset, unsigned bytes,
+                                         Expr::Width width) const {
+  bool littleEndian = Context::get().isLittleEndian();
+  const Expr *whole = 0;
+
+  for (unsigned i = 0; i != bytes; ++i) {
+    unsigned idx = littleEndian ? i : (bytes - i - 1);
+    const ExtractExpr *EE =
+      dyn_cast_or_null<ExtractExpr>(knownSymbolics[offset + idx].get());
+    if (!EE || EE->offset != 8 * i || EE->width != Expr::Int8)
+      return ref<Expr>();
+    if (i == 0) {
+      whole = EE->expr.get();
+      if (whole->getWidth() != width)
+        return ref<Expr>();
+    } else if (EE->expr.get() != whole) {
+      return ref<Expr>();
+    }
   }
+
+  return const_cast<Expr*>(whole);
 }
 
-void ObjectState::write32(unsigned offset, uint32_t value) {
-  unsigned NumBytes = 4;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
+/// Equivalent to write8() on each byte of the value, with the masks
+/// updated a word at a time.
+void ObjectState::writeConcrete(unsigned offset, uint64_t value,
+                                unsigned bytes) {
+  bool littleEndian = Context::get().isLittleEndian();
+  uint8_t *store = object->isSharedConcrete ?
+                     (uint8_t*) object->address : concreteStore;
+
+  for (unsigned i = 0; i != bytes; ++i) {
+    unsigned idx = littleEndian ? i : (bytes - i - 1);
+    store[offset + idx] = (uint8_t) (value >> (8 * i));
   }
+
+  if (object->isSharedConcrete)
+    return;
+
+  if (knownSymbolics) {
+    for (unsigned i = 0; i != bytes; ++i)
+      knownSymbolics[offset + i] = 0;
+  }
+  if (concreteMask)
+    concreteMask->setRange(offset, bytes);
+  if (flushMask)
+    flushMask->setRange(offset, bytes);
+}
+
+void ObjectState::write16(unsigned offset, uint16_t value) {
+  writeConcrete(offset, value, 2);
+}
+
+void ObjectState::write32(unsigned offset, uint32_t value) {
+  writeConcrete(offset, value, 4);
 }
 
 void ObjectState::write64(unsigned offset, uint64_t value) {
-  unsigned NumBytes = 8;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
-  }
+  writeConcrete(offset, value, 8);
 }
 
 void ObjectState::print() {
@@ -16,6 +16,7 @@
 #include "klee/ExecutionState.h"
 #include "klee/Expr.h"
 #include "klee/Solver.h"
+#include "klee/Internal/Support/SlabAllocator.h"
 
 #include "llvm/Support/CommandLine.h"
 
@@ -27,7 +28,10 @@ MemoryManager::~MemoryManager() {
   while (!objects.empty()) {
     MemoryObject *mo = objects.back();
     objects.pop_back();
+    if (!mo->isFixed)
+      SlabAllocator::get().deallocate((void*) mo->address, mo->size);
     delete mo;
+    ++stats::deallocations;
   }
 }
 
@@ -38,14 +42,19 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
     klee_warning_once(0, "failing large alloc: %u bytes", (unsigned) size);
     return 0;
   }
-  uintptr_t address = (uintptr_t) malloc((unsigned) size);
-  if (!address)
-    return 0;
-  
+  uintptr_t address = (uintptr_t) SlabAllocator::get().allocate(size);
+
   ++stats::allocations;
   MemoryObject *res = new MemoryObject(address, size, isLocal, isGlobal, false,
                                        allocSite);
-  objects.push_back(res);
+  if (isGlobal) {
+    // Globals may be looked up through Executor::globalObjects long after
+    // every state dropped them.
+    res->retain();
+    objects.push_back(res);
+  } else {
+    res->isReclaimable = true;
+  }
   return res;
 }
 
@@ -65,10 +74,16 @@ MemoryObject *MemoryManager::allocateFixed(uint64_t address, uint64_t size,
   ++stats::allocations;
   MemoryObject *res = new MemoryObject(address, size, false, true, true,
                                        allocSite);
+  res->retain();
   objects.push_back(res);
   return res;
 }
 
 void MemoryManager::deallocate(const MemoryObject *mo) {
-  assert(0);
+  assert(mo->isReclaimable && "deallocating object owned by the manager");
+
+  SlabAllocator::get().deallocate((void*) mo->address, mo->size);
+  delete mo;
+
+  ++stats::deallocations;
 }
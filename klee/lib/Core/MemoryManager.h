@@ -22,6 +22,9 @@ namespace klee {
 
   class MemoryManager {
   private:
+    /// Objects that live as long as the manager (globals and fixed
+    /// objects). Everything else is reclaimed through deallocate() as soon
+    /// as the last object state or stack frame referring to it goes away.
     typedef std::vector<MemoryObject*> objects_ty;
     objects_ty objects;
 
@@ -33,7 +36,9 @@ namespace klee {
                            const llvm::Value *allocSite);
     MemoryObject *allocateFixed(uint64_t address, uint64_t size,
                                 const llvm::Value *allocSite);
-    void deallocate(const MemoryObject *mo);
+    /// Frees a reclaimable object along with its backing memory. Called by
+    /// MemoryObject::release(), not meant to be called directly.
+    static void deallocate(const MemoryObject *mo);
   };
 
 } // End klee namespace
@@ -17,6 +17,7 @@
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Support/ModuleUtil.h"
+#include "klee/Internal/Support/SlabAllocator.h"
 #include "klee/Internal/System/Time.h"
 
 #include "klee/CallPathManager.h"
@@ -366,6 +367,9 @@ void StatsTracker::writeStatsHeader() {
              << "'CexCacheTime',"
              << "'ForkTime',"
              << "'ResolveTime',"
+             << "'SlabAllocations',"
+             << "'SlabLiveBytes',"
+             << "'SlabBytes',"
              << ")\n";
   statsFile->flush();
 }
@@ -375,6 +379,7 @@ double StatsTracker::elapsed() {
 }
 
 void StatsTracker::writeStatsLine() {
+  const SlabAllocator::Stats &slabStats = SlabAllocator::get().getStats();
   *statsFile << "(" << stats::instructions
              << "," << fullBranches
              << "," << partialBranches
@@ -384,7 +389,7 @@ void StatsTracker::writeStatsLine() {
              << "," << sys::Process::GetTotalMemoryUsage()
              << "," << stats::queries
              << "," << stats::queryConstructs
-             << "," << 0 // was numObjects
+             << "," << stats::allocations - stats::deallocations
              << "," << elapsed()
              << "," << stats::coveredInstructions
              << "," << stats::uncoveredInstructions
@@ -393,6 +398,9 @@ void StatsTracker::writeStatsLine() {
              << "," << stats::cexCacheTime / 1000000.
              << "," << stats::forkTime / 1000000.
              << "," << stats::resolveTime / 1000000.
+             << "," << slabStats.allocations
+             << "," << slabStats.liveBytes + slabStats.largeBytes
+             << "," << slabStats.slabBytes + slabStats.largeBytes
              << ")\n";
   statsFile->flush();
 }
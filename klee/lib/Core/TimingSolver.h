@@ -25,24 +25,30 @@ namespace klee {
   class TimingSolver {
   public:
     Solver *solver;
+    Solver *endSolver;
     STPSolver *stpSolver;
     bool simplifyExprs;
 
   public:
     /// TimingSolver - Construct a new timing solver.
     ///
+    /// \param _endSolver - The core solver at the end of the chain, which
+    /// receives the timeouts.
+    ///
     /// \param _simplifyExprs - Whether expressions should be
     /// simplified (via the constraint manager interface) prior to
     /// querying.
-    TimingSolver(Solver *_solver, STPSolver *_stpSolver, 
+    TimingSolver(Solver *_solver, Solver *_endSolver,
                  bool _simplifyExprs = true) 
-      : solver(_solver), stpSolver(_stpSolver), simplifyExprs(_simplifyExprs) {}
+      : solver(_solver), endSolver(_endSolver),
+        stpSolver(dynamic_cast<STPSolver*>(_endSolver)),
+        simplifyExprs(_simplifyExprs) {}
     ~TimingSolver() {
       delete solver;
     }
 
     void setTimeout(double t) {
-      stpSolver->setTimeout(t);
+      endSolver->setCoreSolverTimeout(t);
     }
 
     bool evaluate(const ExecutionState&, ref<Expr>, Solver::Validity &result);
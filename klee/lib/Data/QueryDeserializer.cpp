@@ -57,6 +57,13 @@ QueryDeserializer::~QueryDeserializer() {
 
 
 bool QueryDeserializer::Deserialize(const std::string &blob, Query &query) {
+    std::vector<const Array*> objects;
+    return Deserialize(blob, query, objects);
+}
+
+
+bool QueryDeserializer::Deserialize(const std::string &blob, Query &query,
+        std::vector<const Array*> &objects) {
     data::QueryData query_data;
     if (!query_data.ParseFromString(blob)) {
         llvm::errs() << "QueryDeserializer: Invalid query frame." << '\n';
@@ -83,6 +90,16 @@ bool QueryDeserializer::Deserialize(const std::string &blob, Query &query) {
     query = Query(ConstraintManager(root_, seed),
             expr_deserializer_.GetExpr(query_data.expr_id()));
 
+    objects.clear();
+    for (int i = 0; i < query_data.object_expr_id_size(); ++i) {
+        ref<Expr> read = expr_deserializer_.GetExpr(query_data.object_expr_id(i));
+        if (!isa<ReadExpr>(read)) {
+            llvm::errs() << "QueryDeserializer: Invalid object expression." << '\n';
+            return false;
+        }
+        objects.push_back(cast<ReadExpr>(read)->updates.root);
+    }
+
     return true;
 }
 
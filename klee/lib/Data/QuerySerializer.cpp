@@ -55,6 +55,12 @@ QuerySerializer::~QuerySerializer() {
 
 std::pair<uint64_t, uint64_t> QuerySerializer::Serialize(const Query &query,
         std::string &blob) {
+    return Serialize(query, std::vector<const Array*>(), blob);
+}
+
+
+std::pair<uint64_t, uint64_t> QuerySerializer::Serialize(const Query &query,
+        const std::vector<const Array*> &objects, std::string &blob) {
     data::QueryData query_data;
 
     ExprFrame expr_frame(es_, query_data.mutable_expr_data());
@@ -62,6 +68,14 @@ std::pair<uint64_t, uint64_t> QuerySerializer::Serialize(const Query &query,
     query_data.set_id(next_id_++);
     query_data.set_expr_id(expr_frame.RecordExpr(query.expr));
 
+    // Use alloc, so the reads are not folded for constant arrays
+    for (std::vector<const Array*>::const_iterator it = objects.begin(),
+            ie = objects.end(); it != ie; ++it) {
+        query_data.add_object_expr_id(expr_frame.RecordExpr(
+                ReadExpr::alloc(UpdateList(*it, 0),
+                        ConstantExpr::alloc(0, Expr::Int32))));
+    }
+
     // XXX: Not really incremental, might happen that two queries
     // share the same prefix.
     for (ConditionNodeRef node = query.constraints.head(),
@@ -651,7 +651,8 @@ KFunction::KFunction(llvm::Function *_function,
   : function(_function),
     numArgs(function->arg_size()),
     numInstructions(0),
-    trackCoverage(true) {
+    trackCoverage(true),
+    specialization(0) {
   for (llvm::Function::iterator bbit = function->begin(), 
          bbie = function->end(); bbit != bbie; ++bbit) {
     BasicBlock *bb = bbit;
@@ -739,6 +740,7 @@ KFunction::KFunction(llvm::Function *_function,
 }
 
 KFunction::~KFunction() {
+  delete specialization;
   for (unsigned i=0; i<numInstructions; ++i)
     delete instructions[i];
   delete[] instructions;
@@ -77,7 +77,7 @@ public:
   ~STPSolverImpl();
 
   char *getConstraintLog(const Query&);
-  void setTimeout(double _timeout) { timeout = _timeout; }
+  void setCoreSolverTimeout(double _timeout) { timeout = _timeout; }
 
   bool computeTruth(const Query&, bool &isValid);
   bool computeValue(const Query&, ref<Expr> &result);
@@ -175,7 +175,7 @@ char *STPSolver::getConstraintLog(const Query &query) {
 }
 
 void STPSolver::setTimeout(double timeout) {
-  static_cast<STPSolverImpl*>(impl)->setTimeout(timeout);
+  setCoreSolverTimeout(timeout);
 }
 
 /***/
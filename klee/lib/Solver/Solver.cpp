@@ -42,6 +42,10 @@ Solver::~Solver() {
 SolverImpl::~SolverImpl() {
 }
 
+void Solver::setCoreSolverTimeout(double timeout) {
+  impl->setCoreSolverTimeout(timeout);
+}
+
 bool Solver::evaluate(const Query& query, Validity &result) {
   assert(query.expr->getWidth() == Expr::Bool && "Invalid expression type!");
 
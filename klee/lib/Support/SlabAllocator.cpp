@@ -0,0 +1,192 @@
+//===-- SlabAllocator.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/SlabAllocator.h"
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+using namespace klee;
+
+const size_t SlabAllocator::MinBlockSize;
+const size_t SlabAllocator::MaxBlockSize;
+const size_t SlabAllocator::SlabSize;
+
+SlabAllocator::SlabAllocator() {
+  memset(&stats, 0, sizeof(stats));
+  for (unsigned i = 0; i < NumClasses; ++i) {
+    partial[i] = 0;
+    full[i] = 0;
+    emptySlabs[i] = 0;
+    blocksPerSlab[i] = (SlabSize - SlabHeaderSize) >> (MinBlockShift + i);
+  }
+}
+
+SlabAllocator::~SlabAllocator() {
+  for (unsigned i = 0; i < NumClasses; ++i) {
+    while (partial[i]) {
+      Slab *slab = partial[i];
+      unlink(slab);
+      releaseSlab(slab);
+    }
+    while (full[i]) {
+      Slab *slab = full[i];
+      unlink(slab);
+      releaseSlab(slab);
+    }
+  }
+}
+
+SlabAllocator &SlabAllocator::get() {
+  // Never destroyed: memory objects may still be released by static
+  // destructors running after this one would.
+  static SlabAllocator *instance = new SlabAllocator();
+  return *instance;
+}
+
+unsigned SlabAllocator::getSizeClass(size_t size) {
+  if (size <= MinBlockSize)
+    return 0;
+  unsigned bits = sizeof(unsigned long) * 8 - __builtin_clzl(size - 1);
+  return bits - MinBlockShift;
+}
+
+SlabAllocator::Slab *&SlabAllocator::getList(Slab *slab) {
+  bool isFull = slab->liveCount == blocksPerSlab[slab->sizeClass];
+  return isFull ? full[slab->sizeClass] : partial[slab->sizeClass];
+}
+
+void SlabAllocator::unlink(Slab *slab) {
+  Slab *&head = getList(slab);
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    head = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+  slab->prev = slab->next = 0;
+}
+
+void SlabAllocator::pushFront(Slab *slab) {
+  Slab *&head = getList(slab);
+  slab->prev = 0;
+  slab->next = head;
+  if (head)
+    head->prev = slab;
+  head = slab;
+}
+
+SlabAllocator::Slab *SlabAllocator::newSlab(unsigned sizeClass) {
+  void *mem;
+  if (posix_memalign(&mem, SlabSize, SlabSize))
+    llvm::report_fatal_error("slab allocator: out of memory");
+
+  Slab *slab = static_cast<Slab*>(mem);
+  slab->freeList = 0;
+  slab->bump = static_cast<char*>(mem) + SlabHeaderSize;
+  slab->liveCount = 0;
+  slab->sizeClass = sizeClass;
+  pushFront(slab);
+
+  ++emptySlabs[sizeClass];
+  ++stats.slabsAllocated;
+  stats.slabBytes += SlabSize;
+  return slab;
+}
+
+void SlabAllocator::releaseSlab(Slab *slab) {
+  ++stats.slabsReleased;
+  stats.slabBytes -= SlabSize;
+  free(slab);
+}
+
+void *SlabAllocator::allocate(size_t size) {
+  ++stats.allocations;
+
+  if (size > MaxBlockSize) {
+    void *p = malloc(size);
+    if (!p)
+      llvm::report_fatal_error("slab allocator: out of memory");
+    stats.largeBytes += size;
+    return p;
+  }
+
+  unsigned sizeClass = getSizeClass(size);
+  size_t blockSize = MinBlockSize << sizeClass;
+
+  Slab *slab = partial[sizeClass];
+  if (!slab)
+    slab = newSlab(sizeClass);
+
+  void *p;
+  if (slab->freeList) {
+    p = slab->freeList;
+    slab->freeList = slab->freeList->next;
+  } else {
+    p = slab->bump;
+    slab->bump += blockSize;
+  }
+
+  if (slab->liveCount == 0)
+    --emptySlabs[sizeClass];
+  if (slab->liveCount + 1 == blocksPerSlab[sizeClass]) {
+    unlink(slab);
+    ++slab->liveCount;
+    pushFront(slab);
+  } else {
+    ++slab->liveCount;
+  }
+
+  stats.liveBytes += blockSize;
+  return p;
+}
+
+void SlabAllocator::deallocate(void *p, size_t size) {
+  if (!p)
+    return;
+
+  ++stats.deallocations;
+
+  if (size > MaxBlockSize) {
+    stats.largeBytes -= size;
+    free(p);
+    return;
+  }
+
+  Slab *slab = getSlab(p);
+  unsigned sizeClass = slab->sizeClass;
+  assert(sizeClass == getSizeClass(size) && "size does not match allocation");
+  assert(slab->liveCount > 0 && "double free");
+
+  FreeBlock *block = static_cast<FreeBlock*>(p);
+  block->next = slab->freeList;
+  slab->freeList = block;
+
+  if (slab->liveCount == blocksPerSlab[sizeClass]) {
+    unlink(slab);
+    --slab->liveCount;
+    pushFront(slab);
+  } else {
+    --slab->liveCount;
+  }
+
+  stats.liveBytes -= MinBlockSize << sizeClass;
+
+  if (slab->liveCount == 0) {
+    if (emptySlabs[sizeClass] > 0) {
+      unlink(slab);
+      releaseSlab(slab);
+    } else {
+      ++emptySlabs[sizeClass];
+    }
+  }
+}
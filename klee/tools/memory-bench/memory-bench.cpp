@@ -0,0 +1,152 @@
+//===-- memory-bench.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Microbenchmarks for ObjectState word accesses under mixed concrete and
+// symbolic contents.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Context.h"
+#include "klee/Expr.h"
+#include "klee/Memory.h"
+#include "klee/Internal/System/Time.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <stdint.h>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+  cl::opt<unsigned>
+  ObjectSize("object-size",
+             cl::desc("Size of the benchmarked object in bytes (default=4096)"),
+             cl::init(4096));
+
+  cl::opt<unsigned>
+  Iterations("iterations",
+             cl::desc("Passes over the whole object per benchmark "
+                      "(default=1000)"),
+             cl::init(1000));
+
+  cl::opt<unsigned>
+  SymbolicEvery("symbolic-every",
+                cl::desc("In the mixed patterns, make every Nth word "
+                         "symbolic (default=4)"),
+                cl::init(4));
+}
+
+enum Pattern {
+  Concrete,      // every byte concrete
+  WholeWords,    // some words written as one symbolic value
+  SplitWords     // some words with a single symbolic byte
+};
+
+static const char *patternName(Pattern p) {
+  switch (p) {
+  case Concrete: return "concrete";
+  case WholeWords: return "whole-symbolic";
+  case SplitWords: return "split-symbolic";
+  }
+  return "?";
+}
+
+static uintptr_t sink;
+
+static void fill(ObjectState &os, Pattern pattern, Expr::Width width,
+                 const Array *array) {
+  unsigned bytes = width / 8;
+  os.initializeToZero();
+  if (pattern == Concrete)
+    return;
+
+  for (unsigned offset = 0, word = 0; offset + bytes <= os.size;
+       offset += bytes, ++word) {
+    if (word % SymbolicEvery)
+      continue;
+    ref<Expr> value = Expr::createTempRead(array, width);
+    if (pattern == WholeWords) {
+      // A computed value, so that extracting its bytes does not fold back
+      // into the underlying array reads
+      os.write(offset, AddExpr::create(value,
+                                       ConstantExpr::create(word, width)));
+    } else {
+      os.write(offset, ExtractExpr::create(value, 0, Expr::Int8));
+    }
+  }
+}
+
+static double benchRead(ObjectState &os, Expr::Width width) {
+  unsigned bytes = width / 8;
+  double start = util::getWallTime();
+  for (unsigned it = 0; it < Iterations; ++it) {
+    for (unsigned offset = 0; offset + bytes <= os.size; offset += bytes)
+      sink += (uintptr_t) os.read(offset, width).get();
+  }
+  return util::getWallTime() - start;
+}
+
+static double benchWrite(ObjectState &os, Expr::Width width) {
+  unsigned bytes = width / 8;
+  ref<Expr> value = ConstantExpr::create(0x1122334455667788ULL, Expr::Int64);
+  value = ExtractExpr::create(value, 0, width);
+  double start = util::getWallTime();
+  for (unsigned it = 0; it < Iterations; ++it) {
+    for (unsigned offset = 0; offset + bytes <= os.size; offset += bytes)
+      os.write(offset, value);
+  }
+  return util::getWallTime() - start;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, " ObjectState microbenchmarks\n");
+
+  if (!SymbolicEvery)
+    SymbolicEvery = 1;
+
+  Context::initialize(true, Expr::Int64);
+
+  MemoryObject mo(0, ObjectSize, false, false, false, 0);
+  const Array *array = new Array("bench", ObjectSize);
+
+  Pattern patterns[] = { Concrete, WholeWords, SplitWords };
+  Expr::Width widths[] = { Expr::Int32, Expr::Int64 };
+
+  outs() << "pattern          op      width    ns/op\n";
+  for (unsigned p = 0; p < sizeof(patterns) / sizeof(patterns[0]); ++p) {
+    for (unsigned w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+      Expr::Width width = widths[w];
+      uint64_t ops = (uint64_t) Iterations * (ObjectSize / (width / 8));
+      if (!ops)
+        continue;
+
+      ObjectState *os = new ObjectState(&mo);
+      fill(*os, patterns[p], width, array);
+      double readTime = benchRead(*os, width);
+      delete os;
+
+      // Concrete writes over the symbolic words, then over the now
+      // concrete object (the masks stay allocated)
+      os = new ObjectState(&mo);
+      fill(*os, patterns[p], width, array);
+      double writeTime = benchWrite(*os, width);
+      delete os;
+
+      outs() << format("%-16s %-7s %5u %8.1f\n", patternName(patterns[p]),
+                       "read", width, readTime * 1e9 / ops);
+      outs() << format("%-16s %-7s %5u %8.1f\n", patternName(patterns[p]),
+                       "write", width, writeTime * 1e9 / ops);
+    }
+  }
+
+  return sink == 42;
+}
@@ -56,9 +56,16 @@
 
 #include <sqlite3.h>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 using namespace llvm;
 using namespace klee;
 using boost::scoped_ptr;
@@ -84,7 +91,8 @@ cl::opt<bool> ReplayQueries("replay",
         cl::init(false));
 
 cl::opt<std::string> ReplayLabel("replay-label",
-        cl::desc("Label to attached to replayed query statistics"));
+        cl::desc("Label to attached to replayed query statistics "
+                "(prefix of the per-configuration labels with -benchmark)"));
 
 cl::opt<bool> ComputeQueryStats("compute-query-stats",
         cl::desc("Compute query statistics (somewhat expensive)"),
@@ -111,6 +119,21 @@ cl::opt<std::string> DumpSMTLIBPath("dump-smtlib-path",
         cl::desc("Output path for SMT-Lib dumps"),
         cl::init(""));
 
+cl::opt<bool> BenchmarkSolvers("benchmark",
+        cl::desc("Replay the queries through a matrix of solver configurations "
+                "in parallel worker processes"),
+        cl::init(false));
+
+cl::list<std::string> BenchmarkConfigs("benchmark-config",
+        cl::desc("Solver configuration to benchmark, as "
+                "<stp|z3>[:<none|stack|assumptions>][+cache][+cex][+indep] "
+                "(default: all combinations)"),
+        cl::ZeroOrMore);
+
+cl::opt<unsigned> BenchmarkJobs("benchmark-jobs",
+        cl::desc("Number of benchmark worker processes (default: one per CPU)"),
+        cl::init(0));
+
 }
 
 
@@ -593,6 +616,10 @@ public:
         query_listeners_.push_back(listener);
     }
 
+    void setVerbose(bool verbose) {
+        verbose_ = verbose;
+    }
+
     int64_t getQueryCount();
     void decodeQueries();
 
@@ -605,12 +632,14 @@ private:
     QueryListenerSet query_listeners_;
 
     TimeValue total_recorded_;
+    bool verbose_;
 };
 
 
 QueryDecoder::QueryDecoder(sqlite3 *db)
     : db_(db),
-      total_recorded_(TimeValue::ZeroTime) {
+      total_recorded_(TimeValue::ZeroTime),
+      verbose_(true) {
 
     const char *select_sql =
         "SELECT q.id, q.type, q.body, r.validity, r.time_usec "
@@ -664,9 +693,10 @@ void QueryDecoder::decodeQueries() {
     std::set<int64_t> query_ids;
 
     if (QueryPicks.size() > 0) {
-        outs() << "[Decoder] Decoding " << QueryPicks.size() << " queries from the DB." << '\n';
+        if (verbose_)
+            outs() << "[Decoder] Decoding " << QueryPicks.size() << " queries from the DB." << '\n';
         query_ids.insert(QueryPicks.begin(), QueryPicks.end());
-    } else {
+    } else if (verbose_) {
         outs() << "[Decoder] Decoding all queries in the DB." << '\n';
     }
 
@@ -695,10 +725,12 @@ void QueryDecoder::decodeQueries() {
                (rec_time_usec % 1000000L) * TimeValue::NANOSECONDS_PER_MICROSECOND);
         total_recorded_ += recorded_duration;
 
-        outs() << "[Decode " << format("%06d", query_id) << "]"
-               << " Recorded time: " << recorded_duration.usec() << " usec"
-               << " Total recorded time: " << total_recorded_.usec() << " usec"
-               << '\n';
+        if (verbose_) {
+            outs() << "[Decode " << format("%06d", query_id) << "]"
+                   << " Recorded time: " << recorded_duration.usec() << " usec"
+                   << " Total recorded time: " << total_recorded_.usec() << " usec"
+                   << '\n';
+        }
 
         for (QueryListenerSet::iterator it = query_listeners_.begin(),
                 ie = query_listeners_.end(); it != ie; ++it) {
@@ -716,9 +748,613 @@ void QueryDecoder::decodeQueries() {
 }
 
 
+// SolverConfig ////////////////////////////////////////////////////////////////
+
+
+struct SolverConfig {
+    enum EndSolver {
+        STP,
+        Z3
+    };
+
+    enum Incrementality {
+        NONE,
+        STACK,
+        ASSUMPTIONS
+    };
+
+    SolverConfig(EndSolver end = STP, Incrementality increm = NONE,
+            bool cache = false, bool cex_cache = false,
+            bool independent = false)
+        : end_solver(end),
+          incrementality(increm),
+          use_cache(cache),
+          use_cex_cache(cex_cache),
+          use_independent(independent) {
+
+    }
+
+    bool parse(const std::string &spec);
+    std::string getName() const;
+    Solver *createSolver() const;
+
+    EndSolver end_solver;
+    Incrementality incrementality;
+    bool use_cache;
+    bool use_cex_cache;
+    bool use_independent;
+};
+
+
+static const char *IncrementalityNames[] = {
+        "none",
+        "stack",
+        "assumptions"
+};
+
+
+bool SolverConfig::parse(const std::string &spec) {
+    std::vector<std::string> parts;
+    std::string::size_type start = 0, end;
+    do {
+        end = spec.find('+', start);
+        parts.push_back(spec.substr(start, end - start));
+        start = end + 1;
+    } while (end != std::string::npos);
+
+    std::string::size_type colon = parts[0].find(':');
+    std::string end_name = parts[0].substr(0, colon);
+    if (end_name == "stp") {
+        end_solver = STP;
+    } else if (end_name == "z3") {
+        end_solver = Z3;
+    } else {
+        return false;
+    }
+
+    incrementality = NONE;
+    if (colon != std::string::npos) {
+        std::string increm_name = parts[0].substr(colon + 1);
+        unsigned i = 0;
+        while (i < 3 && increm_name != IncrementalityNames[i])
+            i++;
+        if (i == 3)
+            return false;
+        incrementality = static_cast<Incrementality>(i);
+    }
+
+    // STP has no incremental interface
+    if (end_solver == STP && incrementality != NONE)
+        return false;
+
+    use_cache = use_cex_cache = use_independent = false;
+    for (unsigned i = 1; i < parts.size(); ++i) {
+        if (parts[i] == "cache") {
+            use_cache = true;
+        } else if (parts[i] == "cex") {
+            use_cex_cache = true;
+        } else if (parts[i] == "indep") {
+            use_independent = true;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+std::string SolverConfig::getName() const {
+    std::string name = end_solver == STP ? "stp" : "z3";
+    if (end_solver == Z3) {
+        name += ':';
+        name += IncrementalityNames[incrementality];
+    }
+    if (use_cache)
+        name += "+cache";
+    if (use_cex_cache)
+        name += "+cex";
+    if (use_independent)
+        name += "+indep";
+    return name;
+}
+
+
+// Mirrors the decoration order of DefaultSolverFactory
+Solver *SolverConfig::createSolver() const {
+    Solver *solver = NULL;
+    if (end_solver == STP) {
+        solver = new STPSolver(false);
+    } else {
+        switch (incrementality) {
+        case NONE:
+            solver = Z3Solver::createResetSolver();
+            break;
+        case STACK:
+            solver = Z3Solver::createStackSolver();
+            break;
+        case ASSUMPTIONS:
+            solver = Z3Solver::createAssumptionSolver();
+            break;
+        }
+    }
+
+    if (use_cex_cache)
+        solver = createCexCachingSolver(solver);
+    if (use_cache)
+        solver = createCachingSolver(solver);
+    if (use_independent)
+        solver = createIndependentSolver(solver);
+
+    return solver;
+}
+
+
+static void getBenchmarkConfigs(std::vector<SolverConfig> &configs) {
+    if (BenchmarkConfigs.empty()) {
+        for (unsigned d = 0; d < 8; ++d) {
+            bool cache = d & 1, cex_cache = d & 2, independent = d & 4;
+            configs.push_back(SolverConfig(SolverConfig::STP,
+                    SolverConfig::NONE, cache, cex_cache, independent));
+            for (unsigned i = 0; i < 3; ++i) {
+                configs.push_back(SolverConfig(SolverConfig::Z3,
+                        static_cast<SolverConfig::Incrementality>(i),
+                        cache, cex_cache, independent));
+            }
+        }
+        return;
+    }
+
+    for (unsigned i = 0; i < BenchmarkConfigs.size(); ++i) {
+        SolverConfig config;
+        if (!config.parse(BenchmarkConfigs[i])) {
+            errs() << "Invalid solver configuration: "
+                    << BenchmarkConfigs[i] << '\n';
+            ::exit(1);
+        }
+        configs.push_back(config);
+    }
+}
+
+
+// BenchmarkWorker /////////////////////////////////////////////////////////////
+
+
+enum BenchmarkOutcome {
+    OUTCOME_AGREE,          // Same validity as recorded
+    OUTCOME_DISAGREE,       // Different validity than recorded
+    OUTCOME_SOLVED,         // Value queries, nothing to compare against
+    OUTCOME_FAILED          // The solver gave up
+};
+
+
+// Sent by the workers to the parent through a pipe, one per query
+struct BenchmarkRecord {
+    int64_t qid;
+    int64_t time_usec;
+    int32_t validity;
+    int32_t outcome;
+};
+
+
+static bool writeAll(int fd, const void *buffer, size_t size) {
+    const char *data = static_cast<const char*>(buffer);
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+
+class BenchmarkWorker : public QueryListener {
+public:
+    BenchmarkWorker(const SolverConfig &config, int fd);
+    virtual ~BenchmarkWorker();
+
+    virtual void onQueryDecoded(const Query &query, int64_t qid,
+            QueryType qtype, Solver::Validity rec_validity,
+            int64_t rec_time_usec);
+
+private:
+    Solver *solver_;
+    int fd_;
+};
+
+
+BenchmarkWorker::BenchmarkWorker(const SolverConfig &config, int fd)
+    : solver_(config.createSolver()),
+      fd_(fd) {
+
+}
+
+
+BenchmarkWorker::~BenchmarkWorker() {
+    delete solver_;
+}
+
+
+void BenchmarkWorker::onQueryDecoded(const Query &query, int64_t qid,
+        QueryType qtype, Solver::Validity rec_validity,
+        int64_t rec_time_usec) {
+    BenchmarkRecord record;
+    record.qid = qid;
+    record.validity = Solver::Unknown;
+
+    bool success = false;
+    TimeValue start = TimeValue::now();
+    switch (qtype) {
+    case TRUTH: {
+        bool result = false;
+        success = solver_->impl->computeTruth(query, result);
+        record.validity = result ? Solver::True : Solver::False;
+        break;
+    }
+    case VALIDITY: {
+        Solver::Validity result = Solver::Unknown;
+        success = solver_->impl->computeValidity(query, result);
+        record.validity = result;
+        break;
+    }
+    case VALUE: {
+        ref<Expr> result;
+        success = solver_->impl->computeValue(query, result);
+        break;
+    }
+    case INITIAL_VALUES: {
+        std::vector<const Array*> objects;
+        std::vector<std::vector<unsigned char> > result;
+        bool hasSolution;
+        success = solver_->impl->computeInitialValues(query, objects, result,
+                hasSolution);
+        break;
+    }
+    default:
+        assert(0 && "Unreachable");
+    }
+    record.time_usec = (TimeValue::now() - start).usec();
+
+    if (!success) {
+        record.outcome = OUTCOME_FAILED;
+    } else if (qtype == TRUTH) {
+        // Truth queries only tell apart valid from not valid
+        bool rec_truth = rec_validity == Solver::True;
+        record.outcome = (rec_truth == (record.validity == Solver::True))
+                ? OUTCOME_AGREE : OUTCOME_DISAGREE;
+    } else if (qtype == VALIDITY) {
+        record.outcome = (rec_validity == record.validity)
+                ? OUTCOME_AGREE : OUTCOME_DISAGREE;
+    } else {
+        record.outcome = OUTCOME_SOLVED;
+    }
+
+    if (!writeAll(fd_, &record, sizeof(record))) {
+        ::_exit(1);
+    }
+}
+
+
+// SolverBenchmark /////////////////////////////////////////////////////////////
+
+
+class SolverBenchmark {
+public:
+    SolverBenchmark(const std::string &db_path, unsigned jobs);
+
+    void addConfig(const SolverConfig &config);
+    void run();
+
+    void printReport();
+    void recordResults(sqlite3 *db, const std::string &label_prefix);
+
+private:
+    struct Run {
+        SolverConfig config;
+        pid_t pid;
+        int fd;
+        std::string pending;
+        std::vector<BenchmarkRecord> records;
+        TimeValue start_time;
+        TimeValue wall_time;
+        bool crashed;
+    };
+
+    void startWorker(Run &run);
+    bool readRecords(Run &run);
+    void finishWorker(Run &run);
+
+    std::string db_path_;
+    unsigned jobs_;
+    std::vector<Run> runs_;
+};
+
+
+SolverBenchmark::SolverBenchmark(const std::string &db_path, unsigned jobs)
+    : db_path_(db_path),
+      jobs_(jobs) {
+
+}
+
+
+void SolverBenchmark::addConfig(const SolverConfig &config) {
+    Run run;
+    run.config = config;
+    run.pid = -1;
+    run.fd = -1;
+    run.start_time = run.wall_time = TimeValue::ZeroTime;
+    run.crashed = false;
+    runs_.push_back(run);
+}
+
+
+void SolverBenchmark::startWorker(Run &run) {
+    int fds[2];
+    if (::pipe(fds) < 0) {
+        errs() << "Could not create pipe: " << strerror(errno) << '\n';
+        ::exit(1);
+    }
+
+    outs().flush();
+    errs().flush();
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        errs() << "Could not fork worker: " << strerror(errno) << '\n';
+        ::exit(1);
+    }
+
+    if (pid == 0) {
+        ::close(fds[0]);
+        for (std::vector<Run>::iterator it = runs_.begin(), ie = runs_.end();
+                it != ie; ++it) {
+            if (it->fd >= 0)
+                ::close(it->fd);
+        }
+
+        // SQLite handles must not cross a fork, so each worker opens its own
+        sqlite3 *db;
+        if (sqlite3_open_v2(db_path_.c_str(), &db, SQLITE_OPEN_READONLY,
+                NULL) != SQLITE_OK) {
+            errs() << "Could not open SQLite DB: " << db_path_ <<
+                    " (" << sqlite3_errmsg(db) << ")" << '\n';
+            ::_exit(1);
+        }
+
+        {
+            QueryDecoder decoder(db);
+            BenchmarkWorker worker(run.config, fds[1]);
+            decoder.setVerbose(false);
+            decoder.addQueryListener(&worker);
+            decoder.decodeQueries();
+        }
+
+        sqlite3_close(db);
+        ::close(fds[1]);
+        ::_exit(0);
+    }
+
+    ::close(fds[1]);
+    run.pid = pid;
+    run.fd = fds[0];
+    run.start_time = TimeValue::now();
+
+    outs() << "[Benchmark] Started " << run.config.getName()
+            << " (pid " << pid << ")" << '\n';
+}
+
+
+// Returns false once the worker closed its end of the pipe
+bool SolverBenchmark::readRecords(Run &run) {
+    char buffer[64 * sizeof(BenchmarkRecord)];
+    ssize_t count = ::read(run.fd, buffer, sizeof(buffer));
+    if (count < 0)
+        return errno == EINTR;
+    if (count == 0)
+        return false;
+
+    run.pending.append(buffer, count);
+    size_t complete = run.pending.size() / sizeof(BenchmarkRecord);
+    for (size_t i = 0; i < complete; ++i) {
+        BenchmarkRecord record;
+        memcpy(&record, run.pending.data() + i * sizeof(record),
+                sizeof(record));
+        run.records.push_back(record);
+    }
+    run.pending.erase(0, complete * sizeof(BenchmarkRecord));
+    return true;
+}
+
+
+void SolverBenchmark::finishWorker(Run &run) {
+    ::close(run.fd);
+    run.fd = -1;
+    run.wall_time = TimeValue::now() - run.start_time;
+
+    int status;
+    while (::waitpid(run.pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    run.crashed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+
+    outs() << "[Benchmark] Finished " << run.config.getName()
+            << ": " << run.records.size() << " queries in "
+            << run.wall_time.usec() / 1000 << " ms"
+            << (run.crashed ? " (CRASHED)" : "") << '\n';
+}
+
+
+void SolverBenchmark::run() {
+    size_t next = 0;
+    std::vector<size_t> running;
+
+    while (next < runs_.size() || !running.empty()) {
+        while (next < runs_.size() && running.size() < jobs_) {
+            startWorker(runs_[next]);
+            running.push_back(next++);
+        }
+
+        std::vector<struct pollfd> fds(running.size());
+        for (size_t i = 0; i < running.size(); ++i) {
+            fds[i].fd = runs_[running[i]].fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if (::poll(&fds[0], fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            errs() << "poll failed: " << strerror(errno) << '\n';
+            ::exit(1);
+        }
+
+        std::vector<size_t> still_running;
+        for (size_t i = 0; i < running.size(); ++i) {
+            Run &run = runs_[running[i]];
+            if (fds[i].revents && !readRecords(run)) {
+                finishWorker(run);
+            } else {
+                still_running.push_back(running[i]);
+            }
+        }
+        running.swap(still_running);
+    }
+}
+
+
+static int64_t getPercentile(const std::vector<int64_t> &sorted,
+        unsigned percentile) {
+    if (sorted.empty())
+        return 0;
+    size_t index = (sorted.size() * percentile + 99) / 100;
+    return sorted[index > 0 ? index - 1 : 0];
+}
+
+
+void SolverBenchmark::printReport() {
+    outs() << '\n'
+           << format("%-32s %8s %10s %10s %10s %10s %10s %8s %8s %8s",
+                   "Configuration", "Queries", "Queries/s", "p50 usec",
+                   "p90 usec", "p99 usec", "Max usec", "Agree", "Disagree",
+                   "Failed")
+           << '\n';
+
+    for (std::vector<Run>::iterator it = runs_.begin(), ie = runs_.end();
+            it != ie; ++it) {
+        std::vector<int64_t> latencies;
+        int64_t total_usec = 0;
+        unsigned outcomes[OUTCOME_FAILED + 1] = { 0 };
+
+        for (std::vector<BenchmarkRecord>::iterator rit = it->records.begin(),
+                rie = it->records.end(); rit != rie; ++rit) {
+            latencies.push_back(rit->time_usec);
+            total_usec += rit->time_usec;
+            outcomes[rit->outcome]++;
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        // Throughput counts solver time only, decoding is excluded
+        double throughput = total_usec > 0
+                ? latencies.size() * 1e6 / total_usec : 0.0;
+
+        std::string name = it->config.getName();
+        if (it->crashed)
+            name += " (crashed)";
+
+        outs() << format("%-32s %8u %10.1f %10lld %10lld %10lld %10lld %8u %8u %8u",
+                   name.c_str(), unsigned(latencies.size()), throughput,
+                   (long long)getPercentile(latencies, 50),
+                   (long long)getPercentile(latencies, 90),
+                   (long long)getPercentile(latencies, 99),
+                   (long long)(latencies.empty() ? 0 : latencies.back()),
+                   outcomes[OUTCOME_AGREE], outcomes[OUTCOME_DISAGREE],
+                   outcomes[OUTCOME_FAILED])
+               << '\n';
+    }
+}
+
+
+void SolverBenchmark::recordResults(sqlite3 *db,
+        const std::string &label_prefix) {
+    const char *sql =
+            "INSERT OR REPLACE INTO query_results"
+            "(query_id, label, time_usec, validity)"
+            "VALUES"
+            "(?1, ?2, ?3, ?4);";
+    sqlite3_stmt *insert_stmt;
+    int result = sqlite3_prepare_v2(db, sql, -1, &insert_stmt, NULL);
+    assert(result == SQLITE_OK);
+
+    sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    for (std::vector<Run>::iterator it = runs_.begin(), ie = runs_.end();
+            it != ie; ++it) {
+        std::string label = label_prefix + "/" + it->config.getName();
+
+        for (std::vector<BenchmarkRecord>::iterator rit = it->records.begin(),
+                rie = it->records.end(); rit != rie; ++rit) {
+            sqlite3_clear_bindings(insert_stmt);
+            sqlite3_bind_int64(insert_stmt, 1, rit->qid);
+            sqlite3_bind_text(insert_stmt, 2, label.c_str(), -1,
+                    SQLITE_TRANSIENT);
+            sqlite3_bind_int64(insert_stmt, 3, rit->time_usec);
+            if (rit->outcome == OUTCOME_AGREE ||
+                    rit->outcome == OUTCOME_DISAGREE) {
+                sqlite3_bind_int(insert_stmt, 4, rit->validity);
+            }
+
+            result = sqlite3_step(insert_stmt);
+            assert(result == SQLITE_DONE);
+            sqlite3_reset(insert_stmt);
+        }
+    }
+    sqlite3_exec(db, "COMMIT TRANSACTION", NULL, NULL, NULL);
+
+    result = sqlite3_finalize(insert_stmt);
+    assert(result == SQLITE_OK);
+}
+
+
 // main ////////////////////////////////////////////////////////////////////////
 
 
+static void benchmarkSolvers() {
+    std::vector<SolverConfig> configs;
+    getBenchmarkConfigs(configs);
+
+    unsigned jobs = BenchmarkJobs;
+    if (jobs == 0) {
+        long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+
+    outs() << "[Benchmark] Running " << configs.size()
+            << " solver configurations on " << jobs << " workers" << '\n';
+
+    SolverBenchmark benchmark(InputFileName, jobs);
+    for (std::vector<SolverConfig>::iterator it = configs.begin(),
+            ie = configs.end(); it != ie; ++it) {
+        benchmark.addConfig(*it);
+    }
+    benchmark.run();
+    benchmark.printReport();
+
+    if (!ReplayLabel.empty()) {
+        sqlite3 *db;
+        if (sqlite3_open(InputFileName.c_str(), &db) != SQLITE_OK) {
+            errs() << "Could not open SQLite DB: " << InputFileName <<
+                    " (" << sqlite3_errmsg(db) << ")" << '\n';
+            ::exit(1);
+        }
+        benchmark.recordResults(db, ReplayLabel);
+        sqlite3_close(db);
+    }
+}
+
+
 static void decodeQueries(sqlite3 *db) {
     QueryDecoder decoder(db);
     scoped_ptr<QueryListener> stats_recorder;
@@ -751,6 +1387,12 @@ int main(int argc, char **argv, char **envp) {
     GOOGLE_PROTOBUF_VERIFY_VERSION;
     cl::ParseCommandLineOptions(argc, argv, "Query analysis");
 
+    if (BenchmarkSolvers) {
+        // The workers open the DB themselves after forking
+        benchmarkSolvers();
+        return 0;
+    }
+
     sqlite3 *db;
 
     if (sqlite3_open(InputFileName.c_str(), &db) != SQLITE_OK) {
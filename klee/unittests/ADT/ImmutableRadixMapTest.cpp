@@ -0,0 +1,169 @@
+#include "gtest/gtest.h"
+
+#include "klee/Internal/ADT/ImmutableRadixMap.h"
+
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+struct Identity {
+  uint64_t operator()(uint64_t k) const { return k; }
+};
+
+typedef ImmutableRadixMap<uint64_t, int, Identity> Map;
+typedef std::map<uint64_t, int> RefMap;
+
+uint64_t randomKey() {
+  // Mix small and large keys so that the trie has to grow and shrink
+  switch (rand() % 3) {
+  case 0: return rand() % 64;
+  case 1: return ((uint64_t) rand() << 12) | (rand() & 0xff0);
+  default: return ((uint64_t) rand() << 33) ^ rand();
+  }
+}
+
+void expectSame(const Map &m, const RefMap &r) {
+  ASSERT_EQ(r.size(), m.size());
+  ASSERT_EQ(r.empty(), m.empty());
+
+  Map::iterator it = m.begin();
+  for (RefMap::const_iterator ri = r.begin(); ri != r.end(); ++ri, ++it) {
+    ASSERT_TRUE(it != m.end());
+    EXPECT_EQ(ri->first, it->first);
+    EXPECT_EQ(ri->second, it->second);
+  }
+  EXPECT_TRUE(it == m.end());
+
+  // Backwards from end()
+  for (RefMap::const_reverse_iterator ri = r.rbegin(); ri != r.rend(); ++ri) {
+    --it;
+    EXPECT_EQ(ri->first, it->first);
+  }
+  EXPECT_TRUE(it == m.begin());
+
+  if (!r.empty()) {
+    EXPECT_EQ(r.begin()->first, m.min().first);
+    EXPECT_EQ(r.rbegin()->first, m.max().first);
+  }
+}
+
+TEST(ImmutableRadixMapTest, MatchesStdMap) {
+  srand(1);
+  Map m;
+  RefMap r;
+  std::vector<uint64_t> keys;
+
+  for (unsigned i = 0; i < 5000; ++i) {
+    unsigned op = rand() % 4;
+    if (op < 2 || keys.empty()) {
+      uint64_t k = randomKey();
+      int v = rand();
+      keys.push_back(k);
+      if (op == 0) {
+        m = m.insert(std::make_pair(k, v));
+        r.insert(std::make_pair(k, v));
+      } else {
+        m = m.replace(std::make_pair(k, v));
+        r[k] = v;
+      }
+    } else {
+      uint64_t k = keys[rand() % keys.size()];
+      m = m.remove(k);
+      r.erase(k);
+    }
+    if (i % 500 == 0)
+      expectSame(m, r);
+  }
+  expectSame(m, r);
+
+  for (unsigned i = 0; i < 2000; ++i) {
+    uint64_t k = i % 2 ? keys[rand() % keys.size()] + (rand() % 3) - 1
+                       : randomKey();
+
+    const Map::value_type *v = m.lookup(k);
+    EXPECT_EQ(r.count(k), m.count(k));
+    if (r.count(k)) {
+      ASSERT_TRUE(v);
+      EXPECT_EQ(r[k], v->second);
+    } else {
+      EXPECT_FALSE(v);
+    }
+
+    RefMap::iterator rlb = r.lower_bound(k);
+    Map::iterator lb = m.lower_bound(k);
+    if (rlb == r.end())
+      EXPECT_TRUE(lb == m.end());
+    else
+      EXPECT_EQ(rlb->first, lb->first);
+
+    RefMap::iterator rub = r.upper_bound(k);
+    Map::iterator ub = m.upper_bound(k);
+    if (rub == r.end())
+      EXPECT_TRUE(ub == m.end());
+    else
+      EXPECT_EQ(rub->first, ub->first);
+
+    const Map::value_type *prev = m.lookup_previous(k);
+    if (rub == r.begin()) {
+      EXPECT_FALSE(prev);
+    } else {
+      --rub;
+      ASSERT_TRUE(prev);
+      EXPECT_EQ(rub->first, prev->first);
+    }
+  }
+}
+
+TEST(ImmutableRadixMapTest, OldVersionsAreUnchanged) {
+  srand(2);
+  std::vector<Map> versions;
+  std::vector<RefMap> refs;
+  Map m;
+  RefMap r;
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    uint64_t k = randomKey();
+    if (rand() % 3 == 0 && !r.empty()) {
+      k = r.begin()->first;
+      m = m.remove(k);
+      r.erase(k);
+    } else {
+      m = m.replace(std::make_pair(k, (int) i));
+      r[k] = i;
+    }
+    if (i % 50 == 0) {
+      versions.push_back(m);
+      refs.push_back(r);
+    }
+  }
+
+  for (unsigned i = 0; i < versions.size(); ++i)
+    expectSame(versions[i], refs[i]);
+}
+
+TEST(ImmutableRadixMapTest, UpdateWhileIterating) {
+  Map m;
+  for (uint64_t k = 0; k < 100; ++k)
+    m = m.insert(std::make_pair(k * 0x1000, 0));
+
+  // The address space replaces objects while walking over them
+  unsigned n = 0;
+  for (Map::iterator it = m.begin(), ie = m.end(); it != ie; ++it, ++n)
+    m = m.replace(std::make_pair(it->first, 1));
+  EXPECT_EQ(100U, n);
+
+  for (Map::iterator it = m.begin(), ie = m.end(); it != ie; ++it)
+    EXPECT_EQ(1, it->second);
+
+  for (uint64_t k = 0; k < 100; ++k)
+    m = m.remove(k * 0x1000);
+  EXPECT_TRUE(m.empty());
+  EXPECT_TRUE(m.begin() == m.end());
+  EXPECT_FALSE(m.lookup_previous(~0ULL));
+}
+
+}
@@ -0,0 +1,95 @@
+#include "gtest/gtest.h"
+
+#include "klee/Internal/ADT/IndexedPriorityQueue.h"
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+typedef IndexedPriorityQueue<int*, int> Queue;
+
+// Reference ordered by (priority, item), greatest last
+typedef std::set<std::pair<int, int*> > RefQueue;
+
+void expectSameTop(const Queue &q, const RefQueue &r) {
+  ASSERT_EQ(r.size(), q.size());
+  ASSERT_EQ(r.empty(), q.empty());
+  if (!r.empty())
+    EXPECT_EQ(r.rbegin()->first, q.getPriority(q.top()));
+}
+
+TEST(IndexedPriorityQueueTest, MatchesOrderedSet) {
+  srand(1);
+  std::vector<int> storage(500);
+  Queue q;
+  RefQueue r;
+  std::map<int*, int> priorities;
+
+  for (unsigned i = 0; i < 20000; ++i) {
+    int *item = &storage[rand() % storage.size()];
+    switch (rand() % 4) {
+    case 0:
+    case 1: {
+      int p = rand() % 1000;
+      if (priorities.count(item))
+        r.erase(std::make_pair(priorities[item], item));
+      priorities[item] = p;
+      r.insert(std::make_pair(p, item));
+      q.update(item, p);
+      break;
+    }
+    case 2:
+      if (priorities.count(item)) {
+        r.erase(std::make_pair(priorities[item], item));
+        priorities.erase(item);
+      }
+      q.erase(item);
+      break;
+    default:
+      if (!q.empty()) {
+        int *top = q.top();
+        EXPECT_EQ(r.rbegin()->first, priorities[top]);
+        r.erase(std::make_pair(priorities[top], top));
+        priorities.erase(top);
+        q.pop();
+      }
+      break;
+    }
+    EXPECT_EQ(priorities.count(item) != 0, q.contains(item));
+    expectSameTop(q, r);
+  }
+
+  // Draining yields non-increasing priorities
+  int last = 1000;
+  while (!q.empty()) {
+    int p = q.getPriority(q.top());
+    EXPECT_LE(p, last);
+    last = p;
+    q.pop();
+  }
+}
+
+TEST(IndexedPriorityQueueTest, CustomOrder) {
+  int a, b, c;
+  IndexedPriorityQueue<int*, int, std::greater<int> > q;
+  q.update(&a, 3);
+  q.update(&b, 1);
+  q.update(&c, 2);
+  EXPECT_EQ(&b, q.top());
+
+  q.update(&b, 5);
+  EXPECT_EQ(&c, q.top());
+  q.erase(&c);
+  EXPECT_EQ(&a, q.top());
+  q.pop();
+  EXPECT_EQ(&b, q.top());
+  q.pop();
+  EXPECT_TRUE(q.empty());
+}
+
+}
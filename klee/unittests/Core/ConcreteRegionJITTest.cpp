@@ -0,0 +1,150 @@
+//===-- ConcreteRegionJITTest.cpp -----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "../../lib/Core/ConcreteRegionJIT.h"
+
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+
+#include "llvm/BasicBlock.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/IRBuilder.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JIT.h"
+#include "llvm/Support/TargetSelect.h"
+
+#include <vector>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+
+/// i32 f(i32 a, i32 b) { return ((a + b) * 3 ^ a) - 1; }, whose first
+/// four instructions form a single region.
+class ConcreteRegionJITTest : public ::testing::Test {
+protected:
+  LLVMContext ctx;
+  Module *module;
+  ExecutionEngine *engine;
+  KModule *kmodule;
+  KFunction *kf;
+
+  virtual void SetUp() {
+    InitializeNativeTarget();
+
+    std::string error;
+    engine = ExecutionEngine::createJIT(new Module("jit", ctx), &error);
+    ASSERT_TRUE(engine != 0) << error;
+
+    module = new Module("test", ctx);
+    Type *i32 = Type::getInt32Ty(ctx);
+    std::vector<Type*> params(2, i32);
+    Function *f = Function::Create(FunctionType::get(i32, params, false),
+                                   GlobalValue::ExternalLinkage, "f", module);
+    Function::arg_iterator args = f->arg_begin();
+    Value *a = args++;
+    Value *b = args++;
+
+    IRBuilder<> builder(BasicBlock::Create(ctx, "entry", f));
+    Value *sum = builder.CreateAdd(a, b);
+    Value *product = builder.CreateMul(sum, builder.getInt32(3));
+    Value *mix = builder.CreateXor(product, a);
+    builder.CreateRet(builder.CreateSub(mix, builder.getInt32(1)));
+
+    kmodule = new KModule(module);
+    kf = new KFunction(f, kmodule);
+  }
+
+  virtual void TearDown() {
+    // The JIT of each test already detached its regions from kf
+    delete kf;
+    delete kmodule;
+    delete module;
+    delete engine;
+  }
+};
+
+TEST_F(ConcreteRegionJITTest, FormsRegion) {
+  ConcreteRegionJIT jit(engine, 3, 1);
+
+  const ConcreteRegion *region = jit.getRegion(kf->instructions[0]);
+  ASSERT_TRUE(region != 0);
+  ASSERT_EQ(4U, region->instructions.size());
+  for (unsigned i = 0; i < 4; ++i)
+    EXPECT_EQ(kf->instructions[i], region->instructions[i]);
+
+  // a and b, a is only loaded once
+  ASSERT_EQ(2U, region->inputs.size());
+  EXPECT_EQ(0U, region->inputs[0].instruction);
+  EXPECT_EQ(0U, region->inputs[0].operand);
+  EXPECT_EQ(0U, region->inputs[1].instruction);
+  EXPECT_EQ(1U, region->inputs[1].operand);
+
+  // Only the result of the subtraction is used past the region
+  ASSERT_EQ(1U, region->outputs.size());
+  EXPECT_EQ(3U, region->outputs[0].instruction);
+  EXPECT_EQ(Expr::Int32, region->outputs[0].width);
+
+  uint64_t io[3] = { 5, 7, 0 };
+  region->native(io);
+  EXPECT_EQ(((5U + 7U) * 3U ^ 5U) - 1U, (uint32_t) io[2]);
+
+  // The region is only built once
+  EXPECT_EQ(region, jit.getRegion(kf->instructions[0]));
+}
+
+TEST_F(ConcreteRegionJITTest, MinimumSize) {
+  ConcreteRegionJIT jit(engine, 3, 1);
+
+  EXPECT_TRUE(jit.getRegion(kf->instructions[1]) != 0);
+  // xor and sub only
+  EXPECT_TRUE(jit.getRegion(kf->instructions[2]) == 0);
+  // ret is not supported
+  EXPECT_TRUE(jit.getRegion(kf->instructions[4]) == 0);
+}
+
+TEST_F(ConcreteRegionJITTest, CompilesHotInstructions) {
+  ConcreteRegionJIT jit(engine, 3, 3);
+
+  EXPECT_TRUE(jit.getRegion(kf->instructions[0]) == 0);
+  EXPECT_TRUE(jit.getRegion(kf->instructions[0]) == 0);
+  const ConcreteRegion *region = jit.getRegion(kf->instructions[0]);
+  ASSERT_TRUE(region != 0);
+  EXPECT_EQ(region, jit.getRegion(kf->instructions[0]));
+
+  // Counted per instruction
+  EXPECT_TRUE(jit.getRegion(kf->instructions[1]) == 0);
+}
+
+TEST_F(ConcreteRegionJITTest, BailoutDisablesInnerEntries) {
+  ConcreteRegionJIT jit(engine, 3, 1);
+
+  const ConcreteRegion *region = jit.getRegion(kf->instructions[0]);
+  ASSERT_TRUE(region != 0);
+  // Already compiled before the bailout
+  ASSERT_TRUE(jit.getRegion(kf->instructions[1]) != 0);
+
+  jit.bailout(region);
+
+  for (unsigned n = 0; n < 3; ++n) {
+    EXPECT_TRUE(jit.getRegion(kf->instructions[1]) == 0);
+    EXPECT_TRUE(jit.getRegion(kf->instructions[2]) == 0);
+  }
+
+  // The region itself is still tried, its inputs may be concrete next time
+  EXPECT_EQ(region, jit.getRegion(kf->instructions[0]));
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+ * QuerySerDeserTest.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "gtest/gtest.h"
+
+#include "klee/ExprBuilder.h"
+#include "klee/Solver.h"
+
+#include "klee/data/ExprDeserializer.h"
+#include "klee/data/ExprSerializer.h"
+#include "klee/data/QueryDeserializer.h"
+#include "klee/data/QuerySerializer.h"
+
+namespace klee {
+namespace {
+
+
+class QuerySerDeserTest: public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    eb = createDefaultExprBuilder();
+  }
+
+  virtual void TearDown() {
+    delete eb;
+    arrays.clear();
+  }
+
+  ref<Expr> GetRead(Array *array, unsigned index) {
+    return eb->Read(UpdateList(array, 0), eb->Constant(index, Expr::Int32));
+  }
+
+  ExprBuilder *eb;
+  std::vector<Array*> arrays;
+};
+
+
+// Test that the requested arrays survive the round trip
+TEST_F(QuerySerDeserTest, Objects) {
+  Array *first = new Array("first", 4);
+  Array *second = new Array("second", 8);
+  arrays.push_back(first);
+  arrays.push_back(second);
+
+  ConstraintManager constraints;
+  constraints.addConstraint(eb->Eq(GetRead(first, 0),
+                                   eb->Constant(42, Expr::Int8)));
+  Query query(constraints, eb->Ult(GetRead(first, 1),
+                                   eb->Constant(10, Expr::Int8)));
+
+  std::vector<const Array*> objects;
+  objects.push_back(second);
+  objects.push_back(first);
+
+  ExprSerializer expr_serializer;
+  QuerySerializer query_serializer(expr_serializer);
+  std::string blob;
+  query_serializer.Serialize(query, objects, blob);
+
+  ExprDeserializer expr_deserializer(*eb, arrays);
+  QueryDeserializer query_deserializer(expr_deserializer);
+  Query des_query;
+  std::vector<const Array*> des_objects;
+  ASSERT_TRUE(query_deserializer.Deserialize(blob, des_query, des_objects));
+
+  EXPECT_EQ(query.expr, des_query.expr);
+  ASSERT_EQ(2u, des_objects.size());
+  EXPECT_EQ(second, des_objects[0]);
+  EXPECT_EQ(first, des_objects[1]);
+}
+
+// Test that queries without objects deserialize with an empty list
+TEST_F(QuerySerDeserTest, NoObjects) {
+  Array *array = new Array("array", 4);
+  arrays.push_back(array);
+
+  ConstraintManager constraints;
+  Query query(constraints, eb->Eq(GetRead(array, 2),
+                                  eb->Constant(1, Expr::Int8)));
+
+  ExprSerializer expr_serializer;
+  QuerySerializer query_serializer(expr_serializer);
+  std::string blob;
+  query_serializer.Serialize(query, blob);
+
+  ExprDeserializer expr_deserializer(*eb, arrays);
+  QueryDeserializer query_deserializer(expr_deserializer);
+  Query des_query;
+  std::vector<const Array*> des_objects;
+  ASSERT_TRUE(query_deserializer.Deserialize(blob, des_query, des_objects));
+
+  EXPECT_EQ(query.expr, des_query.expr);
+  EXPECT_TRUE(des_objects.empty());
+}
+
+}
+}
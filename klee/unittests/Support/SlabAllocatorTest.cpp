@@ -0,0 +1,102 @@
+#include "gtest/gtest.h"
+
+#include "klee/Internal/Support/SlabAllocator.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+TEST(SlabAllocatorTest, DistinctBlocks) {
+  SlabAllocator allocator;
+  std::set<void*> seen;
+
+  // Zero-sized requests still need distinct addresses, memory objects are
+  // ordered by them.
+  for (unsigned i = 0; i < 1000; ++i) {
+    void *p = allocator.allocate(i % 64);
+    EXPECT_TRUE(seen.insert(p).second);
+  }
+
+  for (std::set<void*>::iterator it = seen.begin(); it != seen.end(); ++it)
+    EXPECT_EQ(0U, (uintptr_t) *it % SlabAllocator::MinBlockSize);
+}
+
+TEST(SlabAllocatorTest, ReusesFreedBlocks) {
+  SlabAllocator allocator;
+
+  void *p = allocator.allocate(24);
+  allocator.deallocate(p, 24);
+  EXPECT_EQ(p, allocator.allocate(30));
+  allocator.deallocate(p, 30);
+}
+
+TEST(SlabAllocatorTest, ReleasesEmptySlabs) {
+  SlabAllocator allocator;
+  std::vector<void*> blocks;
+
+  for (unsigned i = 0; i < 10000; ++i) {
+    blocks.push_back(allocator.allocate(100));
+    memset(blocks.back(), 0xAB, 100);
+  }
+  EXPECT_EQ(10000 * 128U, allocator.getStats().liveBytes);
+  EXPECT_LT(SlabAllocator::SlabSize, allocator.getStats().slabBytes);
+
+  for (unsigned i = 0; i < blocks.size(); ++i)
+    allocator.deallocate(blocks[i], 100);
+
+  // Only the one cached empty slab remains
+  EXPECT_EQ(0U, allocator.getStats().liveBytes);
+  EXPECT_EQ(SlabAllocator::SlabSize, allocator.getStats().slabBytes);
+  EXPECT_EQ(allocator.getStats().allocations,
+            allocator.getStats().deallocations);
+}
+
+TEST(SlabAllocatorTest, LargeBlocks) {
+  SlabAllocator allocator;
+
+  size_t size = SlabAllocator::MaxBlockSize + 1;
+  void *p = allocator.allocate(size);
+  memset(p, 0, size);
+  EXPECT_EQ(size, allocator.getStats().largeBytes);
+  EXPECT_EQ(0U, allocator.getStats().slabBytes);
+
+  allocator.deallocate(p, size);
+  EXPECT_EQ(0U, allocator.getStats().largeBytes);
+}
+
+TEST(SlabAllocatorTest, RandomChurn) {
+  SlabAllocator allocator;
+  std::vector<std::pair<unsigned char*, size_t> > blocks;
+
+  srand(42);
+  for (unsigned i = 0; i < 50000; ++i) {
+    if (blocks.empty() || rand() % 3) {
+      size_t size = rand() % (2 * SlabAllocator::MaxBlockSize);
+      unsigned char *p = (unsigned char*) allocator.allocate(size);
+      memset(p, (unsigned char) size, size);
+      blocks.push_back(std::make_pair(p, size));
+    } else {
+      unsigned idx = rand() % blocks.size();
+      unsigned char *p = blocks[idx].first;
+      size_t size = blocks[idx].second;
+      for (size_t j = 0; j < size; ++j)
+        ASSERT_EQ((unsigned char) size, p[j]);
+      allocator.deallocate(p, size);
+      blocks[idx] = blocks.back();
+      blocks.pop_back();
+    }
+  }
+
+  for (unsigned i = 0; i < blocks.size(); ++i)
+    allocator.deallocate(blocks[i].first, blocks[i].second);
+
+  EXPECT_EQ(0U, allocator.getStats().liveBytes);
+  EXPECT_EQ(0U, allocator.getStats().largeBytes);
+}
+
+}
@@ -150,7 +150,11 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
         if (tb->pc == pc &&
             tb->page_addr[0] == phys_page1 &&
             tb->cs_base == cs_base &&
-            tb->flags == flags) {
+            tb->flags == flags
+#ifdef CONFIG_S2E
+            && !tb->s2e_is_prefix
+#endif
+            ) {
             /* check next page if needed */
             if (tb->page_addr[1] != -1) {
                 tb_page_addr_t phys_page2;
@@ -624,6 +628,15 @@ int cpu_exec(CPUArchState *env)
                 qemu_log_mask(CPU_LOG_EXEC, "Trace 0x%08lx [" TARGET_FMT_lx "] %s\n",
                              (long)tb->tc_ptr, tb->pc,
                              lookup_symbol(tb->pc));
+#endif
+#ifdef CONFIG_S2E
+                /* a TB that must run in KLEE has to be reached through
+                   the cpu loop */
+                ++s2e_tb_chain_stats.entries;
+                if (next_tb != 0 && !s2e_tb_chainable(tb, s2e_tb_chain_smask)) {
+                    ++s2e_tb_chain_stats.refused;
+                    next_tb = 0;
+                }
 #endif
                 /* see if we can patch the calling TB. When the TB
                    spans two pages, we cannot safely do a direct
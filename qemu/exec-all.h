@@ -230,6 +230,15 @@ struct TranslationBlock {
     enum ETranslationBlockType s2e_tb_type;
     struct S2ETranslationBlock* s2e_tb;
     struct TranslationBlock* s2e_tb_next[2];
+
+    /* Copy of the first instructions of this TB that do not need KLEE,
+       run natively before interpreting the rest (s2e_tb_get_prefix) */
+    struct TranslationBlock* s2e_prefix_tb;
+    /* For prefix TBs, the TB they were cut from while both are valid */
+    struct TranslationBlock* s2e_prefix_of;
+    /* Prefix TBs are never looked up by pc */
+    int s2e_is_prefix;
+
     uint64_t pcOfLastInstr; /* XXX: hack for call instructions */
     uint32_t instruction_set;
 #endif
@@ -329,6 +338,46 @@ static inline void tb_set_jmp_target(TranslationBlock *tb,
 
 #endif
 
+#ifdef CONFIG_S2E
+/* Symbolic register mask of the running state. Every direct jump between
+   TBs is valid under it: native code never jumps into a TB that would
+   have to run in KLEE under this mask. */
+extern uint64_t s2e_tb_chain_smask;
+
+/* Union of the conflict masks of the TBs that may have incoming direct
+   jumps. A mask growing by bits outside of it needs no unlinking. */
+extern uint64_t s2e_tb_linked_conflict;
+
+struct S2ETbChainStats {
+    uint64_t entries;   /* TBs entered from the cpu loop */
+    uint64_t linked;    /* direct jumps made between TBs */
+    uint64_t refused;   /* links not made because the target needs KLEE */
+    uint64_t unlinked;  /* links removed because the mask grew */
+    uint64_t scans;     /* passes over all TBs to remove links */
+};
+
+extern struct S2ETbChainStats s2e_tb_chain_stats;
+
+/* Symbolic registers that keep native code from jumping straight into tb.
+   A TB whose helpers may touch symbolic memory conflicts with any
+   non-empty mask. */
+static inline uint64_t s2e_tb_chain_conflict(TranslationBlock *tb)
+{
+    if (tb->helper_accesses_mem & 4) {
+        return (uint64_t) -1;
+    }
+    return tb->reg_rmask | tb->reg_wmask;
+}
+
+/* Whether native code may jump straight into tb, without going through
+   the cpu loop, while the registers in smask are symbolic. The decision
+   only depends on the target, so it holds for every link into tb. */
+static inline int s2e_tb_chainable(TranslationBlock *tb, uint64_t smask)
+{
+    return !(smask & s2e_tb_chain_conflict(tb));
+}
+#endif
+
 static inline void tb_add_jump(TranslationBlock *tb, int n,
                                TranslationBlock *tb_next)
 {
@@ -342,6 +391,8 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
         tb_next->jmp_first = (TranslationBlock *)((uintptr_t)(tb) | (n));
 #ifdef CONFIG_S2E
         tb->s2e_tb_next[n] = tb_next;
+        s2e_tb_linked_conflict |= s2e_tb_chain_conflict(tb_next);
+        ++s2e_tb_chain_stats.linked;
 #endif
 #ifdef CONFIG_LLVM
         tb->llvm_tb_next[n] = tb_next;
@@ -349,6 +400,13 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     }
 }
 
+#ifdef CONFIG_S2E
+void s2e_tb_unchain_smask(uint64_t smask);
+
+TranslationBlock *s2e_tb_get_prefix(CPUArchState *env, TranslationBlock *tb,
+                                    int insns);
+#endif
+
 TranslationBlock *tb_find_pc(uintptr_t pc_ptr);
 
 #include "qemu-lock.h"
@@ -874,6 +874,11 @@ void tb_flush(CPUArchState *env1)
     memset (tb_phys_hash, 0, CODE_GEN_PHYS_HASH_SIZE * sizeof (void *));
     page_flush_tb();
 
+#ifdef CONFIG_S2E
+    /* No links are left */
+    s2e_tb_linked_conflict = 0;
+#endif
+
     code_gen_ptr = code_gen_buffer;
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
@@ -994,6 +999,79 @@ static inline void tb_reset_jump(TranslationBlock *tb, int n)
 
 }
 
+#ifdef CONFIG_S2E
+uint64_t s2e_tb_chain_smask;
+uint64_t s2e_tb_linked_conflict;
+struct S2ETbChainStats s2e_tb_chain_stats;
+
+/* remove all the direct jumps into TBs that cannot be chained under
+   smask, the others stay linked */
+void s2e_tb_unchain_smask(uint64_t smask)
+{
+    TranslationBlock *tb, *tb1, *tb2;
+    unsigned int n1;
+    int i;
+
+    s2e_tb_linked_conflict = 0;
+
+    for (i = 0; i < nb_tbs; ++i) {
+        tb = &tbs[i];
+        if (s2e_tb_chainable(tb, smask)) {
+            if (((long)tb->jmp_first & 3) != 2) {
+                s2e_tb_linked_conflict |= s2e_tb_chain_conflict(tb);
+            }
+            continue;
+        }
+
+        tb1 = tb->jmp_first;
+        for(;;) {
+            n1 = (long)tb1 & 3;
+            if (n1 == 2)
+                break;
+            tb1 = (TranslationBlock *)((long)tb1 & ~3);
+            tb2 = tb1->jmp_next[n1];
+            tb_reset_jump(tb1, n1);
+            tb1->jmp_next[n1] = NULL;
+            tb1 = tb2;
+            ++s2e_tb_chain_stats.unlinked;
+        }
+        tb->jmp_first = (TranslationBlock *)((long)tb | 2);
+    }
+
+    ++s2e_tb_chain_stats.scans;
+}
+
+/* return a TB running the first 'insns' instructions of tb, translating
+   it if the cached one has a different length */
+TranslationBlock *s2e_tb_get_prefix(CPUArchState *env, TranslationBlock *tb,
+                                    int insns)
+{
+    TranslationBlock *prefix = tb->s2e_prefix_tb;
+    int invalidated, flushed;
+
+    if (prefix) {
+        if ((prefix->cflags & CF_COUNT_MASK) == insns) {
+            return prefix;
+        }
+        tb_phys_invalidate(prefix, -1);
+    }
+
+    invalidated = tb_invalidated_flag;
+    tb_invalidated_flag = 0;
+    prefix = tb_gen_code(env, tb->pc, tb->cs_base, tb->flags, insns);
+    prefix->s2e_is_prefix = 1;
+    flushed = tb_invalidated_flag;
+    tb_invalidated_flag |= invalidated;
+
+    /* tb is gone if the translation flushed the cache */
+    if (!flushed) {
+        tb->s2e_prefix_tb = prefix;
+        prefix->s2e_prefix_of = tb;
+    }
+    return prefix;
+}
+#endif
+
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     CPUArchState *env;
@@ -1047,6 +1125,19 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
     tb->jmp_first = (TranslationBlock *)((long)tb | 2); /* fail safe */
 
+#ifdef CONFIG_S2E
+    /* a prefix left behind stays valid code, it is just never run
+       again */
+    if (tb->s2e_prefix_tb) {
+        tb->s2e_prefix_tb->s2e_prefix_of = NULL;
+        tb->s2e_prefix_tb = NULL;
+    }
+    if (tb->s2e_prefix_of) {
+        tb->s2e_prefix_of->s2e_prefix_tb = NULL;
+        tb->s2e_prefix_of = NULL;
+    }
+#endif
+
     tb_phys_invalidate_count++;
 }
 
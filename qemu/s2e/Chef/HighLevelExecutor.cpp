@@ -43,71 +43,215 @@
 #include <boost/make_shared.hpp>
 #include <boost/ref.hpp>
 
+#include <llvm/Support/CommandLine.h>
+
 using boost::shared_ptr;
 using boost::make_shared;
 
+namespace {
+
+llvm::cl::opt<unsigned>
+HighLevelTreeBudget("hl-tree-memory-budget",
+        llvm::cl::desc("Memory budget (MB) of the high-level path tree, over which a report is printed and new forks are no longer favored"),
+        llvm::cl::init(0));
+
+llvm::cl::opt<unsigned>
+HighLevelStateTrimThreshold("hl-segment-trim-threshold",
+        llvm::cl::desc("Number of HLPCs left behind a high-level state before they are released"),
+        llvm::cl::init(4096));
+
+}
+
 namespace s2e {
 
 
 // HighLevelPathTracer /////////////////////////////////////////////////////////
 
 HighLevelPathTracer::HighLevelPathTracer()
-    : path_id_counter_(0) {
+    : path_id_counter_(0),
+      segment_count_(0),
+      hlpc_count_(0) {
 
 }
 
 SharedHLPSRef HighLevelPathTracer::createRootSegment() {
     shared_ptr<HighLevelPath> path = make_shared<HighLevelPath>(path_id_counter_++);
-    return make_shared<HighLevelPathSegment>(path);
+    return createSegment(path, 0, SharedHLPSRef());
+}
+
+SharedHLPSRef HighLevelPathTracer::createSegment(shared_ptr<HighLevelPath> path,
+        uint64_t hlpc, SharedHLPSRef parent) {
+    SharedHLPSRef segment = make_shared<HighLevelPathSegment>(
+            boost::ref(*this), path, hlpc, parent);
+    if (parent) {
+        parent->children.insert(std::make_pair(hlpc, segment));
+    }
+    return segment;
+}
+
+/*
+ * Breaks a segment in two at the given offset.  The tail keeps the path of
+ * the segment, as well as its children and the states positioned past the
+ * split point.
+ */
+SharedHLPSRef HighLevelPathTracer::splitSegment(SharedHLPSRef segment,
+        unsigned offset) {
+    assert(offset > 0 && offset < segment->length());
+
+    SharedHLPSRef tail = make_shared<HighLevelPathSegment>(
+            boost::ref(*this), segment->path, segment->hlpcs[offset], segment);
+    tail->hlpcs.assign(segment->hlpcs.begin() + offset, segment->hlpcs.end());
+    segment->hlpcs.resize(offset);
+    // The constructor accounted for the first HLPC, which was moved
+    hlpc_count_--;
+
+    for (HighLevelPathSegment::ChildrenMap::iterator it = segment->children.begin(),
+            ie = segment->children.end(); it != ie; ++it) {
+        it->second->parent = tail;
+        tail->children.insert(*it);
+    }
+    segment->children.clear();
+    segment->children.insert(std::make_pair(tail->hlpcs.front(), tail));
+
+    HighLevelPathSegment::OffsetStateMap::iterator split_it =
+            segment->low_level_states.lower_bound(offset);
+    for (HighLevelPathSegment::OffsetStateMap::iterator it = split_it,
+            ie = segment->low_level_states.end(); it != ie; ++it) {
+        for (HighLevelPathSegment::LowLevelStateSet::iterator sit = it->second.begin(),
+                sie = it->second.end(); sit != sie; ++sit) {
+            (*sit)->segment = tail;
+            (*sit)->offset = it->first - offset;
+        }
+        tail->low_level_states[it->first - offset] = it->second;
+    }
+    segment->low_level_states.erase(split_it, segment->low_level_states.end());
+
+    return tail;
 }
 
-SharedHLPSRef HighLevelPathTracer::getNextSegment(SharedHLPSRef segment,
-        uint64_t next_hlpc) {
+void HighLevelPathTracer::stepPosition(SharedHLPSRef &segment,
+        unsigned &offset, uint64_t next_hlpc) {
+    if (offset + 1 < segment->length()) {
+        if (segment->hlpcs[offset + 1] == next_hlpc) {
+            offset++;
+            return;
+        }
+        // Divergence in the middle of the run
+        splitSegment(segment, offset + 1);
+    }
+
+    if (segment->children.empty()) {
+        // We are at the frontier of the path, so just extend the run.
+        segment->hlpcs.push_back(next_hlpc);
+        hlpc_count_++;
+        offset++;
+        return;
+    }
+
     HighLevelPathSegment::ChildrenMap::iterator it = segment->children.find(next_hlpc);
     if (it != segment->children.end()) {
-        return it->second;
+        segment = it->second;
+        offset = 0;
+        return;
     }
 
-    shared_ptr<HighLevelPath> path = segment->children.empty() ? segment->path
-            : make_shared<HighLevelPath>(path_id_counter_++);
-    SharedHLPSRef child = make_shared<HighLevelPathSegment>(path, next_hlpc, segment);
-    segment->children.insert(std::make_pair(next_hlpc, child));
-    return child;
+    shared_ptr<HighLevelPath> path = make_shared<HighLevelPath>(path_id_counter_++);
+    segment = createSegment(path, next_hlpc, segment);
+    offset = 0;
 }
 
+void HighLevelPathTracer::trimSegment(SharedHLPSRef segment, unsigned &offset) {
+    assert(segment->parent.expired() && "Cannot trim a reachable segment");
+    assert(offset < segment->length());
 
-// HighLevelPathSegment ////////////////////////////////////////////////////////
+    if (offset == 0)
+        return;
 
-HighLevelPathSegment::HighLevelPathSegment(shared_ptr<HighLevelPath> path_)
-    : hlpc(0),
-      path(path_) {
+    segment->hlpcs.erase(segment->hlpcs.begin(), segment->hlpcs.begin() + offset);
+    hlpc_count_ -= offset;
+
+    HighLevelPathSegment::OffsetStateMap shifted_states;
+    for (HighLevelPathSegment::OffsetStateMap::iterator it = segment->low_level_states.begin(),
+            ie = segment->low_level_states.end(); it != ie; ++it) {
+        assert(it->first >= offset && "State behind its high-level state");
+        for (HighLevelPathSegment::LowLevelStateSet::iterator sit = it->second.begin(),
+                sie = it->second.end(); sit != sie; ++sit) {
+            (*sit)->offset = it->first - offset;
+        }
+        shifted_states[it->first - offset] = it->second;
+    }
+    segment->low_level_states.swap(shifted_states);
 
+    offset = 0;
 }
 
+uint64_t HighLevelPathTracer::memory_usage() const {
+    // make_shared co-allocates the control block with the segment.
+    return segment_count_ * (sizeof(HighLevelPathSegment) + 2 * sizeof(long))
+            + hlpc_count_ * sizeof(uint64_t);
+}
 
-HighLevelPathSegment::HighLevelPathSegment(shared_ptr<HighLevelPath> path_,
-        uint64_t hlpc_, SharedHLPSRef parent_)
-    : hlpc(hlpc_),
-      path(path_),
-      parent(parent_) {
 
+// HighLevelPath ///////////////////////////////////////////////////////////////
+
+void HighLevelPath::addTopologicState(TopologicNode *node, LowLevelState *state) {
+    topo_nodes[node].insert(state);
+}
+
+
+void HighLevelPath::removeTopologicState(TopologicNode *node, LowLevelState *state) {
+    TopologicNodeMap::iterator it = topo_nodes.find(node);
+    if (it == topo_nodes.end())
+        return;
+
+    it->second.remove(state);
+    if (it->second.empty()) {
+        topo_nodes.erase(it);
+    }
+}
+
+
+// HighLevelPathSegment ////////////////////////////////////////////////////////
+
+HighLevelPathSegment::HighLevelPathSegment(HighLevelPathTracer &tracer,
+        shared_ptr<HighLevelPath> path_, uint64_t hlpc_, SharedHLPSRef parent_)
+    : hlpcs(1, hlpc_),
+      path(path_),
+      parent(parent_),
+      tracer_(tracer) {
+    tracer_.segment_count_++;
+    tracer_.hlpc_count_++;
 }
 
 
 HighLevelPathSegment::~HighLevelPathSegment() {
+    tracer_.segment_count_--;
+    tracer_.hlpc_count_ -= hlpcs.size();
+}
+
 
+LowLevelState *HighLevelPathSegment::getStateAt(unsigned offset) const {
+    OffsetStateMap::const_iterator it = low_level_states.find(offset);
+    if (it == low_level_states.end())
+        return NULL;
+    return *it->second.begin();
 }
 
 
-void HighLevelPathSegment::joinState(boost::shared_ptr<LowLevelState> state) {
+void HighLevelPathSegment::joinState(boost::shared_ptr<LowLevelState> state,
+        unsigned offset) {
     if (path->low_level_states.size() == 1) {
-        path->low_level_states.begin()->lock()->setAPICState(false);
+        (*path->low_level_states.begin())->setAPICState(false);
         state->setAPICState(false);
     }
 
     state->segment = shared_from_this();
-    low_level_states.insert(state);
-    path->low_level_states.insert(state);
+    state->offset = offset;
+    low_level_states[offset].insert(state.get());
+    path->low_level_states.insert(state.get());
+    if (!state->topo_index.empty()) {
+        path->addTopologicState(state->topo_index.back().get(), state.get());
+    }
 
     if (path->low_level_states.size() == 1) {
         state->setAPICState(true);
@@ -116,12 +260,21 @@ void HighLevelPathSegment::joinState(boost::shared_ptr<LowLevelState> state) {
 
 
 void HighLevelPathSegment::leaveState(boost::shared_ptr<LowLevelState> state) {
-    low_level_states.erase(state);
-    path->low_level_states.erase(state);
+    OffsetStateMap::iterator it = low_level_states.find(state->offset);
+    assert(it != low_level_states.end());
+    it->second.erase(state.get());
+    if (it->second.empty()) {
+        low_level_states.erase(it);
+    }
+
+    path->low_level_states.erase(state.get());
+    if (!state->topo_index.empty()) {
+        path->removeTopologicState(state->topo_index.back().get(), state.get());
+    }
     state->segment.reset();
 
     if (path->low_level_states.size() == 1) {
-        path->low_level_states.begin()->lock()->setAPICState(true);
+        (*path->low_level_states.begin())->setAPICState(true);
         // state->setAPICState(true); // Not sure if this one is really needed
     }
 }
@@ -131,6 +284,7 @@ void HighLevelPathSegment::leaveState(boost::shared_ptr<LowLevelState> state) {
 HighLevelState::HighLevelState(HighLevelExecutor &analyzer,
         shared_ptr<HighLevelPathSegment> segment_)
     : segment(segment_),
+      offset(0),
       analyzer_(analyzer) {
 }
 
@@ -141,15 +295,28 @@ HighLevelState::~HighLevelState() {
 
 
 void HighLevelState::step(uint64_t hlpc) {
-    shared_ptr<HighLevelPathSegment> next_segment = analyzer_.path_tracer_.getNextSegment(segment, hlpc);
+    shared_ptr<HighLevelPathSegment> old_segment = segment;
+    analyzer_.path_tracer_.stepPosition(segment, offset, hlpc);
 
-    segment = next_segment;
-    segment->parent.reset();
+    if (segment != old_segment) {
+        segment->parent.reset();
+        return;
+    }
+
+    // Nothing can reach back behind the high-level state, so release the
+    // part of the run we left behind once it dominates the segment.
+    if (offset >= HighLevelStateTrimThreshold && 2 * offset >= segment->length()) {
+        analyzer_.path_tracer_.trimSegment(segment, offset);
+    }
 }
 
 
 shared_ptr<HighLevelState> HighLevelState::fork(uint64_t hlpc) {
-    shared_ptr<HighLevelPathSegment> next_segment = analyzer_.path_tracer_.getNextSegment(segment, hlpc);
+    assert(offset + 1 == segment->length() && "Forks only occur at segment ends");
+    HighLevelPathSegment::ChildrenMap::iterator it = segment->children.find(hlpc);
+    assert(it != segment->children.end());
+
+    shared_ptr<HighLevelPathSegment> next_segment = it->second;
     assert(next_segment->path != segment->path);
 
     shared_ptr<HighLevelState> clone = make_shared<HighLevelState>(boost::ref(analyzer_), next_segment);
@@ -166,6 +333,12 @@ void HighLevelState::terminate() {
 
 // TopologicNode ///////////////////////////////////////////////////////////////
 
+bool TopologicNodeOrder::operator()(const TopologicNode *a,
+        const TopologicNode *b) const {
+    return a->position < b->position;
+}
+
+
 TopologicNode::TopologicNode(shared_ptr<TopologicNode> p, int bb, int ci, bool cb)
     : parent(p),
       basic_block(bb),
@@ -178,7 +351,21 @@ TopologicNode::TopologicNode()
     : basic_block(-1),
       call_index(0),
       is_call_base(true) {
+    position.push_back(std::make_pair(basic_block, call_index));
+}
+
+void TopologicNode::addState(LowLevelState *state) {
+    states.insert(state);
+    if (state->segment) {
+        state->segment->path->addTopologicState(this, state);
+    }
+}
 
+void TopologicNode::removeState(LowLevelState *state) {
+    states.remove(state);
+    if (state->segment) {
+        state->segment->path->removeTopologicState(this, state);
+    }
 }
 
 shared_ptr<TopologicNode> TopologicNode::getDown(bool cb) {
@@ -187,6 +374,8 @@ shared_ptr<TopologicNode> TopologicNode::getDown(bool cb) {
 
     shared_ptr<TopologicNode> node = make_shared<TopologicNode>(
             shared_from_this(), -1, 0, cb);
+    node->position = position;
+    node->position.push_back(std::make_pair(-1, 0));
     down = node;
     return node;
 }
@@ -202,6 +391,8 @@ shared_ptr<TopologicNode> TopologicNode::getNext(int bb, int ci) {
         if (bb < current->basic_block || (bb == current->basic_block && ci < current->call_index)) {
             shared_ptr<TopologicNode> node = make_shared<TopologicNode>(
                     previous, bb, ci, is_call_base);
+            node->position = position;
+            node->position.back() = std::make_pair(bb, ci);
             previous->next = node;
 
             current->parent = node;
@@ -214,6 +405,8 @@ shared_ptr<TopologicNode> TopologicNode::getNext(int bb, int ci) {
     }
 
     shared_ptr<TopologicNode> node = make_shared<TopologicNode>(previous, bb, ci, is_call_base);
+    node->position = position;
+    node->position.back() = std::make_pair(bb, ci);
     previous->next = node;
     return node;
 }
@@ -236,7 +429,9 @@ llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
 
 LowLevelState::LowLevelState(HighLevelExecutor &analyzer,
         S2EExecutionState *s2e_state)
-    : StreamAnalyzerState<LowLevelState, HighLevelExecutor>(analyzer, s2e_state) {
+    : StreamAnalyzerState<LowLevelState, HighLevelExecutor>(analyzer, s2e_state),
+      offset(0),
+      trace_hash(0xcbf29ce484222325ULL) {
 
 }
 
@@ -244,21 +439,24 @@ LowLevelState::LowLevelState(HighLevelExecutor &analyzer,
 shared_ptr<LowLevelState> LowLevelState::clone(S2EExecutionState *s2e_state) {
     shared_ptr<LowLevelState> new_state = shared_ptr<LowLevelState>(
             new LowLevelState(analyzer(), s2e_state));
-    segment->joinState(new_state);
+    segment->joinState(new_state, offset);
+    new_state->trace_hash = trace_hash;
 
     if (!topo_index.empty()) {
         new_state->topo_index = topo_index;
-        new_state->topo_index.back()->states.insert(new_state.get());
+        new_state->topo_index.back()->addState(new_state.get());
     }
     return new_state;
 }
 
 
 void LowLevelState::terminate() {
+    analyzer().onLowLevelStateKill.emit(this);
+
     segment->leaveState(shared_from_this());
 
     if (!topo_index.empty()) {
-        topo_index.back()->states.remove(this);
+        topo_index.back()->removeState(this);
     }
 
     analyzer().tryUpdateSelectedState();
@@ -266,12 +464,21 @@ void LowLevelState::terminate() {
 
 
 void LowLevelState::step(uint64_t hlpc) {
-    shared_ptr<HighLevelPathSegment> old_segment = segment;
-    shared_ptr<HighLevelPathSegment> next_segment = analyzer().path_tracer_.getNextSegment(segment, hlpc);
+    shared_ptr<HighLevelPathSegment> next_segment = segment;
+    unsigned next_offset = offset;
+    analyzer().path_tracer_.stepPosition(next_segment, next_offset, hlpc);
+
+    // FNV-1a over the HLPC sequence
+    for (unsigned i = 0; i < sizeof(hlpc); ++i) {
+        trace_hash ^= (hlpc >> (i * 8)) & 0xff;
+        trace_hash *= 0x100000001b3ULL;
+    }
 
-    old_segment->leaveState(shared_from_this());
-    next_segment->joinState(shared_from_this());
+    // The step may have split our segment, but never past our position
+    segment->leaveState(shared_from_this());
+    next_segment->joinState(shared_from_this(), next_offset);
 
+    analyzer().checkMemoryBudget();
     analyzer().tryUpdateSelectedState();
 }
 
@@ -287,7 +494,8 @@ HighLevelExecutor::HighLevelExecutor(InterpreterTracer &tracer,
         HighLevelStrategyFactory &hl_factory,
         LowLevelStrategyFactory &ll_factory)
     : StreamAnalyzer<LowLevelState>(tracer.s2e(), tracer.stream()),
-      interp_tracer_(tracer) {
+      interp_tracer_(tracer),
+      over_memory_budget_(false) {
     on_high_level_pc_update_ = interp_tracer_.onHighLevelPCUpdate.connect(
             sigc::mem_fun(*this, &HighLevelExecutor::onHighLevelPCUpdate));
 
@@ -303,6 +511,12 @@ HighLevelExecutor::~HighLevelExecutor() {
     s2e().getMessagesStream() << "High-level executor terminated for tid="
             << interp_tracer_.call_tracer().tracked_tid() << '\n';
     on_high_level_pc_update_.disconnect();
+
+    // The path segments of the states update the counters of path_tracer_
+    // when they are released, so this must happen before it is destroyed.
+    selected_state_.reset();
+    high_level_states_.clear();
+    clearStates();
 }
 
 
@@ -321,11 +535,11 @@ shared_ptr<LowLevelState> HighLevelExecutor::createState(S2EExecutionState *s2e_
     // Create a low-level state as the support for the HL path.
     shared_ptr<LowLevelState> ll_state = shared_ptr<LowLevelState>(
             new LowLevelState(*this, s2e_state));
-    segment->joinState(ll_state);
+    segment->joinState(ll_state, 0);
 
     // Bootstrap the topologic index computation
     ll_state->topo_index = hl_state->cursor;
-    ll_state->topo_index.back()->states.insert(ll_state.get());
+    ll_state->topo_index.back()->addState(ll_state.get());
 
     onHighLevelStateCreate.emit(hl_state.get());
 
@@ -365,7 +579,8 @@ void HighLevelExecutor::tryUpdateSelectedState() {
 
 bool HighLevelExecutor::doUpdateSelectedState() {
     shared_ptr<HighLevelPathSegment> segment = selected_state_->segment;
-    if (!segment->low_level_states.empty())
+    unsigned offset = selected_state_->offset;
+    if (segment->hasStatesAt(offset))
         return false;
 
     assert(segment->parent.expired());
@@ -374,7 +589,12 @@ bool HighLevelExecutor::doUpdateSelectedState() {
     // strategy relinquish (e.g., update the selected_state_ when a low-level
     // state makes some progress.
 
-    if (segment->children.empty()) {
+    if (offset + 1 < segment->length()) {
+        // Plain step inside the segment
+        selected_state_->step(segment->hlpcs[offset + 1]);
+        onHighLevelStateStep.emit(selected_state_.get());
+        hl_strategy_->updateState(selected_state_);
+    } else if (segment->children.empty()) {
         // High-level state terminated
         onHighLevelStateKill.emit(selected_state_.get());
         hl_strategy_->killState(selected_state_);
@@ -424,4 +644,62 @@ bool HighLevelExecutor::doUpdateSelectedState() {
 }
 
 
+void HighLevelExecutor::checkMemoryBudget() {
+    if (!HighLevelTreeBudget)
+        return;
+
+    bool over_budget = path_tracer_.memory_usage() >
+            ((uint64_t)HighLevelTreeBudget << 20);
+    if (over_budget && !over_memory_budget_) {
+        llvm::raw_ostream &os = s2e().getWarningsStream();
+        os << "High-level tree exceeded its memory budget of "
+                << HighLevelTreeBudget << "MB" << '\n';
+        printMemoryReport(os);
+    }
+    if (over_budget != over_memory_budget_) {
+        hl_strategy_->setMemoryPressure(over_budget);
+    }
+    over_memory_budget_ = over_budget;
+}
+
+
+void HighLevelExecutor::printMemoryReport(llvm::raw_ostream &os) const {
+    os << "High-level tree: " << path_tracer_.segment_count() << " segments, "
+            << path_tracer_.hlpc_count() << " HLPCs, ~"
+            << (path_tracer_.memory_usage() >> 10) << "KB" << '\n';
+
+    for (HighLevelStateSet::const_iterator it = high_level_states_.begin(),
+            ie = high_level_states_.end(); it != ie; ++it) {
+        const HighLevelState *hl_state = it->get();
+
+        // Everything ahead of the state, including the paths that are yet
+        // to be forked from it.
+        uint64_t segments = 0, hlpcs = 0, states = 0;
+        std::vector<HighLevelPathSegment*> worklist;
+        worklist.push_back(hl_state->segment.get());
+
+        while (!worklist.empty()) {
+            HighLevelPathSegment *segment = worklist.back();
+            worklist.pop_back();
+
+            segments++;
+            hlpcs += segment->length();
+            for (HighLevelPathSegment::OffsetStateMap::const_iterator sit = segment->low_level_states.begin(),
+                    sie = segment->low_level_states.end(); sit != sie; ++sit) {
+                states += sit->second.size();
+            }
+            for (HighLevelPathSegment::ChildrenMap::iterator cit = segment->children.begin(),
+                    cie = segment->children.end(); cit != cie; ++cit) {
+                worklist.push_back(cit->second.get());
+            }
+        }
+        hlpcs -= hl_state->offset;
+
+        os << "  <HLState " << hl_state->id() << "> " << segments
+                << " segments, " << hlpcs << " HLPCs, " << states
+                << " low-level states" << '\n';
+    }
+}
+
+
 } /* namespace s2e */
@@ -42,10 +42,11 @@
 #include <boost/enable_shared_from_this.hpp>
 
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
 #include <llvm/ADT/SetVector.h>
-//#include <llvm/ADT/DenseSet.h>
-//#include <llvm/ADT/SmallSet.h>
 #include <set>
+#include <map>
+#include <vector>
 
 #include <llvm/Support/raw_ostream.h>
 
@@ -72,54 +73,126 @@ public:
     HighLevelPathTracer();
 
     SharedHLPSRef createRootSegment();
-    SharedHLPSRef getNextSegment(SharedHLPSRef segment, uint64_t next_hlpc);
+
+    // Advance a (segment, offset) position to its successor with the given
+    // HLPC, extending or splitting the path segments as needed.
+    void stepPosition(SharedHLPSRef &segment, unsigned &offset,
+            uint64_t next_hlpc);
+
+    // Drop the part of a segment preceding the given offset, which becomes 0.
+    void trimSegment(SharedHLPSRef segment, unsigned &offset);
+
+    uint64_t segment_count() const {
+        return segment_count_;
+    }
+
+    uint64_t hlpc_count() const {
+        return hlpc_count_;
+    }
+
+    // Approximate memory footprint of the path segments, in bytes
+    uint64_t memory_usage() const;
+
 private:
+    SharedHLPSRef createSegment(boost::shared_ptr<HighLevelPath> path,
+            uint64_t hlpc, SharedHLPSRef parent);
+    SharedHLPSRef splitSegment(SharedHLPSRef segment, unsigned offset);
+
     int path_id_counter_;
+
+    uint64_t segment_count_;
+    uint64_t hlpc_count_;
+
+    friend class HighLevelPathSegment;
+};
+
+
+struct TopologicNode;
+
+// Orders topologic nodes in the sequence visited by a cursor walk
+struct TopologicNodeOrder {
+    bool operator()(const TopologicNode *a, const TopologicNode *b) const;
 };
 
 
 class HighLevelPath {
 public:
-    typedef std::set<boost::weak_ptr<LowLevelState> > LowLevelStateSet;
+    typedef llvm::DenseSet<LowLevelState*> LowLevelStateSet;
+    typedef std::map<TopologicNode*, llvm::SetVector<LowLevelState*>,
+            TopologicNodeOrder> TopologicNodeMap;
 public:
     HighLevelPath(int path_id) : id(path_id) {
 
     }
 
+    void addTopologicState(TopologicNode *node, LowLevelState *state);
+    void removeTopologicState(TopologicNode *node, LowLevelState *state);
+
     int id;
     LowLevelStateSet low_level_states;
+
+    // The topologic nodes holding the low-level states of this path
+    TopologicNodeMap topo_nodes;
 };
 
 
+/*
+ * A segment covers a run of consecutive HLPCs on a single high-level path.
+ * Runs are only split when a low-level state diverges in the middle, so a
+ * position on the high-level tree is a (segment, offset) pair, and forks
+ * only occur at the end of a segment.
+ */
 class HighLevelPathSegment : public boost::enable_shared_from_this<HighLevelPathSegment> {
 public:
     typedef llvm::SmallDenseMap<uint64_t, SharedHLPSRef, 2> ChildrenMap;
-    // TODO: Replace with DenseSet if slow
-    typedef std::set<boost::weak_ptr<LowLevelState> > LowLevelStateSet;
+    typedef llvm::DenseSet<LowLevelState*> LowLevelStateSet;
+    typedef std::map<unsigned, LowLevelStateSet> OffsetStateMap;
 public:
-    HighLevelPathSegment(boost::shared_ptr<HighLevelPath> path);
-    HighLevelPathSegment(boost::shared_ptr<HighLevelPath> path, uint64_t hlpc,
+    HighLevelPathSegment(HighLevelPathTracer &tracer,
+            boost::shared_ptr<HighLevelPath> path, uint64_t hlpc,
             SharedHLPSRef parent);
     ~HighLevelPathSegment();
 
-    void joinState(boost::shared_ptr<LowLevelState> state);
+    void joinState(boost::shared_ptr<LowLevelState> state, unsigned offset);
     void leaveState(boost::shared_ptr<LowLevelState> state);
 
-    uint64_t hlpc;
+    unsigned length() const {
+        return hlpcs.size();
+    }
+
+    bool hasStatesAt(unsigned offset) const {
+        return low_level_states.count(offset) > 0;
+    }
+
+    LowLevelState *getStateAt(unsigned offset) const;
+
+    std::vector<uint64_t> hlpcs;
     boost::shared_ptr<HighLevelPath> path;
 
     WeakHLPSRef parent;
     ChildrenMap children;
 
-    LowLevelStateSet low_level_states;
+    // Only offsets holding at least one state are present
+    OffsetStateMap low_level_states;
 private:
+    HighLevelPathTracer &tracer_;
 
     // Non-copyable
     HighLevelPathSegment(const HighLevelPathSegment&);
     void operator=(const HighLevelPathSegment&);
+
+    friend class HighLevelPathTracer;
 };
 
 
+/*
+ * The position of a node, as the (basic block, call index) pairs of all the
+ * nodes on its topologic index.  Comparing two positions lexicographically
+ * gives the order in which a cursor walk visits the nodes.
+ */
+typedef std::vector<std::pair<int, int> > TopologicPosition;
+
+
 struct TopologicNode : public boost::enable_shared_from_this<TopologicNode> {
     // XXX: For safetly, we should have used weak_ptrs, but SetVectors don't
     // allow it.
@@ -139,9 +212,15 @@ struct TopologicNode : public boost::enable_shared_from_this<TopologicNode> {
     boost::weak_ptr<TopologicNode> down;
     StateSet states;
 
+    TopologicPosition position;
+
     boost::shared_ptr<TopologicNode> getDown(bool cb);
     boost::shared_ptr<TopologicNode> getNext(int bb, int ci);
 
+    // Keep the per-path node index in sync with the state set
+    void addState(LowLevelState *state);
+    void removeState(LowLevelState *state);
+
 private:
     // Non-copyable
     TopologicNode(const TopologicNode&);
@@ -171,11 +250,16 @@ public:
         return segment->path->id;
     }
 
+    uint64_t hlpc() const {
+        return segment->hlpcs[offset];
+    }
+
     void step(uint64_t hlpc);
     boost::shared_ptr<HighLevelState> fork(uint64_t hlpc);
     void terminate();
 
     boost::shared_ptr<HighLevelPathSegment> segment;
+    unsigned offset;
 
     // Used by the strategies that need it (currently, LowLevelTopoStrategy)
     TopologicIndex cursor;
@@ -203,10 +287,14 @@ public:
 
     // The position of the state on the high-level path trace
     boost::shared_ptr<HighLevelPathSegment> segment;
+    unsigned offset;
 
     // Used by the strategies that need it (currently, LowLevelTopoStrategy)
     TopologicIndex topo_index;
 
+    // Hash of the sequence of HLPCs executed by the state
+    uint64_t trace_hash;
+
 private:
     LowLevelState(HighLevelExecutor &analyzer, S2EExecutionState *s2e_state);
 
@@ -228,6 +316,18 @@ public:
         return interp_tracer_;
     }
 
+    const HighLevelPathTracer &path_tracer() const {
+        return path_tracer_;
+    }
+
+    // Whether the high-level tree is over its -hl-tree-memory-budget
+    bool over_memory_budget() const {
+        return over_memory_budget_;
+    }
+
+    // Print the size of the high-level tree ahead of each high-level state
+    void printMemoryReport(llvm::raw_ostream &os) const;
+
     sigc::signal<void,
                  HighLevelState*>
         onHighLevelStateCreate;
@@ -250,6 +350,10 @@ public:
                  HighLevelState*>
         onHighLevelStateSwitch;
 
+    sigc::signal<void,
+                 LowLevelState*>
+        onLowLevelStateKill;
+
 protected:
     boost::shared_ptr<LowLevelState> createState(S2EExecutionState *s2e_state);
 
@@ -260,6 +364,8 @@ private:
     void tryUpdateSelectedState();
     bool doUpdateSelectedState();
 
+    void checkMemoryBudget();
+
     HighLevelPathTracer path_tracer_;
     InterpreterTracer &interp_tracer_;
 
@@ -271,6 +377,8 @@ private:
     HighLevelStateSet high_level_states_;
     boost::shared_ptr<HighLevelState> selected_state_;
 
+    bool over_memory_budget_;
+
     friend class LowLevelState;
     friend class HighLevelState;
 };
@@ -34,6 +34,19 @@
 
 #include "HighLevelStrategy.h"
 
+#include <s2e/Chef/HighLevelExecutor.h>
+
+#include <llvm/Support/CommandLine.h>
+
+namespace {
+
+llvm::cl::opt<unsigned>
+CoveragePatience("hl-cov-patience",
+        llvm::cl::desc("High-level steps without new edges before the coverage strategy switches states"),
+        llvm::cl::init(64));
+
+}
+
 namespace s2e {
 
 // RandomPathStrategy //////////////////////////////////////////////////////////
@@ -63,4 +76,119 @@ RandomPathStrategy::StateRef RandomPathStrategy::selectState() {
     return RandomPathStrategy::StateRef();
 }
 
+// HLPCEdgeCoverage ////////////////////////////////////////////////////////////
+
+HLPCEdgeCoverage::HLPCEdgeCoverage(unsigned map_bits)
+    : map_bits_(map_bits),
+      bitmap_(1 << map_bits, 0),
+      covered_edges_(0) {
+
+}
+
+// CoverageStrategy ////////////////////////////////////////////////////////////
+
+CoverageStrategy::CoverageStrategy(boost::shared_ptr<HLPCEdgeCoverage> coverage)
+    : coverage_(coverage),
+      memory_pressure_(false) {
+
+}
+
+
+void CoverageStrategy::addStates(StateRef current,
+        const std::vector<StateRef> &states) {
+    // The forks and the current state all leave from the same fork point.
+    uint64_t fork_hlpc = 0;
+    if (current) {
+        StateInfoMap::iterator it = states_.find(current.get());
+        assert(it != states_.end() && "Current state not added");
+        fork_hlpc = it->second.last_hlpc;
+    }
+
+    for (std::vector<StateRef>::const_iterator it = states.begin(),
+            ie = states.end(); it != ie; ++it) {
+        bool result = states_.insert(
+                std::make_pair(it->get(), StateInfo())).second;
+        assert(result && "State already added");
+        (void)result;
+
+        if (current) {
+            stepState(*it, fork_hlpc);
+        } else {
+            states_[it->get()].last_hlpc = (*it)->hlpc();
+            others_.update(*it);
+        }
+    }
+
+    if (current) {
+        stepState(current, fork_hlpc);
+    }
+}
+
+
+void CoverageStrategy::killState(StateRef state) {
+    bool result = states_.erase(state.get());
+    assert(result && "State killed twice");
+    (void)result;
+
+    frontier_.remove(state);
+    others_.remove(state);
+
+    if (current_ == state) {
+        current_.reset();
+    }
+}
+
+
+void CoverageStrategy::updateState(StateRef state) {
+    StateInfoMap::iterator it = states_.find(state.get());
+    assert(it != states_.end() && "State not added");
+
+    stepState(state, it->second.last_hlpc);
+}
+
+
+void CoverageStrategy::stepState(StateRef state, uint64_t from_hlpc) {
+    StateInfo &info = states_[state.get()];
+    info.last_hlpc = state->hlpc();
+
+    if (coverage_->cover(from_hlpc, info.last_hlpc)) {
+        info.stale_steps = 0;
+        // The current state is already favored while it discovers edges.
+        if (state != current_) {
+            others_.remove(state);
+            frontier_.update(state);
+        }
+        return;
+    }
+
+    info.stale_steps++;
+    frontier_.remove(state);
+    others_.update(state);
+}
+
+
+CoverageStrategy::StateRef CoverageStrategy::selectState() {
+    if (current_ && (memory_pressure_ ||
+            states_[current_.get()].stale_steps < CoveragePatience)) {
+        return current_;
+    }
+
+    // Over budget, new forks are only picked once the others are exhausted
+    if (!memory_pressure_ || !(current_ = others_.select())) {
+        current_ = frontier_.select();
+        if (current_) {
+            // Give it a fresh chance to discover edges past the fork point
+            frontier_.remove(current_);
+            others_.update(current_);
+        } else {
+            current_ = others_.select();
+        }
+    }
+
+    if (current_) {
+        states_[current_.get()].stale_steps = 0;
+    }
+    return current_;
+}
+
 } /* namespace s2e */
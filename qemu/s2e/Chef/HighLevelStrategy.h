@@ -35,9 +35,17 @@
 #ifndef QEMU_S2E_CHEF_HIGHLEVELSTRATEGY_H_
 #define QEMU_S2E_CHEF_HIGHLEVELSTRATEGY_H_
 
+#include <s2e/Selectors.h>
+
+#include <llvm/ADT/DenseMap.h>
+
 #include <vector>
+#include <list>
+#include <tr1/unordered_map>
 #include <boost/shared_ptr.hpp>
 
+#include <stdint.h>
+
 namespace s2e {
 
 class HighLevelState;
@@ -55,6 +63,11 @@ public:
     virtual void updateState(StateRef state) = 0;
 
     virtual StateRef selectState() = 0;
+
+    // Called when the high-level tree crosses its memory budget, in either
+    // direction.  Strategies that favor new paths should back off while
+    // over budget.
+    virtual void setMemoryPressure(bool over_budget) { }
 };
 
 
@@ -114,6 +127,116 @@ private:
     Selector selector_;
 };
 
+
+/*
+ * AFL-style coverage of the edges between consecutive HLPCs, hashed into a
+ * fixed-size bitmap.  Shared by all the strategies exploring the same
+ * interpreter, so coverage carries over between interpreter runs.
+ */
+class HLPCEdgeCoverage {
+public:
+    HLPCEdgeCoverage(unsigned map_bits = 16);
+
+    // Returns true if the edge was not covered before
+    bool cover(uint64_t from_hlpc, uint64_t to_hlpc) {
+        uint8_t &entry = bitmap_[edgeIndex(from_hlpc, to_hlpc)];
+        bool is_new = (entry == 0);
+        if (is_new) {
+            covered_edges_++;
+        }
+        if (entry < 255) {
+            entry++;
+        }
+        return is_new;
+    }
+
+    bool covered(uint64_t from_hlpc, uint64_t to_hlpc) const {
+        return bitmap_[edgeIndex(from_hlpc, to_hlpc)] != 0;
+    }
+
+    uint64_t covered_edges() const {
+        return covered_edges_;
+    }
+
+private:
+    unsigned locationHash(uint64_t hlpc) const {
+        return (unsigned)((hlpc * 0x9E3779B97F4A7C15ULL) >> (64 - map_bits_));
+    }
+
+    unsigned edgeIndex(uint64_t from_hlpc, uint64_t to_hlpc) const {
+        return (locationHash(from_hlpc) >> 1) ^ locationHash(to_hlpc);
+    }
+
+    unsigned map_bits_;
+    std::vector<uint8_t> bitmap_;
+    uint64_t covered_edges_;
+};
+
+
+/*
+ * Favors the high-level states that just took an HLPC edge never seen
+ * before.  The current state is kept while it keeps discovering edges;
+ * otherwise, the most recent fork entering a new edge is picked, and when
+ * there is none, a random state.  The bitmap, the per-state info and the
+ * selectors are all updated in O(1).
+ *
+ * While the high-level tree is over its memory budget, the current state is
+ * kept until it dies and new forks are no longer favored, so that the
+ * explored paths get finished (and their segments released) before the tree
+ * grows further.
+ */
+class CoverageStrategy : public HighLevelStrategy {
+public:
+    CoverageStrategy(boost::shared_ptr<HLPCEdgeCoverage> coverage);
+
+    void addStates(StateRef current, const std::vector<StateRef> &states);
+    void killState(StateRef state);
+    void updateState(StateRef state);
+
+    StateRef selectState();
+
+    void setMemoryPressure(bool over_budget) {
+        memory_pressure_ = over_budget;
+    }
+
+private:
+    struct StateInfo {
+        StateInfo() : last_hlpc(0), stale_steps(0) { }
+
+        uint64_t last_hlpc;
+        unsigned stale_steps;
+    };
+
+    typedef llvm::DenseMap<HighLevelState*, StateInfo> StateInfoMap;
+
+    // The selectors are updated on every high-level step, so they index
+    // the states by their address too
+    struct StateRefHash {
+        size_t operator()(const StateRef &state) const {
+            return std::tr1::hash<HighLevelState*>()(state.get());
+        }
+    };
+
+    typedef std::list<StateRef> StateQueue;
+    typedef DFSSelector<StateRef, StateQueue,
+            std::tr1::unordered_map<StateRef, StateQueue::iterator,
+                StateRefHash> > FrontierSelector;
+    typedef RandomSelector2<StateRef, RandStdlib, std::vector<StateRef>,
+            std::tr1::unordered_map<StateRef, size_t,
+                StateRefHash> > OthersSelector;
+
+    void stepState(StateRef state, uint64_t from_hlpc);
+
+    boost::shared_ptr<HLPCEdgeCoverage> coverage_;
+
+    StateInfoMap states_;
+    FrontierSelector frontier_;
+    OthersSelector others_;
+
+    StateRef current_;
+    bool memory_pressure_;
+};
+
 } /* namespace s2e */
 
 #endif /* QEMU_S2E_CHEF_HIGHLEVELSTRATEGY_H_ */
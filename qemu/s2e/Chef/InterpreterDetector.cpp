@@ -47,6 +47,10 @@
 #include <map>
 #include <vector>
 #include <set>
+#include <fstream>
+#include <sstream>
+
+#include <inttypes.h>
 
 using boost::shared_ptr;
 using namespace klee;
@@ -58,6 +62,11 @@ DebugDetection("debug-interp-detection",
         llvm::cl::desc("Print debug info for interpreter detection"),
         llvm::cl::init(false));
 
+llvm::cl::opt<bool>
+ForceCalibration("force-interp-calibration",
+        llvm::cl::desc("Ignore the cached interpreter structure parameters"),
+        llvm::cl::init(false));
+
 }
 
 namespace s2e {
@@ -401,11 +410,15 @@ private:
 // InterpreterDetector /////////////////////////////////////////////////////////
 
 InterpreterDetector::InterpreterDetector(CallTracer &call_tracer,
-        boost::shared_ptr<S2ESyscallMonitor> syscall_monitor)
+        boost::shared_ptr<S2ESyscallMonitor> syscall_monitor,
+        const std::string &params_cache)
     : os_tracer_(call_tracer.os_tracer()),
       call_tracer_(call_tracer),
       s2e_(call_tracer.s2e()),
+      params_cache_(params_cache),
       calibrating_(false),
+      skip_calibration_(false),
+      image_key_(0),
       min_opcode_count_(0) {
 
     syscall_range_ = syscall_monitor->registerForRange(
@@ -486,6 +499,23 @@ void InterpreterDetector::startCalibration(S2EExecutionState *state) {
     assert(!calibrating_ && "Calibration start attempted while running");
     assert(!detected_params_ && "Calibration attempted twice on the same interpreter");
 
+    image_key_ = computeImageKey(state);
+
+    InterpreterStructureParams cached_params;
+    if (!ForceCalibration && loadCachedParams(state, image_key_, cached_params)) {
+        s2e_.getMessagesStream(state)
+                << "Found cached interpreter structure for image "
+                << llvm::format("0x%" PRIx64, image_key_)
+                << ". Skipping calibration." << '\n';
+
+        // The guest still goes through the calibration workload, but there
+        // is nothing left to record.  The structure is only announced once
+        // the workload ends, so that its opcodes are not traced.
+        skip_calibration_ = true;
+        detected_params_.reset(new InterpreterStructureParams(cached_params));
+        return;
+    }
+
     calibrating_ = true;
 
     s2e_.getMessagesStream(state)
@@ -503,6 +533,9 @@ void InterpreterDetector::startCalibration(S2EExecutionState *state) {
 
 void InterpreterDetector::checkpointCalibration(S2EExecutionState *state,
         unsigned count) {
+    if (skip_calibration_) {
+        return;
+    }
     assert(calibrating_ && "Cannot checkpoint before calibration starts");
     s2e_.getMessagesStream(state) << "Calibration checkpoint." << '\n';
 
@@ -516,6 +549,12 @@ void InterpreterDetector::checkpointCalibration(S2EExecutionState *state,
 
 
 void InterpreterDetector::endCalibration(S2EExecutionState *state) {
+    if (skip_calibration_) {
+        skip_calibration_ = false;
+        onInterpreterStructureDetected.emit(state, call_tracer_.tracked_tid(),
+                detected_params_.get());
+        return;
+    }
     assert(calibrating_ && "Calibration end attempted before start");
     s2e_.getMessagesStream(state) << "Calibration ended." << '\n';
 
@@ -538,9 +577,143 @@ void InterpreterDetector::endCalibration(S2EExecutionState *state) {
     detected_params_->hlpc_update_pc = analyzer.instrum_hlpc_update;
     detected_params_->instruction_fetch_pc = analyzer.instrum_opcode_read;
 
+    storeCachedParams(state, image_key_, *detected_params_);
+
     onInterpreterStructureDetected.emit(state, call_tracer_.tracked_tid(),
             detected_params_.get());
 }
 
 
+/*
+ * The cache key identifies the interpreter image by its name and the layout
+ * of its executable mappings.  The detected parameters are absolute code
+ * addresses, so a change in the load address must invalidate the entry.
+ * A rebuilt binary may keep the same layout, which is why each entry also
+ * carries the hash of the code at its addresses (see computeCodeHash).
+ */
+uint64_t InterpreterDetector::computeImageKey(S2EExecutionState *state) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+
+    OSThread *thread = os_tracer_.getState(state)->getThread(call_tracer_.tracked_tid());
+    assert(thread != NULL);
+
+    std::string descriptor;
+    llvm::raw_string_ostream os(descriptor);
+    os << thread->name() << ';';
+
+    const OSAddressSpace::VMAreaMap &memory_map = thread->address_space()->memory_map();
+    for (OSAddressSpace::VMAreaMap::const_iterator it = memory_map.begin(),
+            ie = memory_map.end(); it != ie; ++it) {
+        if (!it->second.executable)
+            continue;
+        os << it->second.name << '@'
+           << llvm::format("0x%" PRIx64 "-0x%" PRIx64, it->second.start,
+                   it->second.end) << ';';
+    }
+    os.flush();
+
+    for (std::string::const_iterator it = descriptor.begin(),
+            ie = descriptor.end(); it != ie; ++it) {
+        hash ^= (uint8_t)*it;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+
+/*
+ * Hashes the guest code around each detected address.  The host has no
+ * access to the guest file system, so the code itself stands for the inode
+ * and modification time of the binary.  Returns 0 when the code is not
+ * mapped, which never matches a cache entry.
+ */
+uint64_t InterpreterDetector::computeCodeHash(S2EExecutionState *state,
+        const InterpreterStructureParams &params) {
+    static const unsigned kCodeBytes = 64;
+
+    const uint64_t addresses[] = {
+        params.interp_loop_function,
+        params.hlpc_update_pc,
+        params.instruction_fetch_pc
+    };
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned i = 0; i < sizeof(addresses) / sizeof(addresses[0]); ++i) {
+        uint8_t code[kCodeBytes];
+        if (!state->readMemoryConcrete(addresses[i], code, kCodeBytes)) {
+            return 0;
+        }
+        for (unsigned j = 0; j < kCodeBytes; ++j) {
+            hash ^= code[j];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    return hash ? hash : 1;
+}
+
+
+bool InterpreterDetector::loadCachedParams(S2EExecutionState *state,
+        uint64_t image_key, InterpreterStructureParams &params) {
+    if (params_cache_.empty()) {
+        return false;
+    }
+
+    std::ifstream in(params_cache_.c_str());
+    if (!in) {
+        return false;
+    }
+
+    // One entry per line:
+    // <image key> <loop function> <HLPC update> <fetch> <code hash>
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        uint64_t key, code_hash;
+        InterpreterStructureParams entry;
+
+        ss >> std::hex >> key >> entry.interp_loop_function
+           >> entry.hlpc_update_pc >> entry.instruction_fetch_pc
+           >> code_hash;
+        if (!ss || key != image_key)
+            continue;
+        if (!code_hash || code_hash != computeCodeHash(state, entry))
+            continue;
+
+        params = entry;
+        return true;
+    }
+
+    return false;
+}
+
+
+void InterpreterDetector::storeCachedParams(S2EExecutionState *state,
+        uint64_t image_key, const InterpreterStructureParams &params) {
+    if (params_cache_.empty()) {
+        return;
+    }
+
+    uint64_t code_hash = computeCodeHash(state, params);
+    if (!code_hash) {
+        return;
+    }
+
+    // Append-only, so that concurrent S2E instances can share the same file.
+    std::ofstream out(params_cache_.c_str(), std::ios::app);
+    if (!out) {
+        s2e_.getWarningsStream() << "Could not open interpreter parameters cache "
+                << params_cache_ << '\n';
+        return;
+    }
+
+    out << std::hex << image_key << ' ' << params.interp_loop_function << ' '
+        << params.hlpc_update_pc << ' ' << params.instruction_fetch_pc << ' '
+        << code_hash << '\n';
+}
+
+
 } /* namespace s2e */
@@ -43,6 +43,7 @@
 #include <boost/scoped_ptr.hpp>
 
 #include <stdint.h>
+#include <string>
 
 namespace s2e {
 
@@ -64,7 +65,8 @@ class S2E;
 class InterpreterDetector {
 public:
     InterpreterDetector(CallTracer &call_tracer,
-            boost::shared_ptr<S2ESyscallMonitor> syscall_monitor);
+            boost::shared_ptr<S2ESyscallMonitor> syscall_monitor,
+            const std::string &params_cache = std::string());
     ~InterpreterDetector();
 
     CallTracer &call_tracer() {
@@ -95,15 +97,26 @@ private:
     void checkpointCalibration(S2EExecutionState *state, unsigned count);
     void endCalibration(S2EExecutionState *state);
 
+    // Persistent cache of detected parameters, keyed by interpreter image
+    uint64_t computeImageKey(S2EExecutionState *state);
+    uint64_t computeCodeHash(S2EExecutionState *state,
+            const InterpreterStructureParams &params);
+    bool loadCachedParams(S2EExecutionState *state, uint64_t image_key,
+            InterpreterStructureParams &params);
+    void storeCachedParams(S2EExecutionState *state, uint64_t image_key,
+            const InterpreterStructureParams &params);
 
     // Dependencies
     OSTracer &os_tracer_;
     CallTracer &call_tracer_;
     S2E &s2e_;
     boost::shared_ptr<S2ESyscallRange> syscall_range_;
+    std::string params_cache_;
 
     // Calibration state
     bool calibrating_;
+    bool skip_calibration_;
+    uint64_t image_key_;
     unsigned min_opcode_count_;
     std::pair<uint64_t, uint64_t> memop_range_;
     boost::scoped_ptr<MemoryOpRecorder> memory_recording_;
@@ -99,8 +99,10 @@ LowLevelState *LowLevelSproutStrategy::selectLowLevelState() {
     if (!target_hl_state_)
         return NULL;
 
-    assert(!target_hl_state_->segment->low_level_states.empty());
-    return (*target_hl_state_->segment->low_level_states.begin()).lock().get();
+    LowLevelState *state = target_hl_state_->segment->getStateAt(
+            target_hl_state_->offset);
+    assert(state != NULL);
+    return state;
 }
 
 } /* namespace s2e */
@@ -93,22 +93,24 @@ static bool stepCursor(TopologicIndex &cursor) {
     return true;
 }
 
-static LowLevelState* findNextState(int path_id, TopologicIndex &cursor,
-        long int &counter) {
-    counter = 0;
-    while (!cursor.empty()) {
-        if (!cursor.back()->states.empty()) {
-            for (TopologicNode::StateSet::iterator it = cursor.back()->states.begin(),
-                    ie = cursor.back()->states.end(); it != ie; ++it) {
-                if ((*it)->segment->path->id == path_id) {
-                    return *it;
-                }
-            }
-        }
-        stepCursor(cursor);
-        counter++;
+static LowLevelState* findNextState(HighLevelPath &path, TopologicIndex &cursor) {
+    if (cursor.empty())
+        return NULL;
+
+    // The first node at or after the cursor that holds a state on the path
+    HighLevelPath::TopologicNodeMap::iterator it =
+            path.topo_nodes.lower_bound(cursor.back().get());
+    if (it == path.topo_nodes.end()) {
+        cursor.clear();
+        return NULL;
     }
-    return NULL;
+
+    assert(!it->second.empty());
+    LowLevelState *state = it->second.front();
+
+    // The topologic index of a state is the cursor that reaches its node
+    cursor = state->topo_index;
+    return state;
 }
 
 static int countAccessibleStates(const TopologicIndex &cursor) {
@@ -197,8 +199,8 @@ void LowLevelTopoStrategy::onStackFramePush(CallStack *stack,
     shared_ptr<TopologicNode> next_slot = slot->getDown(true);
     state->topo_index.push_back(next_slot);
 
-    next_slot->states.insert(state);
-    slot->states.remove(state);
+    next_slot->addState(state);
+    slot->removeState(state);
 }
 
 
@@ -222,8 +224,8 @@ void LowLevelTopoStrategy::onStackFramePopping(CallStack *stack,
                 state->topo_index.back()->call_index + 1);
     state->topo_index.back() = next_slot;
 
-    next_slot->states.insert(state);
-    slot->states.remove(state);
+    next_slot->addState(state);
+    slot->removeState(state);
 }
 
 
@@ -337,8 +339,8 @@ void LowLevelTopoStrategy::stepBasicBlock(LowLevelState *state,
         state->topo_index.back() = next_slot;
     }
 
-    next_slot->states.insert(state);
-    prev_slot->states.remove(state);
+    next_slot->addState(state);
+    prev_slot->removeState(state);
 }
 
 
@@ -351,9 +353,8 @@ bool LowLevelTopoStrategy::trySchedule() {
         return false;
     }
 
-    long int counter;
     LowLevelState *next_state = findNextState(
-                target_hl_state_->id(), active_cursor_, counter);
+                *target_hl_state_->segment->path, active_cursor_);
     assert(next_state && "Could not find next state. Perhaps wrong cursor position?");
 
     if (next_state == current_ll_state_) {
@@ -88,6 +88,8 @@ public:
         void operator=(VMArea&);
     };
 
+    typedef std::map<uint64_t, VMArea> VMAreaMap;
+
 public:
     OSTracerState *os_state() const {
         return os_state_.lock().get();
@@ -97,6 +99,10 @@ public:
         return page_table_;
     }
 
+    const VMAreaMap &memory_map() const {
+        return memory_map_;
+    }
+
     // FIXME An address space can be shared by several threads
     boost::shared_ptr<OSThread> thread() {
         return thread_.lock();
@@ -107,8 +113,6 @@ private:
             uint64_t page_table);
     OSAddressSpace(const OSAddressSpace &other);
 
-    typedef std::map<uint64_t, VMArea> VMAreaMap;
-
     boost::weak_ptr<OSTracerState> os_state_;
     // FIXME: In general, one or more threads share an address space.
     boost::weak_ptr<OSThread> thread_;
@@ -140,6 +140,13 @@ public:
 protected:
     virtual StateRef createState(S2EExecutionState *s2e_state) = 0;
 
+    // Releases all the states.  Subclasses whose states refer to their
+    // members call this from their destructor, before the members are gone.
+    void clearStates() {
+        lru_ = std::pair<S2EExecutionState*, StateRef>();
+        state_map_.clear();
+    }
+
 private:
     typedef std::vector<S2EExecutionState*> S2EStateVector;
 
@@ -0,0 +1,300 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Stefan Bucur <stefan.bucur@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "TestCaseCorpus.h"
+
+#include <s2e/S2E.h>
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kCorpusMagic[] = "CHEFTC01";
+const unsigned kCorpusMagicSize = sizeof(kCorpusMagic) - 1;
+
+// Amount of pending data that triggers a write to disk
+const unsigned kFlushThreshold = 64 * 1024;
+
+const uint64_t kFNVOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t kFNVPrime = 0x100000001b3ULL;
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= kFNVPrime;
+    }
+    return hash;
+}
+
+template<typename T>
+void appendValue(std::string &buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+bool readValue(const std::string &buffer, size_t &pos, T &value) {
+    if (pos + sizeof(value) > buffer.size())
+        return false;
+    memcpy(&value, buffer.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+bool readBytes(const std::string &buffer, size_t &pos, std::string &value) {
+    uint32_t size;
+    if (!readValue(buffer, pos, size) || pos + size > buffer.size())
+        return false;
+    value.assign(buffer, pos, size);
+    pos += size;
+    return true;
+}
+
+}
+
+namespace s2e {
+
+// HighLevelTestCase ///////////////////////////////////////////////////////////
+
+/*
+ * Concolic variables are named v<state var id>_<name>_<global var id>.  The
+ * state-local id is deterministic for a given execution, while the global id
+ * depends on the whole session, so it is dropped.
+ */
+std::string HighLevelTestCase::stableName(const std::string &unique_name) {
+    std::string::size_type pos = unique_name.rfind('_');
+    if (pos == std::string::npos)
+        return unique_name;
+    return unique_name.substr(0, pos);
+}
+
+
+const HighLevelTestCase::Bytes *HighLevelTestCase::findVariable(
+        const std::string &stable_name) const {
+    for (VariableList::const_iterator it = variables.begin(),
+            ie = variables.end(); it != ie; ++it) {
+        if (stableName(it->first) == stable_name)
+            return &it->second;
+    }
+    return NULL;
+}
+
+// TestCaseCorpus //////////////////////////////////////////////////////////////
+
+TestCaseCorpus::TestCaseCorpus(S2E &s2e, const std::string &file_name)
+    : s2e_(s2e),
+      file_name_(file_name),
+      fd_(-1),
+      recorded_count_(0),
+      duplicate_count_(0) {
+    load();
+
+    fd_ = open(file_name_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        s2e_.getWarningsStream() << "Could not open test case corpus "
+                << file_name_ << ": " << strerror(errno) << '\n';
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && st.st_size == 0) {
+        pending_.append(kCorpusMagic, kCorpusMagicSize);
+    }
+}
+
+
+TestCaseCorpus::~TestCaseCorpus() {
+    flush();
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+
+void TestCaseCorpus::load() {
+    std::ifstream in(file_name_.c_str(), std::ios::binary);
+    if (!in) {
+        return;
+    }
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string buffer = ss.str();
+
+    if (buffer.empty()) {
+        return;
+    }
+
+    if (buffer.compare(0, kCorpusMagicSize, kCorpusMagic) != 0) {
+        s2e_.getWarningsStream() << "Invalid test case corpus " << file_name_
+                << ". Ignoring its contents." << '\n';
+        return;
+    }
+
+    size_t pos = kCorpusMagicSize;
+    while (pos < buffer.size()) {
+        uint32_t record_size;
+        if (!readValue(buffer, pos, record_size) ||
+                pos + record_size > buffer.size()) {
+            s2e_.getWarningsStream() << "Truncated test case corpus "
+                    << file_name_ << '\n';
+            break;
+        }
+
+        std::string record(buffer, pos, record_size);
+        pos += record_size;
+
+        HighLevelTestCase test_case;
+        size_t rpos = 0;
+        int32_t path_id;
+        uint32_t var_count;
+        bool ok = readValue(record, rpos, path_id) &&
+                readValue(record, rpos, test_case.trace_hash) &&
+                readValue(record, rpos, test_case.content_hash) &&
+                readValue(record, rpos, var_count);
+
+        for (uint32_t i = 0; ok && i < var_count; ++i) {
+            std::string name, data;
+            ok = readBytes(record, rpos, name) && readBytes(record, rpos, data);
+            if (ok) {
+                test_case.variables.push_back(std::make_pair(name,
+                        HighLevelTestCase::Bytes(data.begin(), data.end())));
+            }
+        }
+
+        if (!ok) {
+            s2e_.getWarningsStream() << "Skipping malformed test case in corpus "
+                    << file_name_ << '\n';
+            continue;
+        }
+
+        test_case.path_id = path_id;
+        trace_hashes_.insert(test_case.trace_hash);
+        content_hashes_.insert(test_case.content_hash);
+        loaded_.push_back(test_case);
+    }
+
+    s2e_.getMessagesStream() << "Loaded " << loaded_.size()
+            << " test cases from corpus " << file_name_ << '\n';
+}
+
+
+uint64_t TestCaseCorpus::computeContentHash(const HighLevelTestCase &test_case) {
+    uint64_t hash = kFNVOffsetBasis;
+    for (HighLevelTestCase::VariableList::const_iterator it =
+            test_case.variables.begin(), ie = test_case.variables.end();
+            it != ie; ++it) {
+        std::string name = HighLevelTestCase::stableName(it->first);
+        hash = hashBytes(hash, name.data(), name.size() + 1);
+        if (!it->second.empty()) {
+            hash = hashBytes(hash, &it->second[0], it->second.size());
+        }
+    }
+    return hash;
+}
+
+
+bool TestCaseCorpus::addTestCase(HighLevelTestCase &test_case) {
+    test_case.content_hash = computeContentHash(test_case);
+
+    if (trace_hashes_.count(test_case.trace_hash) ||
+            content_hashes_.count(test_case.content_hash)) {
+        duplicate_count_++;
+        return false;
+    }
+    trace_hashes_.insert(test_case.trace_hash);
+    content_hashes_.insert(test_case.content_hash);
+
+    std::string record;
+    appendValue(record, (int32_t)test_case.path_id);
+    appendValue(record, test_case.trace_hash);
+    appendValue(record, test_case.content_hash);
+    appendValue(record, (uint32_t)test_case.variables.size());
+
+    for (HighLevelTestCase::VariableList::const_iterator it =
+            test_case.variables.begin(), ie = test_case.variables.end();
+            it != ie; ++it) {
+        appendValue(record, (uint32_t)it->first.size());
+        record.append(it->first);
+        appendValue(record, (uint32_t)it->second.size());
+        record.append(it->second.begin(), it->second.end());
+    }
+
+    appendValue(pending_, (uint32_t)record.size());
+    pending_.append(record);
+    recorded_count_++;
+
+    if (pending_.size() >= kFlushThreshold) {
+        flush();
+    }
+    return true;
+}
+
+
+/*
+ * The corpus is opened in append mode and each flush is a single write, so
+ * the records of concurrent S2E processes sharing the file do not interleave.
+ */
+void TestCaseCorpus::flush() {
+    if (fd_ < 0 || pending_.empty()) {
+        return;
+    }
+
+    const char *data = pending_.data();
+    size_t size = pending_.size();
+    while (size > 0) {
+        ssize_t written = write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            s2e_.getWarningsStream() << "Could not write to test case corpus "
+                    << file_name_ << ": " << strerror(errno) << '\n';
+            break;
+        }
+        data += written;
+        size -= written;
+    }
+    pending_.clear();
+}
+
+} /* namespace s2e */
@@ -0,0 +1,128 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Stefan Bucur <stefan.bucur@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef QEMU_S2E_CHEF_TESTCASECORPUS_H_
+#define QEMU_S2E_CHEF_TESTCASECORPUS_H_
+
+#include <deque>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace s2e {
+
+class S2E;
+
+
+struct HighLevelTestCase {
+    typedef std::vector<unsigned char> Bytes;
+    typedef std::vector<std::pair<std::string, Bytes> > VariableList;
+
+    HighLevelTestCase() : path_id(0), trace_hash(0), content_hash(0) {
+
+    }
+
+    int path_id;
+    uint64_t trace_hash;
+    uint64_t content_hash;
+    VariableList variables;
+
+    // The lookup key of a concolic variable, stable across sessions
+    static std::string stableName(const std::string &unique_name);
+
+    const Bytes *findVariable(const std::string &stable_name) const;
+};
+
+
+/*
+ * A binary, append-only store of the high-level test cases of a Chef
+ * campaign.  Test cases are deduplicated by the hash of the HLPC trace that
+ * produced them and by the hash of their contents, including the entries
+ * already on disk, so several sessions (or several S2E processes) can share
+ * the same corpus file.
+ *
+ * Writes are batched in memory and flushed once enough data accumulates, on
+ * an explicit flush(), or on destruction.
+ */
+class TestCaseCorpus {
+public:
+    TestCaseCorpus(S2E &s2e, const std::string &file_name);
+    ~TestCaseCorpus();
+
+    // Returns false if the test case was a duplicate and was not recorded
+    bool addTestCase(HighLevelTestCase &test_case);
+
+    void flush();
+
+    // Test cases loaded from the corpus at startup, in file order
+    const std::deque<HighLevelTestCase> &loaded() const {
+        return loaded_;
+    }
+
+    uint64_t recorded_count() const {
+        return recorded_count_;
+    }
+
+    uint64_t duplicate_count() const {
+        return duplicate_count_;
+    }
+
+private:
+    void load();
+    static uint64_t computeContentHash(const HighLevelTestCase &test_case);
+
+    S2E &s2e_;
+    std::string file_name_;
+    int fd_;
+
+    std::set<uint64_t> trace_hashes_;
+    std::set<uint64_t> content_hashes_;
+
+    std::deque<HighLevelTestCase> loaded_;
+    std::string pending_;
+
+    uint64_t recorded_count_;
+    uint64_t duplicate_count_;
+
+    // Non-copyable
+    TestCaseCorpus(const TestCaseCorpus&);
+    void operator=(const TestCaseCorpus&);
+};
+
+} /* namespace s2e */
+
+#endif /* QEMU_S2E_CHEF_TESTCASECORPUS_H_ */
@@ -0,0 +1,274 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+/*
+ * Native fast paths for QEMU helpers called from symbolically executed code.
+ *
+ * Every helper registered with TCG also exists as LLVM bitcode in
+ * op_helper.bc, which KLEE interprets. When a helper does not touch guest
+ * memory, all its arguments are concrete and none of the registers it
+ * accesses (according to its TCG register masks) are symbolic, the native
+ * version computes the same result much faster. Otherwise the call falls
+ * back to the interpreted bitcode.
+ */
+
+extern "C" {
+#include <qemu-common.h>
+#include <cpu-all.h>
+#include <tcg.h>
+#include <exec-all.h>
+extern CPUArchState *env;
+}
+
+#include "S2EExecutor.h"
+#include "S2EExecutionState.h"
+#include "S2E.h"
+#include "Utils.h"
+
+#include <klee/CoreStats.h>
+#include <klee/ExternalDispatcher.h>
+#include <klee/Memory.h>
+#include <klee/Internal/System/Time.h>
+
+#include <llvm/Module.h>
+#include <llvm/Function.h>
+#include <llvm/Instructions.h>
+#include <llvm/Support/CommandLine.h>
+
+#include <algorithm>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+    cl::opt<bool>
+    NativeHelpers("native-helpers",
+                  cl::desc("Run QEMU helpers natively when their arguments and the registers they access are concrete"),
+                  cl::init(false));
+
+    cl::opt<bool>
+    ProfileHelpers("profile-helpers",
+                   cl::desc("Count calls and time spent in each QEMU helper and write them to helpers.csv"),
+                   cl::init(false));
+}
+
+namespace s2e {
+
+static void copyBackRegisters(ObjectState *wos, const uint8_t *native,
+                              const uint8_t *store)
+{
+    for (unsigned i = 0; i < wos->size; ++i) {
+        if (native[i] != store[i]) {
+            wos->write8(i, native[i]);
+        }
+    }
+}
+
+void S2EExecutor::initializeHelpers()
+{
+    if (!NativeHelpers && !ProfileHelpers) {
+        return;
+    }
+
+    TCGContext *s = &tcg_ctx;
+    for (int i = 0; i < s->nb_helpers; ++i) {
+        const TCGHelperInfo &info = s->helpers[i];
+        Function *f = kmodule->module->getFunction(
+                std::string("helper_") + info.name);
+
+        // Helpers without bitcode are called natively anyway
+        if (!f || f->isDeclaration() || overridenInternalFunctions.count(f)) {
+            continue;
+        }
+
+        HelperInfo &helper = m_helpers[f];
+        helper.name = info.name;
+        helper.regReadMask = info.reg_rmask;
+        helper.regWriteMask = info.reg_wmask;
+        helper.accessesMem = info.accesses_mem;
+        helper.interpretedCalls = helper.interpretedInstructions = 0;
+        helper.nativeCalls = helper.symbolicArgs = helper.symbolicRegs = 0;
+        helper.interpretedTime = helper.nativeTime = 0;
+    }
+}
+
+void S2EExecutor::executeCall(ExecutionState &state, KInstruction *ki,
+                              Function *f, std::vector<ref<Expr> > &arguments)
+{
+    Helpers::iterator it = f ? m_helpers.find(f) : m_helpers.end();
+    if (it == m_helpers.end()) {
+        Executor::executeCall(state, ki, f, arguments);
+        return;
+    }
+
+    HelperInfo &helper = it->second;
+    S2EExecutionState *s2estate = static_cast<S2EExecutionState*>(&state);
+
+    if (NativeHelpers && !helper.accessesMem) {
+        bool concreteArgs = true;
+        for (unsigned i = 0; i < arguments.size(); ++i) {
+            if (!isa<klee::ConstantExpr>(arguments[i])) {
+                concreteArgs = false;
+                break;
+            }
+        }
+
+        if (!concreteArgs) {
+            ++helper.symbolicArgs;
+        } else if ((helper.regReadMask | helper.regWriteMask) &
+                   s2estate->getSymbolicRegistersMask()) {
+            ++helper.symbolicRegs;
+        } else if (callNativeHelper(s2estate, ki, f, helper, arguments)) {
+            return;
+        }
+    }
+
+    ++helper.interpretedCalls;
+    Executor::executeCall(state, ki, f, arguments);
+
+    if (ProfileHelpers) {
+        HelperFrame frame;
+        frame.helper = &helper;
+        frame.stackSize = state.stack.size();
+        frame.instructions = stats::instructions;
+        frame.time = util::getWallTime();
+        m_helperFrames.push_back(frame);
+    }
+}
+
+bool S2EExecutor::callNativeHelper(S2EExecutionState *state,
+                                   KInstruction *ki, Function *f,
+                                   HelperInfo &helper,
+                                   std::vector<ref<Expr> > &arguments)
+{
+    uint64_t *args = (uint64_t*) alloca(sizeof(*args) * (arguments.size() + 1));
+    memset(args, 0, sizeof(*args) * (arguments.size() + 1));
+    for (unsigned i = 0; i < arguments.size(); ++i) {
+        cast<klee::ConstantExpr>(arguments[i])->toMemory(&args[i + 1]);
+    }
+
+    // In symbolic mode the native copy of the registers is stale. The
+    // helper only accesses concrete ones, so it is enough to refresh it
+    // and to copy back whatever the helper changed.
+    ObjectState *wos = state->m_cpuRegistersObject;
+    uint8_t *native = (uint8_t*) state->m_cpuRegistersState->address;
+    const uint8_t *store = wos->getConcreteStore(true);
+    memcpy(native, store, wos->size);
+
+    double start = ProfileHelpers ? util::getWallTime() : 0;
+    bool success;
+    try {
+        success = externalDispatcher->executeCall(f, ki->inst, args);
+    } catch (CpuExitException &) {
+        // The helper raised a guest exception after updating registers
+        copyBackRegisters(wos, native, store);
+        ++helper.nativeCalls;
+        throw;
+    }
+
+    if (!success) {
+        return false;
+    }
+
+    copyBackRegisters(wos, native, store);
+    ++helper.nativeCalls;
+    if (ProfileHelpers) {
+        helper.nativeTime += util::getWallTime() - start;
+    }
+
+    Type *resultType = ki->inst->getType();
+    if (!resultType->isVoidTy()) {
+        bindLocal(ki, *state, klee::ConstantExpr::fromMemory(
+                          (void*) args, getWidthForLLVMType(resultType)));
+    }
+
+    return true;
+}
+
+/** Accounts for the interpreted helpers that returned to their caller */
+void S2EExecutor::popHelperFrames(S2EExecutionState *state)
+{
+    double time = util::getWallTime();
+    while (!m_helperFrames.empty() &&
+           state->stack.size() < m_helperFrames.back().stackSize) {
+        HelperFrame &frame = m_helperFrames.back();
+        frame.helper->interpretedInstructions +=
+                stats::instructions - frame.instructions;
+        frame.helper->interpretedTime += time - frame.time;
+        m_helperFrames.pop_back();
+    }
+}
+
+namespace {
+    struct HelperTimeOrder {
+        template<typename T>
+        bool operator()(const T *a, const T *b) const {
+            return a->interpretedTime + a->nativeTime >
+                   b->interpretedTime + b->nativeTime;
+        }
+    };
+}
+
+void S2EExecutor::writeHelperProfile()
+{
+    if (!ProfileHelpers) {
+        return;
+    }
+
+    std::vector<const HelperInfo*> helpers;
+    foreach2(it, m_helpers.begin(), m_helpers.end()) {
+        const HelperInfo &helper = (*it).second;
+        if (helper.interpretedCalls || helper.nativeCalls) {
+            helpers.push_back(&helper);
+        }
+    }
+    std::sort(helpers.begin(), helpers.end(), HelperTimeOrder());
+
+    llvm::raw_ostream *out = m_s2e->openOutputFile("helpers.csv");
+    if (!out) {
+        return;
+    }
+
+    *out << "Helper,InterpretedCalls,InterpretedInstructions,InterpretedTime,"
+            "NativeCalls,NativeTime,SymbolicArgs,SymbolicRegs\n";
+    foreach2(it, helpers.begin(), helpers.end()) {
+        const HelperInfo &h = **it;
+        *out << h.name << ','
+             << h.interpretedCalls << ',' << h.interpretedInstructions << ','
+             << h.interpretedTime << ','
+             << h.nativeCalls << ',' << h.nativeTime << ','
+             << h.symbolicArgs << ',' << h.symbolicRegs << '\n';
+    }
+
+    delete out;
+}
+
+} // namespace s2e
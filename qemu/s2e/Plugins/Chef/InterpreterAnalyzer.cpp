@@ -35,6 +35,7 @@
 #include "InterpreterAnalyzer.h"
 
 #include <s2e/S2E.h>
+#include <s2e/S2EExecutionState.h>
 #include <s2e/ConfigFile.h>
 #include <s2e/Plugins/CorePlugin.h>
 #include <s2e/Plugins/Opcodes.h>
@@ -51,6 +52,7 @@
 #include <s2e/Chef/HighLevelStrategy.h>
 #include <s2e/Chef/LowLevelStrategy.h>
 #include <s2e/Chef/LowLevelTopoStrategy.h>
+#include <s2e/Chef/TestCaseCorpus.h>
 
 #include <llvm/Support/Format.h>
 #include <llvm/Support/TimeValue.h>
@@ -73,7 +75,9 @@ static const char *valid_interpreters[] = {
 
 class IAHighLevelStrategyFactory : public HighLevelStrategyFactory {
 public:
-    IAHighLevelStrategyFactory(const std::string &config) : config_(config) {
+    IAHighLevelStrategyFactory(const std::string &config,
+            shared_ptr<HLPCEdgeCoverage> coverage)
+        : config_(config), coverage_(coverage) {
 
     }
 
@@ -82,6 +86,8 @@ public:
            return new SelectorStrategy<DFSSelector<HighLevelStrategy::StateRef> >();
        } else if (config_ == "bfs") {
            return new SelectorStrategy<BFSSelector<HighLevelStrategy::StateRef> >();
+       } else if (config_ == "cov") {
+           return new CoverageStrategy(coverage_);
        } else {
            return NULL;
        }
@@ -89,6 +95,7 @@ public:
 
 private:
     std::string config_;
+    shared_ptr<HLPCEdgeCoverage> coverage_;
 };
 
 
@@ -122,6 +129,9 @@ S2E_DEFINE_PLUGIN(InterpreterAnalyzer,
 
 InterpreterAnalyzer::InterpreterAnalyzer(S2E *s2e)
     : Plugin(s2e),
+      replay_corpus_(false),
+      replay_index_(0),
+      replay_case_(NULL),
       tracked_tid_(0) {
 
 }
@@ -140,6 +150,21 @@ void InterpreterAnalyzer::initialize() {
             sigc::mem_fun(*this, &InterpreterAnalyzer::onThreadCreate));
     os_tracer_->onThreadExit.connect(
             sigc::mem_fun(*this, &InterpreterAnalyzer::onThreadExit));
+
+    std::string corpus_file = s2e()->getConfig()->getString(
+            getConfigKey() + ".testCorpus", "");
+    if (!corpus_file.empty()) {
+        test_corpus_.reset(new TestCaseCorpus(*s2e(), corpus_file));
+        s2e()->getCorePlugin()->onProcessFork.connect(
+                sigc::mem_fun(*this, &InterpreterAnalyzer::onProcessFork));
+
+        replay_corpus_ = s2e()->getConfig()->getBool(
+                getConfigKey() + ".replayCorpus", false);
+        if (replay_corpus_) {
+            s2e()->getCorePlugin()->onConcolicVariableCreation.connect(
+                    sigc::mem_fun(*this, &InterpreterAnalyzer::onConcolicVariableCreation));
+        }
+    }
 }
 
 
@@ -149,7 +174,7 @@ llvm::raw_ostream& InterpreterAnalyzer::getStream(const HighLevelState *hl_state
         llvm::sys::TimeValue curTime = llvm::sys::TimeValue::now();
         os << (curTime.seconds() - s2e()->getStartTime()) << ' ';
         os << llvm::format("<HLState %d @ 0x%x>", hl_state->id(),
-                hl_state->segment->hlpc);
+                hl_state->hlpc());
         os << ' ';
     }
     return os;
@@ -199,15 +224,20 @@ void InterpreterAnalyzer::onThreadCreate(S2EExecutionState *state,
     } else {
         s2e()->getMessagesStream(state) << "Interpreter structure unknown. "
                 << "Registering detector..." << '\n';
-        interp_detector_.reset(new InterpreterDetector(*call_tracer_, smonitor_));
+        interp_detector_.reset(new InterpreterDetector(*call_tracer_, smonitor_,
+                s2e()->getConfig()->getString(getConfigKey() + ".paramsCache", "")));
         interp_detector_->onInterpreterStructureDetected.connect(
                 sigc::mem_fun(*this, &InterpreterAnalyzer::onInterpreterStructureDetected));
     }
 
     IALowLevelStrategyFactory ll_factory(s2e()->getConfig()->getString(
             getConfigKey() + ".llstrategy", "topo"));
+    if (!hl_coverage_) {
+        hl_coverage_.reset(new HLPCEdgeCoverage());
+    }
+
     IAHighLevelStrategyFactory hl_factory(s2e()->getConfig()->getString(
-            getConfigKey() + ".hlstrategy", "dfs"));
+            getConfigKey() + ".hlstrategy", "dfs"), hl_coverage_);
 
     high_level_executor_.reset(new HighLevelExecutor(*interp_tracer_,
             hl_factory, ll_factory));
@@ -222,6 +252,21 @@ void InterpreterAnalyzer::onThreadCreate(S2EExecutionState *state,
             sigc::mem_fun(*this, &InterpreterAnalyzer::onHighLevelStateFork));
     high_level_executor_->onHighLevelStateSwitch.connect(
             sigc::mem_fun(*this, &InterpreterAnalyzer::onHighLevelStateSwitch));
+
+    if (test_corpus_) {
+        high_level_executor_->onLowLevelStateKill.connect(
+                sigc::mem_fun(*this, &InterpreterAnalyzer::onLowLevelStateKill));
+    }
+
+    // Each run of the interpreter replays the next test case in the corpus
+    replay_case_ = NULL;
+    if (replay_corpus_ && replay_index_ < test_corpus_->loaded().size()) {
+        replay_case_ = &test_corpus_->loaded()[replay_index_];
+        s2e()->getMessagesStream(state) << "Replaying corpus test case "
+                << replay_index_ << " (HL path " << replay_case_->path_id
+                << ")" << '\n';
+        replay_index_++;
+    }
 }
 
 
@@ -243,6 +288,19 @@ void InterpreterAnalyzer::onThreadExit(S2EExecutionState *state,
     }
 
     s2e()->getMessagesStream(state) << "OPCODE STATS: " << sos.str() << '\n';
+    s2e()->getMessagesStream(state) << "HLPC edges covered: "
+            << hl_coverage_->covered_edges() << '\n';
+
+    if (high_level_executor_) {
+        high_level_executor_->printMemoryReport(s2e()->getMessagesStream(state));
+    }
+
+    if (test_corpus_) {
+        test_corpus_->flush();
+        s2e()->getMessagesStream(state) << "Test corpus: "
+                << test_corpus_->recorded_count() << " recorded, "
+                << test_corpus_->duplicate_count() << " duplicates" << '\n';
+    }
 
     tracked_tid_ = 0;
 
@@ -315,7 +373,7 @@ void InterpreterAnalyzer::onHighLevelStateFork(HighLevelState *hl_state,
         if (*it == hl_state)
             continue;
         getStream(hl_state) << "State " << (*it)->id() << " forked at "
-                << llvm::format("0x%x", (*it)->segment->hlpc) << '\n';
+                << llvm::format("0x%x", (*it)->hlpc()) << '\n';
     }
 #endif
 }
@@ -329,6 +387,57 @@ void InterpreterAnalyzer::onHighLevelStateSwitch(HighLevelState *prev,
 }
 
 
+void InterpreterAnalyzer::onLowLevelStateKill(LowLevelState *ll_state) {
+    S2EExecutionState *state = ll_state->s2e_state();
+
+    HighLevelTestCase test_case;
+    test_case.path_id = ll_state->segment->path->id;
+    test_case.trace_hash = ll_state->trace_hash;
+
+    for (unsigned i = 0; i < state->symbolics.size(); ++i) {
+        const klee::Array *array = state->symbolics[i].second;
+        klee::Assignment::bindings_ty::const_iterator it =
+                state->concolics.bindings.find(array);
+        if (it == state->concolics.bindings.end())
+            continue;
+        test_case.variables.push_back(std::make_pair(array->name, it->second));
+    }
+
+    if (test_case.variables.empty())
+        return;
+
+    if (test_corpus_->addTestCase(test_case)) {
+        s2e()->getMessagesStream(state) << "Recorded test case for HL path "
+                << test_case.path_id << '\n';
+    }
+}
+
+
+void InterpreterAnalyzer::onConcolicVariableCreation(S2EExecutionState *state,
+        const std::string &name, const klee::Array *array) {
+    if (!replay_case_)
+        return;
+
+    const HighLevelTestCase::Bytes *data = replay_case_->findVariable(
+            HighLevelTestCase::stableName(name));
+    if (!data || data->size() != array->size) {
+        s2e()->getWarningsStream(state) << "No replay value for " << name
+                << ". Keeping the default." << '\n';
+        return;
+    }
+    state->concolics.bindings[array] = *data;
+}
+
+
+void InterpreterAnalyzer::onProcessFork(bool prefork, bool is_child,
+        unsigned parent_proc_id) {
+    // Otherwise, both processes would write the same pending test cases
+    if (prefork) {
+        test_corpus_->flush();
+    }
+}
+
+
 } /* namespace plugins */
 
 } /* namespace s2e */
@@ -44,6 +44,10 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
+namespace klee {
+class Array;
+}
+
 namespace s2e {
 
 class OSTracer;
@@ -57,8 +61,12 @@ class InterpreterSemantics;
 
 class HighLevelExecutor;
 class HighLevelState;
+class LowLevelState;
 class HighLevelStack;
 class HighLevelStrategy;
+class HLPCEdgeCoverage;
+class TestCaseCorpus;
+struct HighLevelTestCase;
 
 namespace plugins {
 
@@ -85,6 +93,11 @@ private:
     void onHighLevelStateFork(HighLevelState *hl_state,
             const std::vector<HighLevelState*> &forks);
     void onHighLevelStateSwitch(HighLevelState *prev, HighLevelState *next);
+    void onLowLevelStateKill(LowLevelState *ll_state);
+
+    void onConcolicVariableCreation(S2EExecutionState *state,
+            const std::string &name, const klee::Array *array);
+    void onProcessFork(bool prefork, bool is_child, unsigned parent_proc_id);
 
     llvm::raw_ostream& getStream(const HighLevelState *hl_state);
 
@@ -100,6 +113,12 @@ private:
     boost::scoped_ptr<InterpreterTracer> interp_tracer_;
     boost::scoped_ptr<HighLevelStrategy> strategy_;
     boost::scoped_ptr<HighLevelExecutor> high_level_executor_;
+    boost::shared_ptr<HLPCEdgeCoverage> hl_coverage_;
+
+    boost::scoped_ptr<TestCaseCorpus> test_corpus_;
+    bool replay_corpus_;
+    unsigned replay_index_;
+    const HighLevelTestCase *replay_case_;
 
     int tracked_tid_;
     std::string selected_interpreter_;
@@ -58,6 +58,7 @@ struct QObject;
 
 namespace klee {
 struct Query;
+class Array;
 }
 
 namespace s2e {
@@ -151,6 +152,16 @@ public:
                  const std::string& /* message */>
             onTestCaseGeneration;
 
+    /**
+     * Triggered when a concolic variable is created, once its example
+     * values are bound in the concolic assignment of the state.
+     */
+    sigc::signal<void,
+                 S2EExecutionState*,
+                 const std::string& /* unique name */,
+                 const klee::Array* /* array */>
+            onConcolicVariableCreation;
+
 
     /** Signal emitted when spawning a new S2E process */
     sigc::signal<void, bool /* prefork */,
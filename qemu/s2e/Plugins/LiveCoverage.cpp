@@ -0,0 +1,400 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+extern "C" {
+#include "config.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec-all.h"
+extern CPUArchState *env;
+}
+
+#include "LiveCoverage.h"
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+
+#include <algorithm>
+#include <sstream>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(LiveCoverage, "Live basic block coverage shared by all S2E processes",
+                  "LiveCoverage", "ModuleExecutionDetector");
+
+namespace {
+    struct BasicBlockOrder {
+        template<typename T>
+        bool operator()(const T &b1, const T &b2) const {
+            return b1.start < b2.start;
+        }
+    };
+}
+
+void LiveCoverage::initialize()
+{
+    m_detector = static_cast<ModuleExecutionDetector*>(s2e()->getPlugin("ModuleExecutionDetector"));
+    m_segment = NULL;
+    m_segmentSize = 0;
+    m_header = NULL;
+    m_blockCount = 0;
+    m_coveredInstrumentedTbs = 0;
+
+    ConfigFile *cfg = s2e()->getConfig();
+
+    //Directory with the <module>.bblist files produced by the IDA scripts
+    std::string bbListDir = cfg->getString(getConfigKey() + ".bbListDir", ".");
+
+    //Modules must be known upfront, the segment cannot grow once shared
+    ConfigFile::string_list modules = cfg->getStringList(getConfigKey() + ".modules");
+    foreach2(it, modules.begin(), modules.end()) {
+        Module &module = m_modules[*it];
+        if (!loadBasicBlocks(bbListDir + "/" + *it + ".bblist", module)) {
+            s2e()->getWarningsStream() << "LiveCoverage: no basic blocks for " << *it << '\n';
+            m_modules.erase(*it);
+            continue;
+        }
+        m_blockCount += module.blocks.size();
+    }
+
+    //Name of a POSIX shared memory object to export the coverage to
+    //other processes (e.g., dashboards). Anonymous memory otherwise.
+    std::string shmName = cfg->getString(getConfigKey() + ".shmName", "");
+    if (!allocateSegment(shmName)) {
+        exit(-1);
+    }
+
+    //With several S2E processes, set this to a path outside of the
+    //per-process output directories to always find the latest snapshot
+    m_snapshotFile = cfg->getString(getConfigKey() + ".snapshotFile",
+                                    s2e()->getOutputFilename("coverage.livecov"));
+    m_snapshotInterval = cfg->getInt(getConfigKey() + ".snapshotInterval", 10);
+
+    //Translation blocks keep their instrumentation until they are
+    //retranslated. Flushing the translation cache after that many of them
+    //got covered removes it. Without flushing, covered blocks keep paying
+    //for the instrumentation on every execution. 0 disables flushing.
+    m_flushTbThreshold = cfg->getInt(getConfigKey() + ".flushTbThreshold", 1000);
+
+    m_detector->onModuleTranslateBlockEnd.connect(
+            sigc::mem_fun(*this, &LiveCoverage::onModuleTranslateBlockEnd));
+
+    s2e()->getCorePlugin()->onTimer.connect(
+            sigc::mem_fun(*this, &LiveCoverage::onTimer));
+
+    s2e()->getMessagesStream() << "LiveCoverage: tracking " << m_blockCount
+            << " basic blocks in " << m_modules.size() << " modules\n";
+}
+
+LiveCoverage::~LiveCoverage()
+{
+    if (!m_segment) {
+        return;
+    }
+
+    //When several processes exit at once, one snapshot is enough
+    if (claimSnapshot(0)) {
+        writeSnapshot();
+    }
+    munmap(m_segment, m_segmentSize);
+}
+
+bool LiveCoverage::loadBasicBlocks(const std::string &path, Module &module)
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    if (!fp) {
+        return false;
+    }
+
+    char buffer[512];
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        uint64_t start, end;
+        if (sscanf(buffer, "0x%" PRIx64 " 0x%" PRIx64, &start, &end) != 2 || end < start) {
+            continue;
+        }
+
+        BasicBlock bb;
+        bb.start = start;
+        bb.end = end;
+        module.blocks.push_back(bb);
+    }
+    fclose(fp);
+
+    std::sort(module.blocks.begin(), module.blocks.end(), BasicBlockOrder());
+
+    //Same policy as the coverage tool: overlapping blocks are dropped
+    std::vector<BasicBlock> blocks;
+    foreach2(it, module.blocks.begin(), module.blocks.end()) {
+        if (!blocks.empty() && (*it).start <= blocks.back().end) {
+            continue;
+        }
+        blocks.push_back(*it);
+    }
+    module.blocks.swap(blocks);
+
+    return !module.blocks.empty();
+}
+
+bool LiveCoverage::allocateSegment(const std::string &shmName)
+{
+    m_segmentSize = sizeof(LiveCoverageHeader) + m_modules.size() * sizeof(LiveCoverageModule);
+    foreach2(it, m_modules.begin(), m_modules.end()) {
+        m_segmentSize += ((*it).second.blocks.size() + 63) / 64 * sizeof(uint64_t);
+    }
+
+    //Plugins are initialized before S2E forks its worker processes,
+    //which all inherit the shared mapping.
+    void *segment;
+    if (shmName.empty()) {
+        segment = mmap(NULL, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+    } else {
+        //Stale data from a previous run must not leak into this one
+        shm_unlink(shmName.c_str());
+        int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0 || ftruncate(fd, m_segmentSize) < 0) {
+            s2e()->getWarningsStream() << "LiveCoverage: could not create shared memory object "
+                    << shmName << ": " << strerror(errno) << '\n';
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        segment = mmap(NULL, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+
+    if (segment == MAP_FAILED) {
+        s2e()->getWarningsStream() << "LiveCoverage: could not map the coverage segment\n";
+        return false;
+    }
+
+    m_segment = (uint8_t*) segment;
+    memset(m_segment, 0, m_segmentSize);
+
+    m_header = (LiveCoverageHeader*) m_segment;
+    m_header->magic = LIVE_COVERAGE_MAGIC;
+    m_header->version = LIVE_COVERAGE_VERSION;
+    m_header->moduleCount = m_modules.size();
+    m_header->lastSnapshot = time(NULL);
+
+    LiveCoverageModule *shared = (LiveCoverageModule*) (m_header + 1);
+    uint64_t offset = sizeof(LiveCoverageHeader) + m_modules.size() * sizeof(LiveCoverageModule);
+    foreach2(it, m_modules.begin(), m_modules.end()) {
+        Module &module = (*it).second;
+        strncpy(shared->name, (*it).first.c_str(), sizeof(shared->name) - 1);
+        shared->blockCount = module.blocks.size();
+        shared->bitmapOffset = offset;
+
+        module.shared = shared;
+        module.bitmap = (uint64_t*) (m_segment + offset);
+
+        offset += (module.blocks.size() + 63) / 64 * sizeof(uint64_t);
+        ++shared;
+    }
+
+    return true;
+}
+
+/** Index of the first basic block ending at or after nativePc */
+unsigned LiveCoverage::findFirstBlock(const Module &module, uint64_t nativePc) const
+{
+    unsigned low = 0, high = module.blocks.size();
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        if (module.blocks[mid].end < nativePc) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+bool LiveCoverage::isCovered(const std::string &moduleName, uint64_t nativePc) const
+{
+    Modules::const_iterator it = m_modules.find(moduleName);
+    if (it == m_modules.end()) {
+        return false;
+    }
+
+    const Module &module = (*it).second;
+    unsigned index = findFirstBlock(module, nativePc);
+    if (index == module.blocks.size() || module.blocks[index].start > nativePc) {
+        return false;
+    }
+    return isBlockCovered(module, index);
+}
+
+uint64_t LiveCoverage::getCoveredBlockCount() const
+{
+    return m_header ? m_header->coveredBlocks : 0;
+}
+
+/** Returns true if this call covered the block, in any S2E process */
+bool LiveCoverage::coverBlock(Module &module, unsigned index)
+{
+    uint64_t mask = 1ULL << (index % 64);
+    if (module.bitmap[index / 64] & mask) {
+        return false;
+    }
+
+    uint64_t old = __sync_fetch_and_or(&module.bitmap[index / 64], mask);
+    if (old & mask) {
+        return false;
+    }
+
+    __sync_fetch_and_add(&module.shared->coveredBlocks, 1);
+    __sync_fetch_and_add(&m_header->coveredBlocks, 1);
+    return true;
+}
+
+void LiveCoverage::onModuleTranslateBlockEnd(
+        ExecutionSignal *signal,
+        S2EExecutionState* state,
+        const ModuleDescriptor &module,
+        TranslationBlock *tb,
+        uint64_t endPc,
+        bool staticTarget,
+        uint64_t targetPc)
+{
+    Modules::iterator it = m_modules.find(module.Name);
+    if (it == m_modules.end()) {
+        return;
+    }
+
+    Module &mod = (*it).second;
+    uint64_t start = module.ToNativeBase(tb->pc);
+    uint64_t end = module.ToNativeBase(endPc);
+
+    unsigned first = findFirstBlock(mod, start);
+    unsigned last = first;
+    bool covered = true;
+    for (; last < mod.blocks.size() && mod.blocks[last].start <= end; ++last) {
+        covered = covered && isBlockCovered(mod, last);
+    }
+
+    //Either fully covered or not in the basic block list at all
+    if (covered) {
+        return;
+    }
+
+    signal->connect(sigc::bind(sigc::mem_fun(*this, &LiveCoverage::onExecuteBlock),
+                               &mod, first, last));
+}
+
+void LiveCoverage::onExecuteBlock(S2EExecutionState *state, uint64_t pc,
+                                  Module *module, unsigned first, unsigned last)
+{
+    bool covered = true;
+    for (unsigned i = first; i < last; ++i) {
+        if (isBlockCovered(*module, i)) {
+            continue;
+        }
+
+        //The TB reached its last instruction, so it ran through every
+        //basic block it overlaps
+        if (coverBlock(*module, i)) {
+            const ModuleDescriptor *md = m_detector->getModule(state, pc);
+            if (md) {
+                onNewBlockCovered.emit(state, *md, module->blocks[i].start);
+            }
+        }
+        covered = false;
+    }
+
+    if (!covered) {
+        ++m_coveredInstrumentedTbs;
+    }
+}
+
+void LiveCoverage::onTimer()
+{
+    if (m_flushTbThreshold && m_coveredInstrumentedTbs >= m_flushTbThreshold) {
+        m_coveredInstrumentedTbs = 0;
+        tb_flush(env);
+    }
+
+    if (!m_snapshotInterval) {
+        return;
+    }
+
+    if (claimSnapshot(m_snapshotInterval)) {
+        writeSnapshot();
+    }
+}
+
+/* Elects one of the S2E processes sharing the segment to write the next
+   snapshot, at most one every interval seconds */
+bool LiveCoverage::claimSnapshot(unsigned interval)
+{
+    uint64_t last = m_header->lastSnapshot;
+    uint64_t now = time(NULL);
+    if (now < last + interval) {
+        return false;
+    }
+    return __sync_bool_compare_and_swap(&m_header->lastSnapshot, last, now);
+}
+
+void LiveCoverage::writeSnapshot()
+{
+    //Readers never see a partially written snapshot. The temporary file is
+    //per process, the snapshot file may be shared.
+    std::stringstream tmpPath;
+    tmpPath << m_snapshotFile << ".tmp." << getpid();
+    std::string tmpFile = tmpPath.str();
+    FILE *fp = fopen(tmpFile.c_str(), "wb");
+    if (!fp) {
+        s2e()->getWarningsStream() << "LiveCoverage: could not write " << tmpFile << '\n';
+        return;
+    }
+
+    bool ok = fwrite(m_segment, m_segmentSize, 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpFile.c_str(), m_snapshotFile.c_str()) < 0) {
+        s2e()->getWarningsStream() << "LiveCoverage: could not write " << m_snapshotFile << '\n';
+        unlink(tmpFile.c_str());
+        return;
+    }
+
+    s2e()->getDebugStream() << "LiveCoverage: " << m_header->coveredBlocks << "/"
+            << m_blockCount << " basic blocks covered\n";
+}
+
+} // namespace plugins
+} // namespace s2e
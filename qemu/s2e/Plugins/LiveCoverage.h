@@ -0,0 +1,168 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_LIVECOVERAGE_H
+#define S2E_PLUGINS_LIVECOVERAGE_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/Plugins/ModuleExecutionDetector.h>
+#include <s2e/S2EExecutionState.h>
+
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+#define LIVE_COVERAGE_MAGIC 0x564f434c /* "LCOV" */
+#define LIVE_COVERAGE_VERSION 1
+
+/**
+ * Layout of the shared coverage segment. Snapshots are byte-for-byte
+ * copies of it, so external tools read both the same way.
+ *
+ * The header is followed by moduleCount LiveCoverageModule entries, then
+ * by the bitmaps, one bit per basic block in the order of the module's
+ * basic block list sorted by address.
+ */
+struct LiveCoverageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t moduleCount;
+    uint32_t reserved;
+    uint64_t coveredBlocks;
+    uint64_t lastSnapshot;      /* time() of the last snapshot */
+};
+
+struct LiveCoverageModule {
+    char name[64];
+    uint32_t blockCount;
+    uint32_t reserved;
+    uint64_t coveredBlocks;
+    uint64_t bitmapOffset;      /* from the start of the segment */
+};
+
+/**
+ * Maintains basic block coverage of the configured modules while S2E
+ * runs, in memory shared by all S2E processes.
+ *
+ * Translation blocks whose basic blocks are all covered already are not
+ * instrumented, so covered code runs without any callback once its
+ * translation blocks are retranslated.
+ */
+class LiveCoverage : public Plugin
+{
+    S2E_PLUGIN
+public:
+    LiveCoverage(S2E* s2e): Plugin(s2e) {}
+    virtual ~LiveCoverage();
+
+    void initialize();
+
+    /** Emitted the first time any S2E process covers a basic block */
+    sigc::signal<void, S2EExecutionState*,
+                 const ModuleDescriptor &,
+                 uint64_t /* native start of the basic block */>
+            onNewBlockCovered;
+
+    /** Whether the basic block containing the native pc was covered */
+    bool isCovered(const std::string &module, uint64_t nativePc) const;
+
+    uint64_t getCoveredBlockCount() const;
+    uint64_t getBlockCount() const {
+        return m_blockCount;
+    }
+
+    void writeSnapshot();
+
+private:
+    struct BasicBlock {
+        uint64_t start;
+        uint64_t end; /* inclusive */
+    };
+
+    struct Module {
+        std::vector<BasicBlock> blocks;
+        LiveCoverageModule *shared;
+        uint64_t *bitmap;
+    };
+
+    typedef std::map<std::string, Module> Modules;
+
+    ModuleExecutionDetector *m_detector;
+    Modules m_modules;
+    uint64_t m_blockCount;
+
+    uint8_t *m_segment;
+    size_t m_segmentSize;
+    LiveCoverageHeader *m_header;
+
+    std::string m_snapshotFile;
+    unsigned m_snapshotInterval;
+
+    /* Translation blocks that are still instrumented although covered */
+    unsigned m_flushTbThreshold;
+    unsigned m_coveredInstrumentedTbs;
+
+    bool loadBasicBlocks(const std::string &path, Module &module);
+    bool allocateSegment(const std::string &shmName);
+    bool claimSnapshot(unsigned interval);
+
+    unsigned findFirstBlock(const Module &module, uint64_t nativePc) const;
+
+    bool isBlockCovered(const Module &module, unsigned index) const {
+        return (module.bitmap[index / 64] & (1ULL << (index % 64)));
+    }
+
+    bool coverBlock(Module &module, unsigned index);
+
+    void onModuleTranslateBlockEnd(
+            ExecutionSignal *signal,
+            S2EExecutionState* state,
+            const ModuleDescriptor &module,
+            TranslationBlock *tb,
+            uint64_t endPc,
+            bool staticTarget,
+            uint64_t targetPc);
+
+    void onExecuteBlock(S2EExecutionState *state, uint64_t pc,
+                        Module *module, unsigned first, unsigned last);
+
+    void onTimer();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+extern "C" {
+#include "config.h"
+#include "qemu-common.h"
+}
+
+#include "CoverageSearcher.h"
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+#include <s2e/S2EExecutor.h>
+
+#include <math.h>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(CoverageSearcher, "Prioritizes states that recently covered new basic blocks",
+                  "CoverageSearcher", "LiveCoverage");
+
+void CoverageSearcher::initialize()
+{
+    ConfigFile *cfg = s2e()->getConfig();
+
+    //Both penalties are on a log2 scale, against one unit of the coverage
+    //clock per new basic block
+    m_depthWeight = cfg->getDouble(getConfigKey() + ".depthWeight", 1.0);
+    m_costWeight = cfg->getDouble(getConfigKey() + ".costWeight", 1.0);
+    m_clock = 0;
+
+    LiveCoverage *coverage = static_cast<LiveCoverage*>(s2e()->getPlugin("LiveCoverage"));
+    coverage->onNewBlockCovered.connect(
+            sigc::mem_fun(*this, &CoverageSearcher::onNewBlockCovered));
+
+    s2e()->getExecutor()->setSearcher(this);
+}
+
+CoverageSearcher::Priority CoverageSearcher::computePriority(S2EExecutionState *state)
+{
+    DECLARE_PLUGINSTATE(CoverageSearcherState, state);
+
+    Priority priority;
+    priority.score = (double) plgState->m_lastDiscovery
+            - m_depthWeight * log2(1.0 + state->depth)
+            - m_costWeight * log2(1.0 + state->queryCost);
+    priority.id = state->getID();
+    return priority;
+}
+
+void CoverageSearcher::onNewBlockCovered(S2EExecutionState *state,
+                                         const ModuleDescriptor &module,
+                                         uint64_t blockStart)
+{
+    ++m_clock;
+
+    DECLARE_PLUGINSTATE(CoverageSearcherState, state);
+    plgState->m_lastDiscovery = m_clock;
+
+    if (m_states.contains(state)) {
+        m_states.update(state, computePriority(state));
+    }
+}
+
+klee::ExecutionState& CoverageSearcher::selectState()
+{
+    assert(!m_states.empty() && "There are no states to select!");
+    return *m_states.top();
+}
+
+void CoverageSearcher::update(klee::ExecutionState *current,
+                    const std::set<klee::ExecutionState*> &addedStates,
+                    const std::set<klee::ExecutionState*> &removedStates)
+{
+    foreach2(it, removedStates.begin(), removedStates.end()) {
+        m_states.erase(static_cast<S2EExecutionState*>(*it));
+    }
+
+    //The depth and the solver time of the current state may have changed
+    S2EExecutionState *es = static_cast<S2EExecutionState*>(current);
+    if (es && m_states.contains(es)) {
+        m_states.update(es, computePriority(es));
+    }
+
+    foreach2(it, addedStates.begin(), addedStates.end()) {
+        es = static_cast<S2EExecutionState*>(*it);
+        m_states.update(es, computePriority(es));
+    }
+}
+
+bool CoverageSearcher::empty()
+{
+    return m_states.empty();
+}
+
+
+CoverageSearcherState::CoverageSearcherState()
+{
+    m_lastDiscovery = 0;
+}
+
+CoverageSearcherState::~CoverageSearcherState()
+{
+}
+
+PluginState *CoverageSearcherState::clone() const
+{
+    return new CoverageSearcherState(*this);
+}
+
+PluginState *CoverageSearcherState::factory(Plugin *p, S2EExecutionState *s)
+{
+    return new CoverageSearcherState();
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,118 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_COVERAGESEARCHER_H
+#define S2E_PLUGINS_COVERAGESEARCHER_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/Plugins/LiveCoverage.h>
+#include <s2e/S2EExecutionState.h>
+
+#include <klee/Searcher.h>
+#include <klee/Internal/ADT/IndexedPriorityQueue.h>
+
+namespace s2e {
+namespace plugins {
+
+class CoverageSearcherState: public PluginState
+{
+private:
+    /* Value of the coverage clock when the state (or the state it was
+       forked from) last covered a new basic block */
+    uint64_t m_lastDiscovery;
+
+public:
+    CoverageSearcherState();
+    virtual ~CoverageSearcherState();
+    virtual PluginState *clone() const;
+    static PluginState *factory(Plugin *p, S2EExecutionState *s);
+
+    friend class CoverageSearcher;
+};
+
+/**
+ * Selects the state that most recently covered new basic blocks, as
+ * reported by LiveCoverage, penalized by its fork depth and by the time
+ * it spent in the solver.
+ *
+ * A score only depends on the state it belongs to, so the states are
+ * kept in an indexed heap and only the states that changed are updated.
+ */
+class CoverageSearcher : public Plugin, public klee::Searcher
+{
+    S2E_PLUGIN
+public:
+    CoverageSearcher(S2E* s2e): Plugin(s2e) {}
+    void initialize();
+
+    virtual klee::ExecutionState& selectState();
+    virtual void update(klee::ExecutionState *current,
+                        const std::set<klee::ExecutionState*> &addedStates,
+                        const std::set<klee::ExecutionState*> &removedStates);
+
+    virtual bool empty();
+
+private:
+    struct Priority {
+        double score;
+        int id;
+
+        /* Ties go to the oldest state */
+        bool operator<(const Priority &other) const {
+            if (score != other.score) {
+                return score < other.score;
+            }
+            return id > other.id;
+        }
+    };
+
+    typedef klee::IndexedPriorityQueue<S2EExecutionState*, Priority> StateQueue;
+
+    StateQueue m_states;
+
+    /* Number of new basic blocks covered so far */
+    uint64_t m_clock;
+
+    double m_depthWeight;
+    double m_costWeight;
+
+    Priority computePriority(S2EExecutionState *state);
+
+    void onNewBlockCovered(S2EExecutionState *state,
+                           const ModuleDescriptor &module,
+                           uint64_t blockStart);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
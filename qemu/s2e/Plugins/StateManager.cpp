@@ -45,6 +45,7 @@ extern "C" {
 #include <s2e/s2e_qemu.h>
 
 #include "StateManager.h"
+#include "LiveCoverage.h"
 #include <klee/Searcher.h>
 
 #ifdef CONFIG_WIN32
@@ -307,10 +308,20 @@ void StateManager::initialize()
 
     m_detector = static_cast<ModuleExecutionDetector*>(s2e()->getPlugin("ModuleExecutionDetector"));
 
-    m_detector->onModuleTranslateBlockStart.connect(
-            sigc::mem_fun(*this,
-                    &StateManager::onNewBlockCovered)
-            );
+    //LiveCoverage knows when a block actually runs for the first time,
+    //in any process. Translation is only an approximation of that.
+    LiveCoverage *coverage = static_cast<LiveCoverage*>(s2e()->getPlugin("LiveCoverage"));
+    if (coverage) {
+        coverage->onNewBlockCovered.connect(
+                sigc::mem_fun(*this,
+                        &StateManager::onNewBlockExecuted)
+                );
+    } else {
+        m_detector->onModuleTranslateBlockStart.connect(
+                sigc::mem_fun(*this,
+                        &StateManager::onNewBlockCovered)
+                );
+    }
 
     s2e()->getCorePlugin()->onProcessFork.connect(
             sigc::mem_fun(*this,
@@ -372,6 +383,14 @@ void StateManager::onNewBlockCovered(
     resetTimeout();
 }
 
+void StateManager::onNewBlockExecuted(
+        S2EExecutionState* state,
+        const ModuleDescriptor &module,
+        uint64_t blockStart)
+{
+    resetTimeout();
+}
+
 bool StateManager::killOnTimeOut()
 {
     if (!timeoutReached()) {
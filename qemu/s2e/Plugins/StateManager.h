@@ -127,6 +127,11 @@ private:
             TranslationBlock *tb,
             uint64_t pc);
 
+    void onNewBlockExecuted(
+            S2EExecutionState* state,
+            const ModuleDescriptor &module,
+            uint64_t blockStart);
+
     void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
     void onTimer();
 
@@ -0,0 +1,211 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+
+#ifndef _S2E_BLOCK_OVERLAY_H_
+
+#define _S2E_BLOCK_OVERLAY_H_
+
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+#include <string.h>
+#include <inttypes.h>
+
+namespace s2e {
+
+/**
+ * Copy-on-write store of the disk sectors written by a state.
+ *
+ * Sectors are grouped in fixed-size extents, and extents in nodes that
+ * cover a contiguous range of the disk. Copying an overlay only copies the
+ * node table: nodes and extents are shared with the original and are
+ * duplicated the first time either copy writes to them.
+ */
+class BlockDeviceOverlay
+{
+public:
+    static const unsigned SECTOR_SIZE = 512;
+    static const unsigned EXTENT_SECTORS = 128;
+    static const unsigned EXTENT_SIZE = EXTENT_SECTORS * SECTOR_SIZE;
+    static const unsigned NODE_EXTENTS = 256;
+
+private:
+    struct Extent {
+        uint8_t data[EXTENT_SIZE];
+        uint64_t present[EXTENT_SECTORS / 64];
+
+        Extent() {
+            memset(present, 0, sizeof(present));
+        }
+
+        inline bool isPresent(unsigned sector) const {
+            return present[sector / 64] & (1ULL << (sector % 64));
+        }
+
+        inline bool isFull() const {
+            for (unsigned i = 0; i < EXTENT_SECTORS / 64; ++i) {
+                if (present[i] != ~0ULL) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline void setPresent(unsigned first, unsigned count) {
+            for (unsigned i = first; i < first + count; ++i) {
+                present[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    };
+
+    typedef boost::shared_ptr<Extent> ExtentRef;
+
+    struct Node {
+        ExtentRef extents[NODE_EXTENTS];
+    };
+
+    typedef boost::shared_ptr<Node> NodeRef;
+    typedef std::map<uint64_t, NodeRef> NodeMap;
+
+    NodeMap m_nodes;
+
+    inline Node *getWritableNode(uint64_t index) {
+        NodeRef &node = m_nodes[index];
+        if (!node) {
+            node.reset(new Node());
+        } else if (!node.unique()) {
+            node.reset(new Node(*node));
+        }
+        return node.get();
+    }
+
+    inline Extent *getWritableExtent(Node *node, unsigned index) {
+        ExtentRef &extent = node->extents[index];
+        if (!extent) {
+            extent.reset(new Extent());
+        } else if (!extent.unique()) {
+            extent.reset(new Extent(*extent));
+        }
+        return extent.get();
+    }
+
+    inline const Extent *findExtent(uint64_t extentIndex) const {
+        NodeMap::const_iterator it = m_nodes.find(extentIndex / NODE_EXTENTS);
+        if (it == m_nodes.end()) {
+            return NULL;
+        }
+        return it->second->extents[extentIndex % NODE_EXTENTS].get();
+    }
+
+public:
+    /**
+     * Copy into buf the sectors of the range that are in the overlay,
+     * leaving the other sectors untouched.
+     * Returns the number of sectors copied.
+     */
+    unsigned read(uint64_t sector, uint8_t *buf, unsigned count) const
+    {
+        unsigned found = 0;
+
+        while (count > 0) {
+            unsigned offset = sector % EXTENT_SECTORS;
+            unsigned chunk = EXTENT_SECTORS - offset;
+            if (chunk > count) {
+                chunk = count;
+            }
+
+            const Extent *extent = findExtent(sector / EXTENT_SECTORS);
+            if (extent && extent->isFull()) {
+                memcpy(buf, &extent->data[offset * SECTOR_SIZE], chunk * SECTOR_SIZE);
+                found += chunk;
+            } else if (extent) {
+                /* Copy the runs of present sectors */
+                unsigned i = 0;
+                while (i < chunk) {
+                    if (!extent->isPresent(offset + i)) {
+                        ++i;
+                        continue;
+                    }
+                    unsigned run = 1;
+                    while (i + run < chunk && extent->isPresent(offset + i + run)) {
+                        ++run;
+                    }
+                    memcpy(buf + i * SECTOR_SIZE,
+                           &extent->data[(offset + i) * SECTOR_SIZE],
+                           run * SECTOR_SIZE);
+                    found += run;
+                    i += run;
+                }
+            }
+
+            sector += chunk;
+            buf += chunk * SECTOR_SIZE;
+            count -= chunk;
+        }
+
+        return found;
+    }
+
+    void write(uint64_t sector, const uint8_t *buf, unsigned count)
+    {
+        while (count > 0) {
+            uint64_t extentIndex = sector / EXTENT_SECTORS;
+            unsigned offset = sector % EXTENT_SECTORS;
+            unsigned chunk = EXTENT_SECTORS - offset;
+            if (chunk > count) {
+                chunk = count;
+            }
+
+            Node *node = getWritableNode(extentIndex / NODE_EXTENTS);
+            Extent *extent = getWritableExtent(node, extentIndex % NODE_EXTENTS);
+
+            memcpy(&extent->data[offset * SECTOR_SIZE], buf, chunk * SECTOR_SIZE);
+            extent->setPresent(offset, chunk);
+
+            sector += chunk;
+            buf += chunk * SECTOR_SIZE;
+            count -= chunk;
+        }
+    }
+
+    inline uint64_t getNodeCount() const {
+        return m_nodes.size();
+    }
+};
+
+}
+
+#endif
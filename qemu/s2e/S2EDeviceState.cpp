@@ -74,9 +74,9 @@ std::vector<void *> S2EDeviceState::s_devices;
 llvm::SmallVector<struct BlockDriverState*, 5> S2EDeviceState::s_blockDevices;
 
 QEMUFile *S2EDeviceState::s_memFile = NULL;
-uint8_t *S2EDeviceState::s_tempStateBuffer = NULL;
-unsigned S2EDeviceState::s_tempStateSize = 0;
-unsigned S2EDeviceState::s_finalStateSize = 0;
+S2EDeviceState::DeviceBlob S2EDeviceState::s_saveBuffer;
+unsigned S2EDeviceState::s_saveSize = 0;
+const S2EDeviceState::DeviceBlob *S2EDeviceState::s_loadBlob = NULL;
 
 bool S2EDeviceState::s_devicesInited=false;
 
@@ -84,12 +84,12 @@ extern "C" {
 
 static int s2e_qemu_get_buffer(uint8_t *buf, int64_t pos, int size)
 {
-    return g_s2e_state->getDeviceState()->getBuffer(buf, pos, size);
+    return S2EDeviceState::getBuffer(buf, pos, size);
 }
 
 static int s2e_qemu_put_buffer(const uint8_t *buf, int64_t pos, int size)
 {
-    return g_s2e_state->getDeviceState()->putBuffer(buf, pos, size);
+    return S2EDeviceState::putBuffer(buf, pos, size);
 }
 
 void s2e_init_device_state(S2EExecutionState *s)
@@ -100,32 +100,29 @@ void s2e_init_device_state(S2EExecutionState *s)
 }
 
 
+/* The device blobs are shared with the parent until either state saves */
 S2EDeviceState::S2EDeviceState(const S2EDeviceState &state):
-        m_deviceState(state.m_deviceState)
+        m_deviceBlobs(state.m_deviceBlobs),
+        m_blockOverlay(state.m_blockOverlay)
 {
-    assert( state.m_stateBuffer && s_finalStateSize > 0);
-    m_stateBuffer = (uint8_t*) malloc(s_finalStateSize);
-    memcpy(m_stateBuffer, state.m_stateBuffer, s_finalStateSize);
+    assert(!state.m_deviceBlobs.empty());
     s_memFile = state.s_memFile;
 }
 
-S2EDeviceState::S2EDeviceState(klee::ExecutionState *state):m_deviceState(state)
+S2EDeviceState::S2EDeviceState(klee::ExecutionState *state)
 {
-    m_stateBuffer = NULL;
     s_memFile = NULL;
 }
 
 S2EDeviceState::~S2EDeviceState()
 {
-    if (m_stateBuffer) {
-        free(m_stateBuffer);
-    }
+
 }
 
 void S2EDeviceState::initDeviceState()
 {
-    m_stateBuffer = NULL;
-    
+    m_deviceBlobs.clear();
+
     assert(!s_devicesInited);
 
     s_memFile = qemu_memfile_open(s2e_qemu_get_buffer, s2e_qemu_put_buffer);
@@ -180,55 +177,51 @@ void S2EDeviceState::initDeviceState()
     }
 }
 
+/**
+ * QEMU offers no way to tell whether a device changed, so each device is
+ * still serialized, but into a scratch buffer. A new blob is only allocated
+ * for the devices whose serialized state differs from the one already held
+ * by this state.
+ */
 void S2EDeviceState::saveDeviceState()
 {
-    qemu_make_readable(s_memFile);
-
-    //DPRINTF("Saving device state %p\n", this);
-    /* Iterate through all device descritors and call
-    * their snapshot function */
-    for (vector<void*>::iterator it = s_devices.begin(); it != s_devices.end(); it++) {
-        void *se = *it;
-        //DPRINTF("%s ", s2e_qemu_get_se_idstr(se));
+    m_deviceBlobs.resize(s_devices.size());
+
+    for (unsigned i = 0; i < s_devices.size(); ++i) {
+        void *se = s_devices[i];
+
+        s_saveSize = 0;
+        qemu_make_readable(s_memFile);
         s2e_qemu_save_state(s_memFile, se);
-    }
-    //DPRINTF("\n");
-    qemu_fflush(s_memFile);
-    initFirstSnapshot();
-}
+        qemu_fflush(s_memFile);
 
-void S2EDeviceState::initFirstSnapshot()
-{
-    if (s_finalStateSize) {
-        return;
-    }
+        const DeviceBlobRef &blob = m_deviceBlobs[i];
+        if (blob && blob->size() == s_saveSize &&
+                (s_saveSize == 0 || !memcmp(&(*blob)[0], &s_saveBuffer[0], s_saveSize))) {
+            continue;
+        }
 
-    assert(!m_stateBuffer && s_tempStateBuffer && s_tempStateSize);
-    m_stateBuffer = (uint8_t*) malloc(s_tempStateSize);
-    if (!m_stateBuffer) {
-        llvm::errs() << "S2EDeviceState: could not allocate memory\n";
-        exit(-1);
+        m_deviceBlobs[i] = DeviceBlobRef(new DeviceBlob(s_saveBuffer.begin(),
+                s_saveBuffer.begin() + s_saveSize));
     }
-
-    memcpy(m_stateBuffer, s_tempStateBuffer, s_tempStateSize);
-    s_finalStateSize = s_tempStateSize;
-    free(s_tempStateBuffer);
-    s_tempStateBuffer = NULL;
-    s_tempStateSize = 0;
 }
 
-void S2EDeviceState::restoreDeviceState()
+void S2EDeviceState::restoreDeviceState(const S2EDeviceState *current)
 {
-    assert(s_finalStateSize && m_stateBuffer);
-
-    qemu_make_readable(s_memFile);
-    //DPRINTF("Restoring device state %p\n", this);
-    for (vector<void*>::iterator it = s_devices.begin(); it != s_devices.end(); it++) {
-        void *se = *it;
-        //DPRINTF("%s ", s2e_qemu_get_se_idstr(se));  
-        s2e_qemu_load_state(s_memFile, se);
+    assert(m_deviceBlobs.size() == s_devices.size());
+
+    for (unsigned i = 0; i < s_devices.size(); ++i) {
+        //The device already holds the state we are about to load
+        if (current && current->m_deviceBlobs.size() == m_deviceBlobs.size() &&
+                current->m_deviceBlobs[i] == m_deviceBlobs[i]) {
+            continue;
+        }
+
+        s_loadBlob = m_deviceBlobs[i].get();
+        qemu_make_readable(s_memFile);
+        s2e_qemu_load_state(s_memFile, s_devices[i]);
     }
-    //DPRINTF("\n");
+    s_loadBlob = NULL;
 }
 
 
@@ -236,46 +229,32 @@ void S2EDeviceState::restoreDeviceState()
 /*****************************************************************************/
 /*****************************************************************************/
 
-void S2EDeviceState::allocateBuffer(unsigned int Sz)
-{
-    if (Sz < s_tempStateSize) {
-        return;
-    }
-
-    /* Need to expand the buffer */
-    s_tempStateSize = Sz;
-    s_tempStateBuffer = (uint8_t*) realloc(s_tempStateBuffer, s_tempStateSize);
-    if (!s_tempStateBuffer) {
-        cerr << "Cannot reallocate memory for device state snapshot" << endl;
-        exit(-1);
-    }
-}
-
 int S2EDeviceState::putBuffer(const uint8_t *buf, int64_t pos, int size)
 {
-    uint8_t *dest;
-
-    if (!m_stateBuffer) {
-        allocateBuffer(pos + size);
-        dest = &s_tempStateBuffer[pos];
-    } else {
-        dest = &m_stateBuffer[pos];
+    uint64_t end = pos + size;
+    if (end > s_saveBuffer.size()) {
+        s_saveBuffer.resize(end);
     }
 
-    memcpy(dest, buf, size);
+    memcpy(&s_saveBuffer[pos], buf, size);
+    if (end > s_saveSize) {
+        s_saveSize = end;
+    }
     return size;
 }
 
+/* Reads past the end of the blob return zeros, QEMU reads ahead */
 int S2EDeviceState::getBuffer(uint8_t *buf, int64_t pos, int size)
 {
-    assert(m_stateBuffer);
-    int toCopy = pos + size <= s_finalStateSize ? size : s_finalStateSize - pos;
-    memcpy(buf, &m_stateBuffer[pos], toCopy);
-    return size;
+    assert(s_loadBlob);
+    int64_t available = (int64_t) s_loadBlob->size() - pos;
+    int toCopy = available <= 0 ? 0 : (available < size ? available : size);
 
-
-    //memcpy(buf, &m_state[pos], toCopy);
-    //return toCopy;
+    if (toCopy > 0) {
+        memcpy(buf, &(*s_loadBlob)[pos], toCopy);
+    }
+    memset(buf + toCopy, 0, size - toCopy);
+    return size;
 }
 
 
@@ -296,60 +275,27 @@ unsigned S2EDeviceState::getBlockDeviceId(struct BlockDriverState* dev)
     return i;
 }
 
-uint64_t S2EDeviceState::getBlockDeviceStart(struct BlockDriverState* dev)
+uint64_t S2EDeviceState::getBlockDeviceStartSector(struct BlockDriverState* dev)
 {
     unsigned id = getBlockDeviceId(dev);
-    return id * BLOCK_DEV_AS;
+    return id * (BLOCK_DEV_AS / SECTOR_SIZE);
 }
 
 /* Return 0 upon success */
 int S2EDeviceState::writeSector(struct BlockDriverState *bs, int64_t sector, const uint8_t *buf, int nb_sectors)
 {
-    uint64_t bstart = getBlockDeviceStart(bs);
-
-    while (nb_sectors > 0) {
-        uintptr_t address = (uintptr_t) bstart + sector * SECTOR_SIZE;
-        ObjectPair op = m_deviceState.findObject(address);
-        if (op.first == NULL) {
-            MemoryObject *mo = new MemoryObject(address, SECTOR_SIZE, false, false, false, NULL);
-            ObjectState *os = new ObjectState(mo);
-            m_deviceState.bindObject(mo, os);
-            op.first = mo;
-            op.second = os;
-        }
-
-        ObjectState *os = m_deviceState.getWriteable(op.first, op.second);
-        memcpy(os->getConcreteStore(false), buf, SECTOR_SIZE);
-        buf += SECTOR_SIZE;
-        --nb_sectors;
-        ++sector;
-    }
-
+    assert(sector + nb_sectors <= (int64_t) (BLOCK_DEV_AS / SECTOR_SIZE));
+    m_blockOverlay.write(getBlockDeviceStartSector(bs) + sector, buf, nb_sectors);
     return 0;
 }
 
-/* Return the number of sectors that could be read from the local store */
+/**
+ * Copy the sectors of the range written by this state into buf.
+ * Return the number of sectors that could be read from the local store.
+ */
 int S2EDeviceState::readSector(struct BlockDriverState *bs, int64_t sector, uint8_t *buf, int nb_sectors)
 {
-    int readCount = 0;
-
-    uint64_t bstart = getBlockDeviceStart(bs);
-
-    while (nb_sectors > 0) {
-        uintptr_t address = (uintptr_t) bstart + sector * SECTOR_SIZE;
-        ObjectPair op = m_deviceState.findObject(address);
-        if (!op.first) {
-            return readCount;
-        }
-
-        memcpy(buf, op.second->getConcreteStore(false), SECTOR_SIZE);
-        buf += SECTOR_SIZE;
-        ++readCount;
-        --nb_sectors;
-        ++sector;
-    }
-
-    return readCount;
+    return m_blockOverlay.read(getBlockDeviceStartSector(bs) + sector, buf, nb_sectors);
 }
 
 /*****************************************************************************/
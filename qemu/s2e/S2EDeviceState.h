@@ -47,10 +47,15 @@ extern "C" {
 #include <stdint.h>
 #include <llvm/ADT/SmallVector.h>
 
-#include <klee/AddressSpace.h>
+#include <boost/shared_ptr.hpp>
 
+#include "S2EBlockOverlay.h"
 #include "s2e_block.h"
 
+namespace klee {
+class ExecutionState;
+}
+
 namespace s2e {
 
 class S2EExecutionState;
@@ -59,8 +64,8 @@ class S2EDeviceState {
 private:
     static const unsigned SECTOR_SIZE = 512;
 
-    /* Give 64GB of KLEE address space for each block device */
-    static const uint64_t BLOCK_DEV_AS = (1024 * 1024 * 1024) * 64;
+    /* Give 64GB of overlay address space for each block device */
+    static const uint64_t BLOCK_DEV_AS = (1024 * 1024 * 1024) * 64ULL;
 
     static std::vector<void *> s_devices;
     static std::set<std::string> s_customDevices;
@@ -68,45 +73,46 @@ private:
 
     static QEMUFile *s_memFile;
 
-    /* Scratch buffer for the first snapshot */
-    static uint8_t *s_tempStateBuffer;
+    /**
+     * Serialized state of a single device. Blobs are immutable once
+     * created, so forked states share them until one of the states
+     * saves a different device state.
+     */
+    typedef std::vector<uint8_t> DeviceBlob;
+    typedef boost::shared_ptr<const DeviceBlob> DeviceBlobRef;
 
-    /* Once determined, the size of the device state is constant */
-    static unsigned s_tempStateSize;
-    static unsigned s_finalStateSize;
+    /* One blob per registered device, in the order of s_devices */
+    std::vector<DeviceBlobRef> m_deviceBlobs;
 
-    uint8_t *m_stateBuffer;
+    /* Scratch buffer that receives the state of the device being saved */
+    static DeviceBlob s_saveBuffer;
+    static unsigned s_saveSize;
 
+    /* The blob of the device being restored */
+    static const DeviceBlob *s_loadBlob;
 
     static llvm::SmallVector<struct BlockDriverState*, 5> s_blockDevices;
-    klee::AddressSpace m_deviceState;
-
-    void allocateBuffer(unsigned int Sz);
+    BlockDeviceOverlay m_blockOverlay;
 
     static unsigned getBlockDeviceId(struct BlockDriverState* dev);
-    static uint64_t getBlockDeviceStart(struct BlockDriverState* dev);
-
-    void initFirstSnapshot();
+    static uint64_t getBlockDeviceStartSector(struct BlockDriverState* dev);
 
 public:
     S2EDeviceState(klee::ExecutionState *state);
     S2EDeviceState(const S2EDeviceState &state);
     ~S2EDeviceState();
 
-    void setExecutionState(klee::ExecutionState *state) {
-        m_deviceState.state = state;
-    }
-
     void initDeviceState();
 
     //From QEMU to KLEE
     void saveDeviceState();
-    
-    //From KLEE to QEMU
-    void restoreDeviceState();
 
-    int putBuffer(const uint8_t *buf, int64_t pos, int size);
-    int getBuffer(uint8_t *buf, int64_t pos, int size);
+    //From KLEE to QEMU. If the devices currently hold the state saved in
+    //current, only the devices whose state differs are reloaded.
+    void restoreDeviceState(const S2EDeviceState *current = NULL);
+
+    static int putBuffer(const uint8_t *buf, int64_t pos, int size);
+    static int getBuffer(uint8_t *buf, int64_t pos, int size);
 
     int writeSector(struct BlockDriverState *bs, int64_t sector, const uint8_t *buf, int nb_sectors);
     int readSector(struct BlockDriverState *bs, int64_t sector, uint8_t *buf, int nb_sectors);
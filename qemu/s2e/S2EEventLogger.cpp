@@ -53,6 +53,11 @@ namespace {
     llvm::cl::opt<int>
     CollectEventMaxStackDepth("collect-event-max-stack-depth",
             llvm::cl::init(32));
+
+    llvm::cl::opt<unsigned>
+    DebugInfoBatchSize("debug-info-batch-size",
+            llvm::cl::desc("Number of new pcs inserted at once in the debug_info table"),
+            llvm::cl::init(1024));
 }
 
 
@@ -67,9 +72,14 @@ static const char *callstacks_init_sql =
         "state_id INTEGER NOT NULL,"
         "sec_state_id INTEGER,"
         "pc INTEGER NOT NULL,"
-        "callstack BLOB,"
+        "stack_id INTEGER,"
         "callstack_decoded TEXT"
         ");"
+        "CREATE TABLE IF NOT EXISTS stack_frames ("
+        "id INTEGER PRIMARY KEY NOT NULL,"
+        "parent_id INTEGER,"
+        "pc INTEGER NOT NULL"
+        ");"
         "CREATE TABLE IF NOT EXISTS debug_info ("
         "pc INTEGER PRIMARY KEY NOT NULL,"
         "module_name TEXT,"
@@ -80,10 +90,16 @@ static const char *callstacks_init_sql =
 
 static const char *callstack_insert_sql =
         "INSERT INTO callstacks"
-        "(id, state_id, sec_state_id, pc, callstack)"
+        "(id, state_id, sec_state_id, pc, stack_id)"
         "VALUES"
         "(?1, ?2, ?3, ?4, ?5);";
 
+static const char *frame_insert_sql =
+        "INSERT INTO stack_frames"
+        "(parent_id, pc)"
+        "VALUES"
+        "(?1, ?2);";
+
 static const char *debug_insert_sql =
         "INSERT OR IGNORE INTO debug_info (pc) VALUES(?1);";
 
@@ -103,10 +119,15 @@ S2EEventLogger::S2EEventLogger(sqlite3 *db)
             &callstack_insert_stmt_, NULL);
     assert(result == SQLITE_OK);
 
+    result = sqlite3_prepare_v2(db_, frame_insert_sql, -1,
+            &frame_insert_stmt_, NULL);
+    assert(result == SQLITE_OK);
+
     result = sqlite3_prepare_v2(db_, debug_insert_sql, -1,
             &debug_insert_stmt_, NULL);
     assert(result == SQLITE_OK);
 
+    callstack_ = NULL;
     if (CollectEventStacks) {
         callstack_ = new uint64_t[CollectEventMaxStackDepth];
     }
@@ -114,7 +135,10 @@ S2EEventLogger::S2EEventLogger(sqlite3 *db)
 
 
 S2EEventLogger::~S2EEventLogger() {
+    flushDebugPcs();
+
     sqlite3_finalize(callstack_insert_stmt_);
+    sqlite3_finalize(frame_insert_stmt_);
     sqlite3_finalize(debug_insert_stmt_);
     delete [] callstack_;
 }
@@ -143,11 +167,14 @@ uint64_t S2EEventLogger::logStateEvent(klee::ExecutionState *state,
 
     sqlite3_bind_int64(callstack_insert_stmt_, 4, s2e_state->getPc());
 
-    int stack_size;
+    int stack_size = 0;
     if (CollectEventStacks) {
         extractCallStack(s2e_state, stack_size);
-        sqlite3_bind_blob(callstack_insert_stmt_, 5, callstack_,
-                stack_size * sizeof(callstack_[0]), NULL);
+    }
+
+    if (stack_size > 0) {
+        sqlite3_bind_int64(callstack_insert_stmt_, 5,
+                internCallStack(stack_size));
     } else {
         sqlite3_bind_null(callstack_insert_stmt_, 5);
     }
@@ -156,16 +183,94 @@ uint64_t S2EEventLogger::logStateEvent(klee::ExecutionState *state,
     assert(result == SQLITE_DONE);
     sqlite3_reset(callstack_insert_stmt_);
 
-    // TODO: Do this for the callstack, too, in the future...
-    sqlite3_bind_int64(debug_insert_stmt_, 1, s2e_state->getPc());
-    result = sqlite3_step(debug_insert_stmt_);
-    assert(result == SQLITE_DONE);
-    sqlite3_reset(debug_insert_stmt_);
+    addDebugPc(s2e_state->getPc());
 
     return event_id;
 }
 
 
+// Returns the frame of the innermost call. The frames are interned from the
+// outermost one, so that stacks with the same callers share their frames.
+uint64_t S2EEventLogger::internCallStack(int stack_size) {
+    uint64_t frame_id = 0;
+    for (int i = stack_size - 1; i >= 0; --i) {
+        frame_id = internFrame(frame_id, callstack_[i]);
+    }
+    return frame_id;
+}
+
+
+uint64_t S2EEventLogger::internFrame(uint64_t parent_id, uint64_t pc) {
+    StackFrameKey key;
+    key.parent_id = parent_id;
+    key.pc = pc;
+
+    StackFrames::iterator it = stack_frames_.find(key);
+    if (it != stack_frames_.end()) {
+        return it->second;
+    }
+
+    // Frames are written right away, as events refer to them. The database
+    // picks the id, since the S2E processes forked from us write their own
+    // frames to it too.
+    if (parent_id) {
+        sqlite3_bind_int64(frame_insert_stmt_, 1, parent_id);
+    } else {
+        sqlite3_bind_null(frame_insert_stmt_, 1);
+    }
+    sqlite3_bind_int64(frame_insert_stmt_, 2, pc);
+
+    int result = sqlite3_step(frame_insert_stmt_);
+    assert(result == SQLITE_DONE);
+    sqlite3_reset(frame_insert_stmt_);
+
+    uint64_t frame_id = sqlite3_last_insert_rowid(db_);
+    stack_frames_.insert(std::make_pair(key, frame_id));
+
+    addDebugPc(pc);
+
+    return frame_id;
+}
+
+
+void S2EEventLogger::addDebugPc(uint64_t pc) {
+    if (!debug_pcs_.insert(pc).second) {
+        return;
+    }
+
+    pending_debug_pcs_.push_back(pc);
+    if (pending_debug_pcs_.size() >= DebugInfoBatchSize) {
+        flushDebugPcs();
+    }
+}
+
+
+void S2EEventLogger::flushDebugPcs() {
+    if (pending_debug_pcs_.empty()) {
+        return;
+    }
+
+    // Batch the inserts in one transaction, unless one is already open
+    bool own_transaction = sqlite3_get_autocommit(db_);
+    if (own_transaction) {
+        sqlite3_exec(db_, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    }
+
+    for (unsigned i = 0; i < pending_debug_pcs_.size(); ++i) {
+        sqlite3_bind_int64(debug_insert_stmt_, 1, pending_debug_pcs_[i]);
+        int result = sqlite3_step(debug_insert_stmt_);
+        assert(result == SQLITE_DONE);
+        sqlite3_reset(debug_insert_stmt_);
+    }
+
+    if (own_transaction) {
+        sqlite3_exec(db_, "COMMIT TRANSACTION;", NULL, NULL, NULL);
+    }
+
+    pending_debug_pcs_.clear();
+}
+
+
 void S2EEventLogger::extractCallStack(S2EExecutionState *state,
         int &stack_size) {
 #ifdef TARGET_I386
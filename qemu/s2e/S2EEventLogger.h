@@ -38,6 +38,10 @@
 
 #include "klee/data/EventLogger.h"
 
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
+#include <vector>
+
 namespace s2e {
 
 class S2EExecutionState;
@@ -54,12 +58,46 @@ public:
             klee::ExecutionState *other, unsigned event, uint64_t count);
 
 private:
+    // A stack frame is interned as a node of a prefix tree, identified by
+    // its caller's node and its pc, so that events with the same stack
+    // share all its frames.
+    struct StackFrameKey {
+        uint64_t parent_id;
+        uint64_t pc;
+
+        bool operator==(const StackFrameKey &other) const {
+            return parent_id == other.parent_id && pc == other.pc;
+        }
+    };
+
+    struct StackFrameKeyHash {
+        size_t operator()(const StackFrameKey &key) const {
+            return std::tr1::hash<uint64_t>()(key.pc * 0x9e3779b97f4a7c15ULL ^
+                    key.parent_id);
+        }
+    };
+
+    typedef std::tr1::unordered_map<StackFrameKey, uint64_t,
+            StackFrameKeyHash> StackFrames;
+    typedef std::tr1::unordered_set<uint64_t> PcSet;
+
     sqlite3_stmt *callstack_insert_stmt_;
+    sqlite3_stmt *frame_insert_stmt_;
     sqlite3_stmt *debug_insert_stmt_;
 
     uint64_t *callstack_;
 
+    StackFrames stack_frames_;
+
+    PcSet debug_pcs_;
+    std::vector<uint64_t> pending_debug_pcs_;
+
     void extractCallStack(S2EExecutionState *state, int &stack_size);
+    uint64_t internCallStack(int stack_size);
+    uint64_t internFrame(uint64_t parent_id, uint64_t pc);
+
+    void addDebugPc(uint64_t pc);
+    void flushDebugPcs();
 };
 
 } /* namespace klee */
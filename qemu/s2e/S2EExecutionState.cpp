@@ -59,6 +59,7 @@ extern CPUArchState *env;
 #include <s2e/S2EDeviceState.h>
 #include <s2e/S2EExecutor.h>
 #include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
 #include <s2e/Utils.h>
 
 #include <klee/Context.h>
@@ -67,9 +68,12 @@ extern CPUArchState *env;
 #include <s2e/S2E.h>
 #include <s2e/Utils.h>
 #include <s2e/s2e_qemu.h>
+#include <s2e/S2EStatsTracker.h>
 
+#include <llvm/ADT/Hashing.h>
 #include <llvm/Support/CommandLine.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <list>
@@ -107,6 +111,7 @@ S2EExecutionState::S2EExecutionState(klee::KFunction *kf) :
         m_qemuIcount(0),
         m_lastS2ETb(NULL),
         m_lastMergeICount((uint64_t)-1),
+        m_mergeFingerprint(0),
         m_needFinalizeTBExec(false),
         m_forkAborted(false),
         m_nextSymbVarId(0),
@@ -307,7 +312,6 @@ ExecutionState* S2EExecutionState::clone()
     clearTlbOwnership();
     S2EExecutionState *ret = new S2EExecutionState(*this);
     ret->addressSpace.state = ret;
-    ret->m_deviceState.setExecutionState(ret);
 
     if(m_lastS2ETb)
         m_lastS2ETb->refCount += 1;
@@ -607,6 +611,7 @@ void S2EExecutionState::writeCpuState(unsigned offset, uint64_t value,
     if(width == 1)
         value &= 1;
     small_memcpy(address + offset, (void*) &value, Expr::getMinBytesForWidth(width));
+    m_mergeFingerprint = 0;
 }
 
 bool S2EExecutionState::isRamRegistered(uint64_t hostAddress)
@@ -1500,11 +1505,12 @@ ref<Expr> S2EExecutionState::createConcolicValue(
     MemoryObject *mo = new MemoryObject(0, bytes, false, false, false, NULL);
     mo->setName(sname);
 
-    symbolics.push_back(std::make_pair(mo, array));
+    addSymbolic(mo, array);
 
     if (bufferSize == bytes) {
         if (ConcolicMode) {
             concolics.add(array, buffer);
+            g_s2e->getCorePlugin()->onConcolicVariableCreation.emit(this, sname, array);
         } else {
             g_s2e->getWarningsStream(this)
                     << "Concolic mode disabled: ignoring concrete assignments for " << name << '\n';
@@ -1558,11 +1564,12 @@ std::vector<ref<Expr> > S2EExecutionState::createConcolicArray(
     MemoryObject *mo = new MemoryObject(0, size, false, false, false, NULL);
     mo->setName(sname);
 
-    symbolics.push_back(std::make_pair(mo, array));
+    addSymbolic(mo, array);
 
     if (concreteBuffer.size() == size) {
         if (ConcolicMode) {
             concolics.add(array, concreteBuffer);
+            g_s2e->getCorePlugin()->onConcolicVariableCreation.emit(this, sname, array);
         } else {
             g_s2e->getWarningsStream(this)
                     << "Concolic mode disabled: ignoring concrete assignments for " << name << '\n';
@@ -1666,6 +1673,94 @@ void S2EExecutionState::dumpCpuState(llvm::raw_ostream &os) const
 #endif
 }
 
+uint64_t S2EExecutionState::getMergeFingerprint() const
+{
+    if (m_mergeFingerprint) {
+        return m_mergeFingerprint;
+    }
+
+    llvm::hash_code h = llvm::hash_combine((KInstruction*) pc,
+                                           addressSpace.bindingsHash,
+                                           stack.size(), symbolics.size());
+
+    foreach2(it, stack.begin(), stack.end()) {
+        h = llvm::hash_combine(h, (KInstruction*) (*it).caller, (*it).kf);
+    }
+
+    foreach2(it, symbolics.begin(), symbolics.end()) {
+        h = llvm::hash_combine(h, (*it).first, (*it).second);
+    }
+
+    // Same ranges as compareArchitecturalConcreteState()
+    const uint8_t *cpu = (const uint8_t*) getCpuState();
+    h = llvm::hash_combine(h,
+            llvm::hash_combine_range(cpu + CPU_CONC_LIMIT,
+                                     cpu + CPU_OFFSET(s2e_common_start)),
+            llvm::hash_combine_range(cpu + CPU_OFFSET(s2e_common_end),
+                                     cpu + sizeof(CPUArchState)));
+
+    uint64_t fingerprint = (size_t) h;
+    if (!fingerprint) {
+        fingerprint = 1;
+    }
+
+    // Active states keep changing
+    if (!m_active) {
+        m_mergeFingerprint = fingerprint;
+    }
+    return fingerprint;
+}
+
+/** Merges the bytes of b that differ from a into a, under condition inA.
+    Runs of differing bytes produce one select per naturally sized word,
+    and identical concrete words are skipped without building expressions.
+    Returns the number of selects. */
+static unsigned mergeObjectStates(ObjectState *a, const ObjectState *b,
+                                  ref<Expr> inA)
+{
+    const uint8_t *aStore = a->getConcreteStore(true);
+    const uint8_t *bStore = b->getConcreteStore(true);
+    unsigned size = a->size;
+    unsigned selects = 0;
+
+    std::vector<bool> differs(size);
+    for (unsigned i = 0; i < size; ) {
+        unsigned n = std::min(size - i, 8u);
+        if (a->isConcrete(i, n * 8) && b->isConcrete(i, n * 8)) {
+            for (unsigned j = i; j < i + n; ++j) {
+                differs[j] = aStore[j] != bStore[j];
+            }
+        } else {
+            for (unsigned j = i; j < i + n; ++j) {
+                differs[j] = a->read8(j) != b->read8(j);
+            }
+        }
+        i += n;
+    }
+
+    for (unsigned i = 0; i < size; ) {
+        if (!differs[i]) {
+            ++i;
+            continue;
+        }
+
+        unsigned run = 1;
+        while (run < 8 && i + run < size && differs[i + run]) {
+            ++run;
+        }
+
+        // Only byte, half, word and double word values can be written
+        unsigned bytes = run >= 8 ? 8 : run >= 4 ? 4 : run >= 2 ? 2 : 1;
+        Expr::Width width = bytes * 8;
+        a->write(i, SelectExpr::create(inA, a->read(i, width),
+                                       b->read(i, width)));
+        ++selects;
+        i += bytes;
+    }
+
+    return selects;
+}
+
 bool S2EExecutionState::merge(const ExecutionState &_b)
 {
     assert(dynamic_cast<const S2EExecutionState*>(&_b));
@@ -1678,6 +1773,15 @@ bool S2EExecutionState::merge(const ExecutionState &_b)
     if(DebugLogStateMerge)
         s << "Attempting merge with state " << b.getID() << '\n';
 
+    // Cheap rejection of most candidates. In debug mode, go on with the
+    // detailed checks to log what differs.
+    if(getMergeFingerprint() != b.getMergeFingerprint()) {
+        ++stats::mergesRejected;
+        if(!DebugLogStateMerge)
+            return false;
+        s << "fingerprints differ\n";
+    }
+
     if(pc != b.pc) {
         if(DebugLogStateMerge) {
             s << "merge failed: different KLEE pc\n"
@@ -1721,6 +1825,7 @@ bool S2EExecutionState::merge(const ExecutionState &_b)
             if(itA->caller!=itB->caller || itA->kf!=itB->kf) {
                 if(DebugLogStateMerge)
                     s << "merge failed: different callstacks" << '\n';
+                return false;
             }
           ++itA;
           ++itB;
@@ -1901,22 +2006,7 @@ bool S2EExecutionState::merge(const ExecutionState &_b)
         }
 
         ObjectState *wos = addressSpace.getWriteable(mo, os);
-        for (unsigned i=0; i<mo->size; i++) {
-            ref<Expr> av = wos->read8(i);
-            ref<Expr> bv = otherOS->read8(i);
-            if(av != bv) {
-                ref<Expr> e = SelectExpr::create(inA, av, bv);
-
-                #if 0
-                if (DebugLogStateMerge) {
-                    s << "Byte " << i << ": " << e << "\n";
-                }
-                #endif
-
-                wos->write(i, e);
-                selectCountMem += 1;
-            }
-        }
+        selectCountMem += mergeObjectStates(wos, otherOS, inA);
     }
 
     if(DebugLogStateMerge)
@@ -178,6 +178,10 @@ protected:
 
     uint64_t m_lastMergeICount;
 
+    /** Hash of everything that must be equal for two states to merge,
+        cached while the state is inactive (0 when not computed) */
+    mutable uint64_t m_mergeFingerprint;
+
     bool m_needFinalizeTBExec;
 
     bool m_forkAborted;
@@ -440,6 +444,8 @@ public:
 
     int compareArchitecturalConcreteState(const S2EExecutionState &other);
 
+    uint64_t getMergeFingerprint() const;
+
     virtual void addConstraint(klee::ref<klee::Expr> e);
 
     /** Creates new unconstrained symbolic value */
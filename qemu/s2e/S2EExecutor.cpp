@@ -114,9 +114,11 @@ uint64_t helper_set_cc_op_eflags(void);
 #include <klee/TimerStatIncrementer.h>
 #include <klee/Solver.h>
 #include <klee/SolverFactory.h>
+#include <klee/Internal/System/Time.h>
 
 #include <llvm/Support/TimeValue.h>
 
+#include <algorithm>
 #include <vector>
 
 #include <sstream>
@@ -208,6 +210,11 @@ namespace {
     UseFastHelpers("use-fast-helpers",
                    cl::desc("Replaces LLVM bitcode with fast symbolic-aware equivalent native helpers"),  cl::init(false));
 
+    cl::opt<bool>
+    HybridTranslationBlocks("hybrid-translation-blocks",
+                   cl::desc("Run the instructions of a TB that precede its first access to a symbolic register natively,"
+                            " interpreting only the rest in KLEE"),  cl::init(false));
+
     cl::opt<unsigned>
     ClockSlowDown("clock-slow-down",
                    cl::desc("Slow down factor when interpreting LLVM code"),  cl::init(101));
@@ -215,6 +222,22 @@ namespace {
     cl::opt<unsigned>
     ClockSlowDownFastHelpers("clock-slow-down-fast-helpers",
                    cl::desc("Slow down factor when interpreting LLVM code and using fast helpers"),  cl::init(11));
+
+    cl::opt<unsigned>
+    StateSwitchMinSlice("state-switch-min-slice",
+                   cl::desc("Minimum time (ms) a state runs before the searcher may switch to another one"),  cl::init(100));
+
+    cl::opt<unsigned>
+    StateSwitchMaxSlice("state-switch-max-slice",
+                   cl::desc("Maximum time (ms) a state runs before the searcher may switch to another one"),  cl::init(5000));
+
+    cl::opt<double>
+    StateSwitchMaxOverhead("state-switch-max-overhead",
+                   cl::desc("Fraction of the time that state switches may take, the time slice grows with the switch cost"),  cl::init(0.1));
+
+    cl::opt<unsigned>
+    MetricsInterval("metrics-interval",
+                   cl::desc("Seconds between the samples written to metrics.ndjson, 0 disables them"),  cl::init(0));
 }
 
 //The logs may be flooded with messages when switching execution mode.
@@ -619,8 +642,14 @@ S2EExecutor::S2EExecutor(S2E* s2e, TCGLLVMContext *tcgLLVMContext,
                 tcgLLVMContext->getExecutionEngine()),
           m_s2e(s2e), m_tcgLLVMContext(tcgLLVMContext),
           m_executeAlwaysKlee(false), m_forkProcTerminateCurrentState(false),
-          m_inLoadBalancing(false)
+          m_inLoadBalancing(false), m_lastStateSwitchCost(0),
+          m_metrics(NULL), m_lastMetricsSample(0),
+          m_concreteModeStart(0)
 {
+    for (unsigned i = 0; i < StateSwitchCostBuckets; ++i) {
+        m_stateSwitchCost[i] = 0;
+    }
+
     delete externalDispatcher;
     externalDispatcher = new S2EExternalDispatcher(
             tcgLLVMContext->getExecutionEngine());
@@ -910,6 +939,16 @@ void S2EExecutor::initializeStatistics()
                     userSearcherRequiresMD2U());
         statsTracker->writeHeaders();
     }
+
+    //Forked processes write to their own output directory
+    delete m_metrics;
+    m_metrics = NULL;
+    if (MetricsInterval) {
+        m_metrics = new S2EMetricsStream(
+                m_s2e->openOutputFile("metrics.ndjson"),
+                m_s2e->getCurrentProcessIndex());
+        m_lastMetricsSample = util::getWallTime();
+    }
 }
 
 
@@ -921,6 +960,13 @@ S2EExecutor::~S2EExecutor()
 {
     if(statsTracker)
         statsTracker->done();
+
+    if (m_metrics) {
+        m_metrics->writeSample(*this);
+        delete m_metrics;
+    }
+
+    writeHelperProfile();
 }
 
 S2EExecutionState* S2EExecutor::createInitialState()
@@ -1017,6 +1063,7 @@ void S2EExecutor::initializeExecution(S2EExecutionState* state,
 
     initTimers();
     initializeStateSwitchTimer();
+    initializeHelpers();
 }
 
 void S2EExecutor::registerCpu(S2EExecutionState *initialState,
@@ -1187,6 +1234,7 @@ void S2EExecutor::switchToConcrete(S2EExecutionState *state)
     memcpy((void*) state->m_cpuRegistersState->address,
            wos->getConcreteStore(true), wos->size);
     static_cast<S2EExecutionState*>(state)->m_runningConcrete = true;
+    m_concreteModeStart = util::getWallTime();
 
     if (PrintModeSwitch) {
         m_s2e->getMessagesStream(state)
@@ -1210,6 +1258,11 @@ void S2EExecutor::switchToSymbolic(S2EExecutionState *state)
            (void*) state->m_cpuRegistersState->address, wos->size);
     state->m_runningConcrete = false;
 
+    if (m_concreteModeStart) {
+        stats::concreteModeTime += (uint64_t) ((util::getWallTime() - m_concreteModeStart) * 1000000);
+        m_concreteModeStart = 0;
+    }
+
     if (PrintModeSwitch) {
         m_s2e->getMessagesStream(state)
                 << "Switched to symbolic execution at pc = "
@@ -1305,13 +1358,14 @@ void S2EExecutor::stateSwitchTimerCallback(void *opaque)
         }
     }
 
-    qemu_mod_timer(c->m_stateSwitchTimer, qemu_get_clock_ms(host_clock) + 100);
+    qemu_mod_timer(c->m_stateSwitchTimer,
+                   qemu_get_clock_ms(host_clock) + c->getStateSwitchInterval());
 }
 
 void S2EExecutor::initializeStateSwitchTimer()
 {
     m_stateSwitchTimer = qemu_new_timer_ms(host_clock, &stateSwitchTimerCallback, this);
-    qemu_mod_timer(m_stateSwitchTimer, qemu_get_clock_ms(host_clock) + 100);
+    qemu_mod_timer(m_stateSwitchTimer, qemu_get_clock_ms(host_clock) + StateSwitchMinSlice);
 }
 
 void S2EExecutor::resetStateSwitchTimer()
@@ -1319,6 +1373,65 @@ void S2EExecutor::resetStateSwitchTimer()
     qemu_mod_timer(m_stateSwitchTimer, qemu_get_clock_ms(host_clock));
 }
 
+/** Picks a time slice long enough for the last switch to take at most
+    StateSwitchMaxOverhead of the time. States far apart in the process
+    tree share fewer device and memory snapshots, so switching to them
+    costs more and they run longer before the next switch. */
+int64_t S2EExecutor::getStateSwitchInterval() const
+{
+    double overhead = std::min(std::max((double) StateSwitchMaxOverhead, 0.001), 1.0);
+    double slice = m_lastStateSwitchCost * 1000 * (1 - overhead) / overhead;
+
+    slice = std::max(slice, (double) StateSwitchMinSlice);
+    slice = std::min(slice, (double) std::max<unsigned>(StateSwitchMaxSlice, StateSwitchMinSlice));
+    return (int64_t) slice;
+}
+
+/** Number of forks between the two states and their closest common
+    ancestor in the process tree */
+unsigned S2EExecutor::getStateDistance(S2EExecutionState *a,
+                                       S2EExecutionState *b) const
+{
+    std::set<PTreeNode*> ancestors;
+    for (PTreeNode *n = a->ptreeNode; n; n = n->parent) {
+        ancestors.insert(n);
+    }
+
+    unsigned distance = 0;
+    PTreeNode *n = b->ptreeNode;
+    for (; n && !ancestors.count(n); n = n->parent) {
+        ++distance;
+    }
+
+    for (PTreeNode *m = a->ptreeNode; m && m != n; m = m->parent) {
+        ++distance;
+    }
+
+    return distance;
+}
+
+void S2EExecutor::updateStateSwitchCost(S2EExecutionState *oldState,
+                                        S2EExecutionState *newState,
+                                        double time)
+{
+    unsigned distance = oldState ? getStateDistance(oldState, newState) : 0;
+    unsigned bucket = 0;
+    while ((distance >> bucket) && bucket < StateSwitchCostBuckets - 1) {
+        ++bucket;
+    }
+
+    double &cost = m_stateSwitchCost[bucket];
+    cost = cost ? 0.75 * cost + 0.25 * time : time;
+    m_lastStateSwitchCost = cost;
+
+    if (VerboseStateSwitching) {
+        m_s2e->getDebugStream()
+                << "State switch to " << newState->getID()
+                << " (distance " << distance << ") took "
+                << time * 1000 << " ms, average " << cost * 1000 << " ms\n";
+    }
+}
+
 void S2EExecutor::doStateSwitch(S2EExecutionState* oldState,
                                 S2EExecutionState* newState)
 {
@@ -1411,12 +1524,14 @@ void S2EExecutor::doStateSwitch(S2EExecutionState* oldState,
         }
 
         newState->m_active = true;
+        newState->m_mergeFingerprint = 0;
 
         //Devices may need to write to memory, which can be done
         //after the state is activated
         //XXX: assigning g_s2e_state here is ugly but is required for restoreDeviceState...
         g_s2e_state = newState;
-        newState->getDeviceState()->restoreDeviceState();
+        newState->getDeviceState()->restoreDeviceState(
+                oldState ? oldState->getDeviceState() : NULL);
 
         /**
          * Memory region layout may change in between state switches.
@@ -1521,10 +1636,30 @@ S2EExecutionState* S2EExecutor::selectNextState(S2EExecutionState *state)
     }
 
     if(newState != state) {
+        if (state) {
+            state->m_stats.updateStats(state);
+        }
+
         g_s2e->getCorePlugin()->onStateSwitch.emit(state, newState);
+        double start = util::getWallTime();
+
+        //The VM stop and the switch itself are not concrete execution
+        if (state && state->m_runningConcrete && m_concreteModeStart) {
+            stats::concreteModeTime += (uint64_t) ((start - m_concreteModeStart) * 1000000);
+        }
+        m_concreteModeStart = 0;
+
         vm_stop(RUN_STATE_SAVE_VM);
         doStateSwitch(state, newState);
         vm_start();
+
+        //A killed state already left the process tree
+        bool killed = state && state->isZombie();
+        updateStateSwitchCost(killed ? NULL : state, newState,
+                              util::getWallTime() - start);
+    } else {
+        //Staying on the same state is free
+        m_lastStateSwitchCost = 0;
     }
 
     //We can't free the state immediately if it is the current state.
@@ -1616,9 +1751,20 @@ inline bool S2EExecutor::executeInstructions(S2EExecutionState *state, unsigned
                       << ": " << *ki->inst << '\n';
             }
 
+            if (concreteRegionJIT) {
+                if (unsigned count = executeConcreteRegion(*state)) {
+                    state->m_stats.m_statInstructionCountSymbolic += count - 1;
+                    continue;
+                }
+            }
+
             stepInstruction(*state);
             executeInstruction(*state, ki);
 
+            if (!m_helperFrames.empty()) {
+                popHelperFrames(state);
+            }
+
             updateStates(state);
 
             //S2E doesn't know if the current state can be run
@@ -1639,6 +1785,7 @@ inline bool S2EExecutor::executeInstructions(S2EExecutionState *state, unsigned
         }
     } catch (CpuExitException &) {
         updateStates(state);
+        m_helperFrames.clear();
         //assert(addedStates.empty());
         return true;
     }
@@ -1791,75 +1938,47 @@ uintptr_t S2EExecutor::executeTranslationBlockConcrete(S2EExecutionState *state,
     return ret;
 }
 
-static inline void s2e_tb_reset_jump(TranslationBlock *tb, unsigned int n)
+/* Keeps native TB chaining consistent with the symbolic registers of the
+   running state. Links valid under the previous mask stay valid under any
+   subset of it, and the cpu loop adds the links it refused back lazily
+   when the mask shrinks. Only the TBs conflicting with registers that just
+   became symbolic lose their incoming links, and the TBs are not scanned
+   at all when no linked TB touches these registers. */
+static void s2e_tb_update_chain_smask(uint64_t smask)
 {
-    TranslationBlock *tb1, *tb_next, **ptb;
-    unsigned int n1;
+    uint64_t gained = smask & ~s2e_tb_chain_smask;
+    s2e_tb_chain_smask = smask;
 
-    tb1 = tb->jmp_next[n];
-    if (tb1 != NULL) {
-        /* find head of list */
-        for(;;) {
-            n1 = (intptr_t)tb1 & 3;
-            tb1 = (TranslationBlock *)((intptr_t)tb1 & ~3);
-            if (n1 == 2)
-                break;
-            tb1 = tb1->jmp_next[n1];
-        }
-        /* we are now sure now that tb jumps to tb1 */
-        tb_next = tb1;
-
-        /* remove tb from the jmp_first list */
-        ptb = &tb_next->jmp_first;
-        for(;;) {
-            tb1 = *ptb;
-            n1 = (intptr_t)tb1 & 3;
-            tb1 = (TranslationBlock *)((intptr_t)tb1 & ~3);
-            if (n1 == n && tb1 == tb)
-                break;
-            ptb = &tb1->jmp_next[n1];
-        }
-        *ptb = tb->jmp_next[n];
-        tb->jmp_next[n] = NULL;
-
-        /* suppress the jump to next tb in generated code */
-        tb_set_jmp_target(tb, n, (uintptr_t)(tb->tc_ptr + tb->tb_next_offset[n]));
-        tb->s2e_tb_next[n] = NULL;
+    if (!(gained & s2e_tb_linked_conflict)) {
+        return;
     }
-}
 
+    sigset_t oldset;
+    s2e_disable_signals(&oldset);
+    s2e_tb_unchain_smask(smask);
+    s2e_enable_signals(&oldset);
+}
 
-//XXX: inline causes compiler internal errors
-static void s2e_tb_reset_jump_smask(TranslationBlock* tb, unsigned int n,
-                                           uint64_t smask, int depth = 0)
+/* Number of leading instructions of tb that can run natively while the
+   registers in smask are symbolic */
+static unsigned s2e_tb_concrete_prefix(TranslationBlock *tb, uint64_t smask)
 {
-    TranslationBlock *tb1 = tb->s2e_tb_next[n];
-    sigset_t oldset;
-    if (depth == 0) {
-        s2e_disable_signals(&oldset);
-    }
+    const std::vector<uint64_t> &masks = tb->s2e_tb->instructionRegMasks;
+    uint64_t stop = smask | (1ULL << 63);
 
-    if(tb1) {
-        if(depth > 2 || (smask & tb1->reg_rmask) || (smask & tb1->reg_wmask)
-                             || (tb1->helper_accesses_mem & 4)) {
-            s2e_tb_reset_jump(tb, n);
-        } else if(tb1 != tb) {
-            s2e_tb_reset_jump_smask(tb1, 0, smask, depth + 1);
-            s2e_tb_reset_jump_smask(tb1, 1, smask, depth + 1);
-        }
+    unsigned i = 0;
+    while (i < masks.size() && !(masks[i] & stop)) {
+        ++i;
     }
 
-    if (depth == 0) {
-        s2e_enable_signals(&oldset);
-    }
+    /* The whole TB cannot be safe if it was sent to KLEE */
+    return i < masks.size() ? i : 0;
 }
 
 uintptr_t S2EExecutor::executeTranslationBlock(
         S2EExecutionState* state,
         TranslationBlock* tb)
 {
-    //Avoid incrementing stats every time, very expensive.
-    static unsigned doStatsIncrementCount= 0;
     assert(state->isActive());
 
     bool executeKlee = m_executeAlwaysKlee;
@@ -1892,26 +2011,22 @@ uintptr_t S2EExecutor::executeTranslationBlock(
                     /* TB reads symbolic variables */
                     executeKlee = true;
 
-                } else {
-                    s2e_tb_reset_jump_smask(tb, 0, smask);
-                    s2e_tb_reset_jump_smask(tb, 1, smask);
-
-                    /* XXX: check whether we really have to unlink the block */
-                    /*
-                    tb->jmp_first = (TranslationBlock *)((intptr_t)tb | 2);
-                    tb->jmp_next[0] = NULL;
-                    tb->jmp_next[1] = NULL;
-                    if(tb->tb_next_offset[0] != 0xffff)
-                        tb_set_jmp_target(tb, 0,
-                              (uintptr_t)(tb->tc_ptr + tb->tb_next_offset[0]));
-                    if(tb->tb_next_offset[1] != 0xffff)
-                        tb_set_jmp_target(tb, 1,
-                              (uintptr_t)(tb->tc_ptr + tb->tb_next_offset[1]));
-                    tb->s2e_tb_next[0] = NULL;
-                    tb->s2e_tb_next[1] = NULL;
-                    */
+                    /* Run the instructions before the first symbolic
+                       access natively, the cpu loop then comes back with
+                       a TB starting at that access */
+                    unsigned prefix = 0;
+                    if (HybridTranslationBlocks) {
+                        prefix = s2e_tb_concrete_prefix(tb, smask);
+                    }
+                    if (prefix) {
+                        tb = s2e_tb_get_prefix(env, tb, prefix);
+                        executeKlee = false;
+                        ++stats::hybridTranslationBlocks;
+                        stats::hybridInstructionsConcrete += prefix;
+                    }
                 }
             }
+            s2e_tb_update_chain_smask(smask);
 #else
             executeKlee |= !state->m_cpuRegistersObject->isAllConcrete();
 #endif
@@ -1921,7 +2036,6 @@ uintptr_t S2EExecutor::executeTranslationBlock(
 
     if(executeKlee) {
         if(state->m_runningConcrete) {
-            TimerStatIncrementer t(stats::concreteModeTime);
             switchToSymbolic(state);
         }
 
@@ -1938,10 +2052,6 @@ uintptr_t S2EExecutor::executeTranslationBlock(
         if(!state->m_runningConcrete)
             switchToConcrete(state);
 
-        if (!((++doStatsIncrementCount) & 0xFFF)) {
-            TimerStatIncrementer t(stats::concreteModeTime);
-        }
-
         int new_scaling = timers_state.clock_scale / 2;
         if (new_scaling == 0) {
             new_scaling = 1;
@@ -2030,6 +2140,8 @@ void S2EExecutor::deleteState(klee::ExecutionState *state)
 {
     assert(dynamic_cast<S2EExecutionState*>(state));
     processTree->remove(state->ptreeNode);
+    //The state itself lives until the next state switch
+    state->ptreeNode = NULL;
     m_deletedStates.push_back(static_cast<S2EExecutionState*>(state));
 }
 
@@ -2217,14 +2329,19 @@ bool S2EExecutor::merge(klee::ExecutionState &_base, klee::ExecutionState &_othe
     assert(!s1 || !s2);
 
     bool result;
-    if(base.merge(other)) {
+    {
+        TimerStatIncrementer t(stats::mergeTime);
+        result = base.merge(other);
+    }
+
+    if(result) {
+        ++stats::mergesSucceeded;
         m_s2e->getMessagesStream(&base)
                 << "Merged with state " << other.getID() << '\n';
-        result = true;
     } else {
+        ++stats::mergesFailed;
         m_s2e->getDebugStream(&base)
                 << "Merge with state " << other.getID() << " failed" << '\n';
-        result = false;
     }
 
     //Reactivate the state
@@ -2456,10 +2573,27 @@ void S2EExecutor::unrefS2ETb(S2ETranslationBlock* s2e_tb)
     }
 }
 
+/** Called by the CorePlugin timer. Per-state counters are plain
+    increments on the execution paths, they are only folded into the
+    global statistics here and on state switches. */
 void S2EExecutor::updateStats(S2EExecutionState *state)
 {
-    state->m_stats.updateStats(state);
+    double now = util::getWallTime();
+    if (state) {
+        state->m_stats.updateStats(state);
+
+        if (state->m_runningConcrete && m_concreteModeStart) {
+            stats::concreteModeTime += (uint64_t) ((now - m_concreteModeStart) * 1000000);
+            m_concreteModeStart = now;
+        }
+    }
+
     processTimers(state, 0);
+
+    if (m_metrics && now - m_lastMetricsSample >= MetricsInterval) {
+        m_metrics->writeSample(*this);
+        m_lastMetricsSample = now;
+    }
 }
 
 } // namespace s2e
@@ -2612,6 +2746,26 @@ void s2e_tb_alloc(S2E*, TranslationBlock *tb)
 
     tb->s2e_tb_next[0] = 0;
     tb->s2e_tb_next[1] = 0;
+
+    tb->s2e_prefix_tb = NULL;
+    tb->s2e_prefix_of = NULL;
+    tb->s2e_is_prefix = 0;
+}
+
+void s2e_set_tb_insn_masks(S2E*, TranslationBlock *tb)
+{
+    /* TBs are cut at a page, longer ones simply never get a prefix */
+    static uint64_t masks[512];
+
+    int count = tcg_calc_insn_regmask(&tcg_ctx, masks,
+                                      sizeof(masks) / sizeof(masks[0]));
+
+    std::vector<uint64_t> &insnMasks = tb->s2e_tb->instructionRegMasks;
+    if (count > 0) {
+        insnMasks.assign(masks, masks + count);
+    } else {
+        insnMasks.clear();
+    }
 }
 
 void s2e_set_tb_function(S2E*, TranslationBlock *tb)
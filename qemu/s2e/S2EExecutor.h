@@ -53,6 +53,7 @@ namespace s2e {
 
 class S2E;
 class S2EExecutionState;
+class S2EMetricsStream;
 struct S2ETranslationBlock;
 
 class CpuExitException
@@ -114,6 +115,51 @@ protected:
 
     struct QEMUTimer *m_stateSwitchTimer;
 
+    /** Moving averages of the state switch time in seconds, indexed by
+        the log2 of the distance of the two states in the process tree */
+    static const unsigned StateSwitchCostBuckets = 16;
+    double m_stateSwitchCost[StateSwitchCostBuckets];
+
+    /** Estimated cost of the last switch, sizes the next time slice */
+    double m_lastStateSwitchCost;
+
+    /** See --metrics-interval */
+    S2EMetricsStream *m_metrics;
+    double m_lastMetricsSample;
+
+    /** When the active state entered concrete mode, 0 while not timed */
+    double m_concreteModeStart;
+
+    /** A QEMU helper that has both LLVM bitcode and a native version */
+    struct HelperInfo {
+        std::string name;
+        uint64_t regReadMask;
+        uint64_t regWriteMask;
+        uint64_t accessesMem;
+
+        /* Profile, see --profile-helpers */
+        uint64_t interpretedCalls;
+        uint64_t interpretedInstructions;
+        double interpretedTime;
+        uint64_t nativeCalls;
+        double nativeTime;
+        uint64_t symbolicArgs;
+        uint64_t symbolicRegs;
+    };
+
+    typedef std::map<const llvm::Function*, HelperInfo> Helpers;
+    Helpers m_helpers;
+
+    /** Interpreted helper calls that have not returned yet */
+    struct HelperFrame {
+        HelperInfo *helper;
+        unsigned stackSize;
+        uint64_t instructions;
+        double time;
+    };
+
+    std::vector<HelperFrame> m_helperFrames;
+
 
 public:
     S2EExecutor(S2E* s2e, TCGLLVMContext *tcgLVMContext,
@@ -326,6 +372,11 @@ protected:
     void setupTimersHandler();
     void initializeStateSwitchTimer();
     static void stateSwitchTimerCallback(void *opaque);
+    int64_t getStateSwitchInterval() const;
+
+    unsigned getStateDistance(S2EExecutionState *a, S2EExecutionState *b) const;
+    void updateStateSwitchCost(S2EExecutionState *oldState,
+                               S2EExecutionState *newState, double time);
 
     /** The following are special handlers for MMU functions */
     static void handle_ldb_mmu(klee::Executor* executor,
@@ -413,6 +464,18 @@ protected:
     void replaceExternalFunctionsWithSpecialHandlers();
     void disableConcreteLLVMHelpers();
 
+    /** Native helper fast paths (see NativeHelpers.cpp) */
+    void initializeHelpers();
+    void executeCall(klee::ExecutionState &state,
+                     klee::KInstruction *ki,
+                     llvm::Function *f,
+                     std::vector< klee::ref<klee::Expr> > &arguments);
+    bool callNativeHelper(S2EExecutionState *state, klee::KInstruction *ki,
+                          llvm::Function *f, HelperInfo &helper,
+                          std::vector< klee::ref<klee::Expr> > &arguments);
+    void popHelperFrames(S2EExecutionState *state);
+    void writeHelperProfile();
+
     struct HandlerInfo {
       const char *name;
       S2EExecutor::FunctionHandler handler;
@@ -437,6 +500,10 @@ struct S2ETranslationBlock
         when this translation block will be flushed.
         XXX: how could we avoid using void* here ? */
     std::vector<void*> executionSignals;
+
+    /** Registers accessed by each guest instruction, see
+        tcg_calc_insn_regmask(). Empty if unknown. */
+    std::vector<uint64_t> instructionRegMasks;
 };
 
 } // namespace s2e
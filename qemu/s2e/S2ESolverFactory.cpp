@@ -42,6 +42,7 @@
 #include "klee/SolverImpl.h"
 
 #include <boost/scoped_ptr.hpp>
+#include <llvm/Support/CommandLine.h>
 #include <llvm/Support/TimeValue.h>
 
 
@@ -49,6 +50,13 @@ using namespace klee;
 using boost::scoped_ptr;
 using llvm::sys::TimeValue;
 
+namespace {
+    llvm::cl::opt<bool>
+    UseSolverWorker("use-solver-worker",
+            llvm::cl::desc("Run the end solver in a persistent worker process"),
+            llvm::cl::init(false));
+}
+
 
 namespace s2e {
 
@@ -136,6 +144,14 @@ S2ESolverFactory::~S2ESolverFactory() {
 }
 
 
+Solver *S2ESolverFactory::createEndSolver() {
+    if (UseSolverWorker) {
+        return createSolverWorker(this);
+    }
+    return DefaultSolverFactory::createEndSolver();
+}
+
+
 Solver *S2ESolverFactory::decorateSolver(Solver *end_solver) {
     Solver *solver = DefaultSolverFactory::decorateSolver(end_solver);
     solver = createDataCollectorSolver(solver, s2e_);
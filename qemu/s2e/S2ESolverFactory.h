@@ -50,6 +50,7 @@ public:
     S2ESolverFactory(S2E *s2e, klee::InterpreterHandler *ih);
     virtual ~S2ESolverFactory();
 
+    virtual klee::Solver *createEndSolver();
     virtual klee::Solver *decorateSolver(klee::Solver *end_solver);
 private:
     S2E *s2e_;
@@ -38,12 +38,17 @@
 #include <klee/Solver.h>
 #include <sqlite3.h>
 
+namespace klee {
+class DefaultSolverFactory;
+}
+
 namespace s2e {
 
 class S2E;
 
 klee::Solver *createDataCollectorSolver(klee::Solver *s, S2E *s2e);
 klee::Solver *createNotificationSolver(klee::Solver *s, S2E *s2e);
+klee::Solver *createSolverWorker(klee::DefaultSolverFactory *factory);
 }
 
 
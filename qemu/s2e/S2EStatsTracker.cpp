@@ -33,6 +33,12 @@
  * All contributors are listed in the S2E-AUTHORS file.
  */
 
+extern "C" {
+#include <qemu-common.h>
+#include <cpu-all.h>
+#include <exec-all.h>
+}
+
 #include "S2EStatsTracker.h"
 
 #include <s2e/S2EExecutor.h>
@@ -41,6 +47,7 @@
 #include <klee/CoreStats.h>
 #include <klee/SolverStats.h>
 #include <klee/Internal/System/Time.h>
+#include <klee/Internal/Support/SlabAllocator.h>
 
 #include <llvm/Support/Process.h>
 
@@ -74,6 +81,14 @@ namespace stats {
 
     Statistic concreteModeTime("ConcreteModeTime", "ConcModeTime");
     Statistic symbolicModeTime("SymbolicModeTime", "SymbModeTime");
+
+    Statistic hybridTranslationBlocks("HybridTranslationBlocks", "HybridTBs");
+    Statistic hybridInstructionsConcrete("HybridInstructionsConcrete", "HybridIConcrete");
+
+    Statistic mergesSucceeded("MergesSucceeded", "MergeOk");
+    Statistic mergesFailed("MergesFailed", "MergeFail");
+    Statistic mergesRejected("MergesRejected", "MergeRej");
+    Statistic mergeTime("MergeTime", "MergeTime");
 } // namespace stats
 } // namespace klee
 
@@ -165,11 +180,26 @@ void S2EStatsTracker::writeStatsHeader() {
              << "'ForkTime',"
              << "'ResolveTime',"
              << "'MemoryUsage',"
+             << "'SlabAllocations',"
+             << "'SlabLiveBytes',"
+             << "'SlabBytes',"
+             << "'TbChainLoopEntries',"
+             << "'TbChainLinked',"
+             << "'TbChainRefused',"
+             << "'TbChainUnlinked',"
+             << "'TbChainScans',"
+             << "'HybridTranslationBlocks',"
+             << "'HybridInstructionsConcrete',"
+             << "'MergesSucceeded',"
+             << "'MergesFailed',"
+             << "'MergesRejected',"
+             << "'MergeTime',"
              << ")\n";
   statsFile->flush();
 }
 
 void S2EStatsTracker::writeStatsLine() {
+  const SlabAllocator::Stats &slabStats = SlabAllocator::get().getStats();
   *statsFile //<< "(" << stats::instructions
              //<< "," << fullBranches
              //<< "," << partialBranches
@@ -177,7 +207,7 @@ void S2EStatsTracker::writeStatsLine() {
              << "(" << executor.getStatesCount()
              << "," << stats::queries
              << "," << stats::queryConstructs
-             << "," << 0 // was numObjects
+             << "," << stats::allocations - stats::deallocations
              //<< "," << stats::coveredInstructions
              //<< "," << stats::uncoveredInstructions
              << "," << stats::translationBlocks
@@ -196,10 +226,77 @@ void S2EStatsTracker::writeStatsLine() {
              << "," << stats::forkTime / 1000000.
              << "," << stats::resolveTime / 1000000.
              << "," << getProcessMemoryUsage() //sys::Process::GetTotalMemoryUsage()
+             << "," << slabStats.allocations
+             << "," << slabStats.liveBytes + slabStats.largeBytes
+             << "," << slabStats.slabBytes + slabStats.largeBytes
+             << "," << s2e_tb_chain_stats.entries
+             << "," << s2e_tb_chain_stats.linked
+             << "," << s2e_tb_chain_stats.refused
+             << "," << s2e_tb_chain_stats.unlinked
+             << "," << s2e_tb_chain_stats.scans
+             << "," << stats::hybridTranslationBlocks
+             << "," << stats::hybridInstructionsConcrete
+             << "," << stats::mergesSucceeded
+             << "," << stats::mergesFailed
+             << "," << stats::mergesRejected
+             << "," << stats::mergeTime / 1000000.
              << ")\n";
   statsFile->flush();
 }
 
+S2EMetricsStream::S2EMetricsStream(llvm::raw_ostream *out,
+                                   unsigned processIndex):
+    m_out(out), m_processIndex(processIndex),
+    m_lastTbsConcrete(stats::translationBlocksConcrete),
+    m_lastTbsSymbolic(stats::translationBlocksKlee),
+    m_lastInstructions(stats::cpuInstructions)
+{
+    m_startTime = m_lastTime = util::getWallTime();
+}
+
+S2EMetricsStream::~S2EMetricsStream()
+{
+    delete m_out;
+}
+
+void S2EMetricsStream::writeSample(const klee::Executor &executor)
+{
+    double now = util::getWallTime();
+    double period = now - m_lastTime;
+    if (period <= 0) {
+        return;
+    }
+
+    uint64_t tbsConcrete = stats::translationBlocksConcrete;
+    uint64_t tbsSymbolic = stats::translationBlocksKlee;
+    uint64_t instructions = stats::cpuInstructions;
+    const SlabAllocator::Stats &slabStats = SlabAllocator::get().getStats();
+
+    *m_out << "{\"time\":" << now - m_startTime
+           << ",\"process\":" << m_processIndex
+           << ",\"states\":" << executor.getStatesCount()
+           << ",\"tbs_concrete\":" << tbsConcrete
+           << ",\"tbs_symbolic\":" << tbsSymbolic
+           << ",\"tb_rate_concrete\":" << (tbsConcrete - m_lastTbsConcrete) / period
+           << ",\"tb_rate_symbolic\":" << (tbsSymbolic - m_lastTbsSymbolic) / period
+           << ",\"instructions\":" << instructions
+           << ",\"instruction_rate\":" << (instructions - m_lastInstructions) / period
+           << ",\"concrete_time\":" << stats::concreteModeTime / 1000000.
+           << ",\"symbolic_time\":" << stats::symbolicModeTime / 1000000.
+           << ",\"solver_time\":" << stats::solverTime / 1000000.
+           << ",\"queries\":" << stats::queries
+           << ",\"forks\":" << stats::forks
+           << ",\"memory\":" << S2EStatsTracker::getProcessMemoryUsage()
+           << ",\"slab_live_bytes\":" << slabStats.liveBytes + slabStats.largeBytes
+           << "}\n";
+    m_out->flush();
+
+    m_lastTime = now;
+    m_lastTbsConcrete = tbsConcrete;
+    m_lastTbsSymbolic = tbsSymbolic;
+    m_lastInstructions = instructions;
+}
+
 S2EStateStats::S2EStateStats():
     m_statTranslationBlockConcrete(0),
     m_statTranslationBlockSymbolic(0),
@@ -39,6 +39,8 @@
 #include <klee/Statistic.h>
 #include <klee/StatsTracker.h>
 
+#include <llvm/Support/raw_ostream.h>
+
 namespace klee {
 namespace stats {
     extern klee::Statistic translationBlocks;
@@ -51,6 +53,14 @@ namespace stats {
 
     extern klee::Statistic concreteModeTime;
     extern klee::Statistic symbolicModeTime;
+
+    extern klee::Statistic hybridTranslationBlocks;
+    extern klee::Statistic hybridInstructionsConcrete;
+
+    extern klee::Statistic mergesSucceeded;
+    extern klee::Statistic mergesFailed;
+    extern klee::Statistic mergesRejected;
+    extern klee::Statistic mergeTime;
 } // namespace stats
 } // namespace klee
 
@@ -69,6 +79,28 @@ protected:
     void writeStatsLine();
 };
 
+/** Writes samples of the main counters, one JSON object per line, for
+    monitoring long runs. Rates are computed over the time since the
+    previous sample. */
+class S2EMetricsStream
+{
+public:
+    S2EMetricsStream(llvm::raw_ostream *out, unsigned processIndex);
+    ~S2EMetricsStream();
+
+    void writeSample(const klee::Executor &executor);
+
+private:
+    llvm::raw_ostream *m_out;
+    unsigned m_processIndex;
+
+    double m_startTime;
+    double m_lastTime;
+    uint64_t m_lastTbsConcrete;
+    uint64_t m_lastTbsSymbolic;
+    uint64_t m_lastInstructions;
+};
+
 class S2EExecutionState;
 
 class S2EStateStats {
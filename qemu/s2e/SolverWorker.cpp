@@ -0,0 +1,527 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Stefan Bucur <stefan.bucur@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "s2e/S2E.h"
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverFactory.h"
+#include "klee/SolverStats.h"
+#include "klee/ExprBuilder.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/data/ExprSerializer.h"
+#include "klee/data/ExprDeserializer.h"
+#include "klee/data/QuerySerializer.h"
+#include "klee/data/QueryDeserializer.h"
+
+#include "S2ESolvers.h"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/TimeValue.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using boost::scoped_ptr;
+using llvm::sys::TimeValue;
+
+namespace {
+    llvm::cl::opt<unsigned>
+    SolverWorkerTimeout("solver-worker-timeout",
+            llvm::cl::desc("Seconds after which a query sent to the solver worker is abandoned (0 to follow the core solver timeout)"),
+            llvm::cl::init(0));
+
+    llvm::cl::opt<unsigned>
+    SolverWorkerRestart("solver-worker-restart",
+            llvm::cl::desc("Number of queries after which the solver worker is restarted, to release its memory"),
+            llvm::cl::init(10000));
+
+    llvm::cl::opt<unsigned>
+    SolverWorkerBuffer("solver-worker-buffer",
+            llvm::cl::desc("Initial size (MB) of the buffer shared with the solver worker"),
+            llvm::cl::init(16));
+}
+
+
+namespace s2e {
+
+
+using namespace klee;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Layout of the memory shared with the worker. The request carries a
+ * serialized query, the response the values of the requested arrays.
+ */
+struct SolverWorkerChannel {
+    uint64_t request_size;
+    uint64_t values_size;
+    double timeout;
+    uint32_t deserialized;
+    uint32_t success;
+    uint32_t has_solution;
+
+    uint8_t *data() {
+        return reinterpret_cast<uint8_t*>(this + 1);
+    }
+};
+
+
+/*
+ * Solves queries in a long-lived worker process, forked from the S2E process
+ * once and restarted only when it crashes, times out, or after a number of
+ * queries. Queries go through the QuerySerializer, which only sends the
+ * expressions and constraints the worker has not seen yet.
+ *
+ * Each S2E process talks to its own worker. A process forked by S2E drops
+ * the worker inherited from its parent and starts a new one.
+ */
+class SolverWorker : public SolverImpl {
+public:
+    SolverWorker(DefaultSolverFactory *factory);
+    ~SolverWorker();
+
+    bool computeTruth(const Query &query, bool &isValid);
+    bool computeValue(const Query &query, ref<Expr> &result);
+    bool computeInitialValues(const Query &query,
+            const std::vector<const Array*> &objects,
+            std::vector<std::vector<unsigned char> > &values,
+            bool &hasSolution);
+    void setCoreSolverTimeout(double timeout) {
+        core_timeout_ = timeout;
+    }
+
+private:
+    bool startWorker();
+    void stopWorker();
+    void releaseWorker();
+
+    bool sendQuery(const Query &query,
+            const std::vector<const Array*> &objects);
+    bool waitResponse();
+
+    void runWorker(int fd);
+
+    SolverWorkerChannel *channel() {
+        return reinterpret_cast<SolverWorkerChannel*>(buffer_);
+    }
+
+    DefaultSolverFactory *factory_;
+
+    pid_t owner_pid_;
+    pid_t worker_pid_;
+    int fd_;
+    uint8_t *buffer_;
+    uint64_t buffer_size_;
+    unsigned query_count_;
+    double core_timeout_;
+
+    // Mirror the state of the deserializers in the worker
+    scoped_ptr<ExprSerializer> expr_serializer_;
+    scoped_ptr<QuerySerializer> query_serializer_;
+};
+
+
+SolverWorker::SolverWorker(DefaultSolverFactory *factory)
+    : factory_(factory),
+      owner_pid_(0),
+      worker_pid_(0),
+      fd_(-1),
+      buffer_(NULL),
+      buffer_size_((uint64_t) SolverWorkerBuffer << 20),
+      query_count_(0),
+      core_timeout_(0) {
+
+}
+
+
+SolverWorker::~SolverWorker() {
+    if (worker_pid_ && owner_pid_ == getpid()) {
+        stopWorker();
+    }
+}
+
+
+bool SolverWorker::startWorker() {
+    assert(!worker_pid_);
+
+    buffer_ = (uint8_t*) mmap(NULL, buffer_size_, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (buffer_ == MAP_FAILED) {
+        buffer_ = NULL;
+        llvm::errs() << "SolverWorker: could not map the shared buffer" << '\n';
+        return false;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        llvm::errs() << "SolverWorker: socketpair failed ("
+                << strerror(errno) << ")" << '\n';
+        munmap(buffer_, buffer_size_);
+        buffer_ = NULL;
+        return false;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    // The worker must not receive the signals used by QEMU
+    sigset_t sig_mask, sig_mask_old;
+    sigfillset(&sig_mask);
+    sigprocmask(SIG_SETMASK, &sig_mask, &sig_mask_old);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        runWorker(fds[1]);
+        _exit(0);
+    }
+
+    sigprocmask(SIG_SETMASK, &sig_mask_old, NULL);
+    close(fds[1]);
+
+    if (pid < 0) {
+        llvm::errs() << "SolverWorker: fork failed (" << strerror(errno)
+                << ")" << '\n';
+        close(fds[0]);
+        munmap(buffer_, buffer_size_);
+        buffer_ = NULL;
+        return false;
+    }
+
+    owner_pid_ = getpid();
+    worker_pid_ = pid;
+    fd_ = fds[0];
+    query_count_ = 0;
+
+    expr_serializer_.reset(new ExprSerializer());
+    query_serializer_.reset(new QuerySerializer(*expr_serializer_));
+
+    return true;
+}
+
+
+void SolverWorker::stopWorker() {
+    assert(worker_pid_);
+
+    // Closing our end of the socket is not enough to stop the worker, since
+    // the S2E processes forked in the meantime hold copies of it.
+    close(fd_);
+    kill(worker_pid_, SIGKILL);
+
+    int status;
+    while (waitpid(worker_pid_, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    worker_pid_ = 0;
+    releaseWorker();
+}
+
+
+/* Drop the resources of the worker without touching the process */
+void SolverWorker::releaseWorker() {
+    if (worker_pid_) {
+        close(fd_);
+        worker_pid_ = 0;
+    }
+    fd_ = -1;
+
+    if (buffer_) {
+        munmap(buffer_, buffer_size_);
+        buffer_ = NULL;
+    }
+
+    query_serializer_.reset();
+    expr_serializer_.reset();
+}
+
+
+bool SolverWorker::sendQuery(const Query &query,
+        const std::vector<const Array*> &objects) {
+    uint64_t values_size = 0;
+    for (std::vector<const Array*>::const_iterator it = objects.begin(),
+            ie = objects.end(); it != ie; ++it) {
+        values_size += (*it)->size;
+    }
+
+    for (;;) {
+        if (worker_pid_ && owner_pid_ != getpid()) {
+            // Inherited from the parent S2E process
+            releaseWorker();
+        }
+
+        if (worker_pid_ && query_count_ >= SolverWorkerRestart) {
+            stopWorker();
+        }
+
+        if (!worker_pid_ && !startWorker()) {
+            return false;
+        }
+
+        std::string blob;
+        query_serializer_->Serialize(query, objects, blob);
+
+        uint64_t required = sizeof(SolverWorkerChannel) +
+                std::max<uint64_t>(blob.size(), values_size);
+        if (required > buffer_size_) {
+            // The serializers are out of sync with the worker now, so the
+            // query is sent again, in full, to a new worker.
+            stopWorker();
+            while (buffer_size_ < required) {
+                buffer_size_ *= 2;
+            }
+            continue;
+        }
+
+        channel()->request_size = blob.size();
+        channel()->timeout = core_timeout_;
+        memcpy(channel()->data(), blob.data(), blob.size());
+        break;
+    }
+
+    char cmd = 'q';
+    if (send(fd_, &cmd, 1, MSG_NOSIGNAL) != 1) {
+        llvm::errs() << "SolverWorker: could not send the query ("
+                << strerror(errno) << ")" << '\n';
+        stopWorker();
+        return false;
+    }
+
+    query_count_++;
+    return true;
+}
+
+
+bool SolverWorker::waitResponse() {
+    // Leave the core solver a second to give up on its own, which keeps
+    // the worker and its cached expressions alive.
+    double limit = SolverWorkerTimeout;
+    if (!limit && core_timeout_ > 0) {
+        limit = core_timeout_ + 1;
+    }
+    TimeValue deadline = TimeValue::now() + TimeValue(limit);
+
+    for (;;) {
+        int timeout_ms = -1;
+        if (limit > 0) {
+            TimeValue now = TimeValue::now();
+            timeout_ms = now < deadline ? (deadline - now).msec() : 0;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        int res = poll(&pfd, 1, timeout_ms);
+
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res == 0) {
+            llvm::errs() << "SolverWorker: query timed out" << '\n';
+            stopWorker();
+            return false;
+        }
+        if (res < 0) {
+            llvm::errs() << "SolverWorker: poll failed (" << strerror(errno)
+                    << ")" << '\n';
+            stopWorker();
+            return false;
+        }
+        break;
+    }
+
+    char cmd;
+    ssize_t count;
+    do {
+        count = recv(fd_, &cmd, 1, 0);
+    } while (count < 0 && errno == EINTR);
+
+    if (count != 1) {
+        llvm::errs() << "SolverWorker: the worker died" << '\n';
+        stopWorker();
+        return false;
+    }
+
+    return true;
+}
+
+
+bool SolverWorker::computeInitialValues(const Query &query,
+        const std::vector<const Array*> &objects,
+        std::vector<std::vector<unsigned char> > &values,
+        bool &hasSolution) {
+    ++stats::queries;
+    ++stats::queryCounterexamples;
+
+    if (!sendQuery(query, objects) || !waitResponse()) {
+        return false;
+    }
+
+    SolverWorkerChannel *ch = channel();
+    if (!ch->deserialized) {
+        // The serializers no longer mirror each other; start over
+        llvm::errs() << "SolverWorker: the worker could not read the query"
+                << '\n';
+        stopWorker();
+        return false;
+    }
+    if (!ch->success) {
+        return false;
+    }
+
+    hasSolution = ch->has_solution;
+    if (hasSolution) {
+        ++stats::queriesInvalid;
+
+        values = std::vector<std::vector<unsigned char> >(objects.size());
+        const uint8_t *pos = ch->data();
+        for (unsigned i = 0; i < objects.size(); ++i) {
+            values[i].assign(pos, pos + objects[i]->size);
+            pos += objects[i]->size;
+        }
+    } else {
+        ++stats::queriesValid;
+    }
+
+    return true;
+}
+
+
+bool SolverWorker::computeTruth(const Query &query, bool &isValid) {
+    std::vector<const Array*> objects;
+    std::vector<std::vector<unsigned char> > values;
+    bool hasSolution;
+
+    if (!computeInitialValues(query, objects, values, hasSolution))
+        return false;
+
+    isValid = !hasSolution;
+    return true;
+}
+
+
+bool SolverWorker::computeValue(const Query &query, ref<Expr> &result) {
+    std::vector<const Array*> objects;
+    std::vector<std::vector<unsigned char> > values;
+    bool hasSolution;
+
+    // Find the object used in the expression, and compute an assignment
+    // for them.
+    findSymbolicObjects(query.expr, objects);
+    if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+        return false;
+    assert(hasSolution && "state has invalid constraint set");
+
+    // Evaluate the expression with the computed assignment.
+    Assignment a(objects, values);
+    result = a.evaluate(query.expr);
+
+    return true;
+}
+
+
+/* The worker side. Never returns. */
+void SolverWorker::runWorker(int fd) {
+    scoped_ptr<ExprBuilder> expr_builder(createDefaultExprBuilder());
+    ExprDeserializer expr_deserializer(*expr_builder, std::vector<Array*>());
+    QueryDeserializer query_deserializer(expr_deserializer);
+
+    scoped_ptr<Solver> solver(factory_->DefaultSolverFactory::createEndSolver());
+
+    for (;;) {
+        char cmd;
+        ssize_t count = recv(fd, &cmd, 1, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count != 1) {
+            _exit(0);
+        }
+
+        SolverWorkerChannel *ch = channel();
+        std::string blob((const char*) ch->data(), ch->request_size);
+
+        Query query;
+        std::vector<const Array*> objects;
+        std::vector<std::vector<unsigned char> > values;
+        bool hasSolution = false;
+
+        solver->setCoreSolverTimeout(ch->timeout);
+
+        ch->deserialized = query_deserializer.Deserialize(blob, query,
+                objects);
+        ch->success = ch->deserialized &&
+                solver->impl->computeInitialValues(query, objects, values,
+                        hasSolution);
+        ch->has_solution = hasSolution;
+
+        if (ch->success && hasSolution) {
+            uint8_t *pos = ch->data();
+            for (unsigned i = 0; i < values.size(); ++i) {
+                if (!values[i].empty()) {
+                    memcpy(pos, &values[i][0], values[i].size());
+                }
+                pos += values[i].size();
+            }
+            ch->values_size = pos - ch->data();
+        }
+
+        if (send(fd, &cmd, 1, MSG_NOSIGNAL) != 1) {
+            _exit(0);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Solver *createSolverWorker(DefaultSolverFactory *factory) {
+    return new Solver(new SolverWorker(factory));
+}
+
+
+} // namespace s2e
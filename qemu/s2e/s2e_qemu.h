@@ -257,6 +257,10 @@ void s2e_tb_free(struct S2E* s2e, struct TranslationBlock *tb);
     in order to update tb->s2e_tb->llvm_function */
 void s2e_set_tb_function(struct S2E* s2e, struct TranslationBlock *tb);
 
+/** Called after code generation to record the registers accessed by
+    each instruction of the translation block */
+void s2e_set_tb_insn_masks(struct S2E* s2e, struct TranslationBlock *tb);
+
 void s2e_flush_tb_cache(void);
 void s2e_flush_tlb_cache(void);
 void s2e_flush_tlb_cache_page(void *objectState, int mmu_idx, int index);
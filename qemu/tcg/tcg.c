@@ -1156,6 +1156,96 @@ void tcg_calc_regmask_ex(TCGContext *s, uint64_t *rmask, uint64_t *wmask,
         args += nb_iargs + nb_oargs + nb_cargs;
     }
 }
+
+/* Compute the registers accessed by each guest instruction of the last
+   translated block, i.e. the union of its rmask and wmask. Bit 63 of an
+   entry is set if the instruction calls a helper that may access
+   symbolic memory. The ops emitted before the first debug_insn_start
+   (e.g., the TB prologue) are attributed to the first instruction, since
+   they run before it. Returns the number of instructions, or -1 if there
+   are more than max_insns. */
+int tcg_calc_insn_regmask(TCGContext *s, uint64_t *masks, int max_insns)
+{
+    const uint16_t *opc_ptr;
+    const TCGArg *args;
+    int c, i, nb_oargs, nb_iargs, nb_cargs, insn, started;
+    const TCGOpDef *def;
+
+    uint64_t temps[TCG_MAX_TEMPS];
+    memset(temps, 0, sizeof(temps[0])*(s->nb_globals + s->nb_temps));
+
+    if (max_insns < 1)
+        return -1;
+
+    insn = 0;
+    started = 0;
+    masks[0] = 0;
+    opc_ptr = gen_opc_buf;
+    args = gen_opparam_buf;
+    while (opc_ptr < gen_opc_ptr) {
+        c = *opc_ptr++;
+        def = &tcg_op_defs[c];
+
+        if (c == INDEX_op_debug_insn_start) {
+            if (started) {
+                if (++insn >= max_insns)
+                    return -1;
+                masks[insn] = 0;
+            }
+            started = 1;
+        }
+
+        if (c == INDEX_op_call) {
+            TCGArg arg_count;
+
+            arg_count = *args++;
+            nb_oargs = arg_count >> 16;
+            nb_iargs = arg_count & 0xffff;
+            nb_cargs = def->nb_cargs;
+
+            TCGArg func_arg = args[nb_oargs + nb_iargs - 1];
+            assert(func_arg < s->nb_globals + s->nb_temps);
+
+            uint64_t func_rmask, func_wmask, func_accesses_mem;
+            tcg_helper_get_reg_mask(s, (void*) temps[func_arg],
+                                    &func_rmask, &func_wmask,
+                                    &func_accesses_mem);
+
+            masks[insn] |= func_rmask | func_wmask;
+            if (func_accesses_mem & 4)
+                masks[insn] |= 1ULL << 63;
+        } else if (c == INDEX_op_nopn) {
+            nb_cargs = *args;
+            nb_oargs = 0;
+            nb_iargs = 0;
+        } else {
+            nb_oargs = def->nb_oargs;
+            nb_iargs = def->nb_iargs;
+            nb_cargs = def->nb_cargs;
+        }
+
+        if (c == INDEX_op_movi_i32
+#if TCG_TARGET_REG_BITS == 64
+                   || c == INDEX_op_movi_i64
+#endif
+                   ) {
+            temps[args[0]] = args[1];
+        } else {
+            for(i = 0; i < nb_oargs; i++)
+                temps[args[i]] = 0;
+        }
+
+        for(i = 0; i < nb_oargs + nb_iargs; i++) {
+            TCGArg idx = args[i];
+            if (idx < s->nb_globals)
+                masks[insn] |= (1<<idx);
+        }
+
+        args += nb_iargs + nb_oargs + nb_cargs;
+    }
+
+    return started ? insn + 1 : 0;
+}
 #endif
 
 
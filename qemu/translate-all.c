@@ -115,6 +115,7 @@ int cpu_gen_code(CPUArchState *env, TranslationBlock *tb, int *gen_code_size_ptr
 #ifdef CONFIG_S2E
     tcg_calc_regmask(s, &tb->reg_rmask, &tb->reg_wmask,
                      &tb->helper_accesses_mem);
+    s2e_set_tb_insn_masks(g_s2e, tb);
 #endif
 
 #if defined(CONFIG_LLVM)
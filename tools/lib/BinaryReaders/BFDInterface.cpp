@@ -42,6 +42,7 @@
 #include "llvm/Support/system_error.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <cassert>
 
 #include <algorithm>
@@ -54,7 +55,8 @@ namespace s2etools
 
 bool BFDInterface::s_bfdInited = false;
 
-BFDInterface::BFDInterface(const std::string &fileName):ExecutableFile(fileName)
+BFDInterface::BFDInterface(const std::string &fileName):ExecutableFile(fileName),
+    m_symbolIndex(fileName)
 {
     m_bfd = NULL;
     m_symbolTable = NULL;
@@ -66,7 +68,8 @@ BFDInterface::BFDInterface(const std::string &fileName):ExecutableFile(fileName)
     m_binary = NULL;
 }
 
-BFDInterface::BFDInterface(const std::string &fileName, bool requireSymbols):ExecutableFile(fileName)
+BFDInterface::BFDInterface(const std::string &fileName, bool requireSymbols):ExecutableFile(fileName),
+    m_symbolIndex(fileName)
 {
     m_bfd = NULL;
     m_symbolTable = NULL;
@@ -77,6 +80,8 @@ BFDInterface::BFDInterface(const std::string &fileName, bool requireSymbols):Exe
 
 BFDInterface::~BFDInterface()
 {
+    m_symbolIndex.save();
+
     if (m_binary) {
         delete m_binary;
     }
@@ -199,6 +204,8 @@ bool BFDInterface::initialize(const std::string &format)
         m_moduleName = m_fileName.substr(pos);
     }
 
+    m_symbolIndex.load();
+
     return true;
 }
 
@@ -208,20 +215,33 @@ bool BFDInterface::getInfo(uint64_t addr, std::string &source, uint64_t &line, s
         return false;
     }
 
-    BFDSection s;
-    s.start = addr;
-    s.size = 1;
-
+    const SymbolIndexEntry *entry = m_symbolIndex.find(addr);
+    if (entry) {
+        if (!entry->isValid()) {
+            return false;
+        }
+        m_symbolIndex.getInfo(entry, source, line, function);
+        return true;
+    }
 
-    if (m_invalidAddresses.find(addr) != m_invalidAddresses.end()) {
+    if (!lookupInfo(addr, source, line, function)) {
+        m_symbolIndex.addInvalid(addr);
         return false;
     }
 
+    m_symbolIndex.add(addr, source, line, function);
+    return true;
+}
+
+bool BFDInterface::lookupInfo(uint64_t addr, std::string &source, uint64_t &line, std::string &function)
+{
+    BFDSection s;
+    s.start = addr;
+    s.size = 1;
+
     Sections::const_iterator it = m_sections.find(s);
     if (it == m_sections.end()) {
         std::cerr << "Could not find section at address 0x"  << std::hex << addr << " in file " << m_fileName << std::endl;
-        //Cache the value for speed  up
-        m_invalidAddresses.insert(addr);
         return false;
     }
 
@@ -315,13 +335,23 @@ bool BFDInterface::read(uint64_t va, void *dest, unsigned size) const
         return false;
     }
 
-    bool b = bfd_get_section_contents(m_bfd, section, dest, va - section->vma, size);
+    //Copy straight from the mapped file when the section is stored there
+    //as is, which avoids a seek and a read syscall per call in BFD
+    uint64_t offset = va - section->vma;
+    bool b;
+    if ((section->flags & SEC_HAS_CONTENTS) && m_file &&
+        offset + size <= section->size &&
+        section->filepos + offset + size <= m_file->getBufferSize()) {
+        memcpy(dest, m_file->getBufferStart() + section->filepos + offset, size);
+        b = true;
+    } else {
+        b = bfd_get_section_contents(m_bfd, section, dest, offset, size);
+    }
+
     //Check for written changes
-    for (unsigned i=0; i<size; ++i) {
-        std::map<uint64_t, uint8_t>::const_iterator it = m_cowBuffer.find(va+i);
-        if (it != m_cowBuffer.end()) {
-            *(((uint8_t*)dest) + i) = (*it).second;
-        }
+    std::map<uint64_t, uint8_t>::const_iterator it = m_cowBuffer.lower_bound(va);
+    for (; it != m_cowBuffer.end() && (*it).first < va + size; ++it) {
+        *(((uint8_t*)dest) + ((*it).first - va)) = (*it).second;
     }
     return b;
 }
@@ -47,6 +47,7 @@ extern "C" {
 #include <inttypes.h>
 
 #include "ExecutableFile.h"
+#include "SymbolIndex.h"
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/ADT/OwningPtr.h>
 
@@ -110,8 +111,6 @@ public:
 
 private:
 
-    typedef std::set<uint64_t> AddressSet;
-
     static bool s_bfdInited;
     bfd *m_bfd;
     asymbol **m_symbolTable;
@@ -119,7 +118,9 @@ private:
 
     std::string m_moduleName;
     Sections m_sections;
-    AddressSet m_invalidAddresses;
+
+    //Caches getInfo results across tool invocations
+    SymbolIndex m_symbolIndex;
 
     uint64_t m_imageBase;
     bool m_requireSymbols;
@@ -136,6 +137,7 @@ private:
 
     bool initPeImports();
     asection *getSection(uint64_t va, unsigned size) const;
+    bool lookupInfo(uint64_t addr, std::string &source, uint64_t &line, std::string &function);
 
 public:
     BFDInterface(const std::string &fileName);
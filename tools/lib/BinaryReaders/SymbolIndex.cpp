@@ -0,0 +1,254 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "SymbolIndex.h"
+
+#include "llvm/Support/system_error.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace s2etools
+{
+
+namespace {
+    struct EntryAddressOrder {
+        bool operator()(const SymbolIndexEntry &e, uint64_t address) const {
+            return e.address < address;
+        }
+    };
+}
+
+SymbolIndex::SymbolIndex(const std::string &binaryPath)
+{
+    m_binaryPath = binaryPath;
+    m_indexPath = binaryPath + ".symidx";
+    m_binarySize = 0;
+    m_binaryMtime = 0;
+    m_entries = NULL;
+    m_entryCount = 0;
+    m_strings = NULL;
+    m_stringsSize = 0;
+}
+
+bool SymbolIndex::load()
+{
+    struct stat st;
+    if (stat(m_binaryPath.c_str(), &st) < 0) {
+        return false;
+    }
+    m_binarySize = st.st_size;
+    m_binaryMtime = st.st_mtime;
+
+    llvm::OwningPtr<llvm::MemoryBuffer> file;
+    if (llvm::MemoryBuffer::getFile(m_indexPath.c_str(), file, -1, false)) {
+        return false;
+    }
+
+    if (file->getBufferSize() < sizeof(Header)) {
+        return false;
+    }
+
+    const Header *hdr = (const Header*) file->getBufferStart();
+    if (hdr->magic != Magic || hdr->version != Version ||
+        hdr->binarySize != m_binarySize || hdr->binaryMtime != m_binaryMtime) {
+        return false;
+    }
+
+    //The file is searched in place, so anything that does not check out
+    //makes us rebuild the index rather than read out of bounds
+    uint64_t available = file->getBufferSize() - sizeof(Header);
+    if (hdr->entryCount > available / sizeof(SymbolIndexEntry)) {
+        return false;
+    }
+    available -= hdr->entryCount * sizeof(SymbolIndexEntry);
+    if (hdr->stringsSize != available ||
+        hdr->stringsSize >= SymbolIndexEntry::NoString) {
+        return false;
+    }
+
+    const SymbolIndexEntry *entries = (const SymbolIndexEntry*) (hdr + 1);
+    const char *strings = (const char*) (entries + hdr->entryCount);
+    if (hdr->stringsSize && strings[hdr->stringsSize - 1]) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < hdr->entryCount; ++i) {
+        const SymbolIndexEntry &e = entries[i];
+        if (i > 0 && entries[i - 1].address >= e.address) {
+            return false;
+        }
+
+        if (e.isValid()) {
+            if (e.source >= hdr->stringsSize ||
+                e.function >= hdr->stringsSize) {
+                return false;
+            }
+        } else if (e.function != SymbolIndexEntry::NoString) {
+            return false;
+        }
+    }
+
+    m_entries = entries;
+    m_entryCount = hdr->entryCount;
+    m_strings = strings;
+    m_stringsSize = hdr->stringsSize;
+    m_file.swap(file);
+    return true;
+}
+
+const SymbolIndexEntry *SymbolIndex::find(uint64_t address) const
+{
+    const SymbolIndexEntry *end = m_entries + m_entryCount;
+    const SymbolIndexEntry *it = std::lower_bound(m_entries, end, address,
+                                                  EntryAddressOrder());
+    if (it != end && it->address == address) {
+        return it;
+    }
+
+    Entries::const_iterator ait = m_added.find(address);
+    if (ait != m_added.end()) {
+        return &(*ait).second;
+    }
+
+    return NULL;
+}
+
+const char *SymbolIndex::getString(uint32_t id) const
+{
+    if (id < m_stringsSize) {
+        return m_strings + id;
+    }
+    return &m_newStrings[id - m_stringsSize];
+}
+
+void SymbolIndex::getInfo(const SymbolIndexEntry *entry, std::string &source,
+                          uint64_t &line, std::string &function) const
+{
+    source = getString(entry->source);
+    line = entry->line;
+    function = getString(entry->function);
+}
+
+uint32_t SymbolIndex::intern(const std::string &s)
+{
+    StringIds::iterator it = m_newStringIds.find(s);
+    if (it != m_newStringIds.end()) {
+        return (*it).second;
+    }
+
+    uint32_t id = m_stringsSize + m_newStrings.size();
+    m_newStrings.insert(m_newStrings.end(), s.begin(), s.end());
+    m_newStrings.push_back(0);
+    m_newStringIds[s] = id;
+    return id;
+}
+
+void SymbolIndex::add(uint64_t address, const std::string &source,
+                      uint64_t line, const std::string &function)
+{
+    SymbolIndexEntry &e = m_added[address];
+    e.address = address;
+    e.line = line;
+    e.source = intern(source);
+    e.function = intern(function);
+}
+
+void SymbolIndex::addInvalid(uint64_t address)
+{
+    SymbolIndexEntry &e = m_added[address];
+    e.address = address;
+    e.line = 0;
+    e.source = SymbolIndexEntry::NoString;
+    e.function = SymbolIndexEntry::NoString;
+}
+
+bool SymbolIndex::save()
+{
+    if (!isDirty() || !m_binarySize) {
+        return true;
+    }
+
+    //Merge the mapped entries with the new ones, both sorted by address
+    std::vector<SymbolIndexEntry> entries;
+    entries.reserve(m_entryCount + m_added.size());
+
+    const SymbolIndexEntry *it = m_entries, *end = m_entries + m_entryCount;
+    Entries::const_iterator ait = m_added.begin();
+    while (it != end || ait != m_added.end()) {
+        if (ait == m_added.end() ||
+            (it != end && it->address < (*ait).first)) {
+            entries.push_back(*it++);
+        } else {
+            entries.push_back((*ait).second);
+            ++ait;
+        }
+    }
+
+    Header hdr;
+    hdr.magic = Magic;
+    hdr.version = Version;
+    hdr.binarySize = m_binarySize;
+    hdr.binaryMtime = m_binaryMtime;
+    hdr.entryCount = entries.size();
+    hdr.stringsSize = m_stringsSize + m_newStrings.size();
+
+    //Other tool instances may be saving the same index concurrently
+    std::stringstream tmpPath;
+    tmpPath << m_indexPath << ".tmp." << getpid();
+
+    std::ofstream ofs(tmpPath.str().c_str(), std::ios::binary);
+    if (!ofs.is_open()) {
+        return false;
+    }
+
+    ofs.write((const char*) &hdr, sizeof(hdr));
+    ofs.write((const char*) &entries[0], entries.size() * sizeof(SymbolIndexEntry));
+    ofs.write(m_strings, m_stringsSize);
+    if (!m_newStrings.empty()) {
+        ofs.write(&m_newStrings[0], m_newStrings.size());
+    }
+    ofs.close();
+
+    if (ofs.fail() || rename(tmpPath.str().c_str(), m_indexPath.c_str()) < 0) {
+        unlink(tmpPath.str().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+}
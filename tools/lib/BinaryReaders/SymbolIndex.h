@@ -0,0 +1,136 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2ETOOLS_SYMBOLINDEX_H
+#define S2ETOOLS_SYMBOLINDEX_H
+
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/ADT/OwningPtr.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+namespace s2etools
+{
+
+struct SymbolIndexEntry
+{
+    uint64_t address;
+    uint64_t line;
+
+    //Offsets in the string table, NoString for addresses without
+    //debug information
+    uint32_t source;
+    uint32_t function;
+
+    static const uint32_t NoString = (uint32_t) -1;
+
+    bool isValid() const {
+        return source != NoString;
+    }
+};
+
+/**
+ *  Address to source/line/function index of one binary, stored in
+ *  <binary>.symidx next to it and reused by later tool invocations.
+ *
+ *  The file holds a header, the entries sorted by address and a string
+ *  table. It is mapped in memory and searched in place. Lookups that miss
+ *  are resolved by the caller (e.g., with BFD) and added to an in-memory
+ *  overlay, which save() merges into the file. The index is discarded when
+ *  the size or modification time of the binary changes.
+ */
+class SymbolIndex
+{
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t binarySize;
+        uint64_t binaryMtime;
+        uint64_t entryCount;
+        uint64_t stringsSize;
+    };
+
+    static const uint32_t Magic = 0x58444953; // "SIDX"
+    static const uint32_t Version = 1;
+
+    typedef std::map<uint64_t, SymbolIndexEntry> Entries;
+    typedef std::map<std::string, uint32_t> StringIds;
+
+    std::string m_binaryPath;
+    std::string m_indexPath;
+    uint64_t m_binarySize;
+    uint64_t m_binaryMtime;
+
+    llvm::OwningPtr<llvm::MemoryBuffer> m_file;
+    const SymbolIndexEntry *m_entries;
+    uint64_t m_entryCount;
+    const char *m_strings;
+    uint64_t m_stringsSize;
+
+    Entries m_added;
+    std::vector<char> m_newStrings;
+    StringIds m_newStringIds;
+
+    uint32_t intern(const std::string &s);
+    const char *getString(uint32_t id) const;
+
+public:
+    SymbolIndex(const std::string &binaryPath);
+
+    //Maps the index file if it exists and matches the binary
+    bool load();
+
+    //Returns NULL if the address is not indexed yet
+    const SymbolIndexEntry *find(uint64_t address) const;
+
+    void getInfo(const SymbolIndexEntry *entry, std::string &source,
+                 uint64_t &line, std::string &function) const;
+
+    void add(uint64_t address, const std::string &source, uint64_t line,
+             const std::string &function);
+
+    //Records that the address has no debug information
+    void addInvalid(uint64_t address);
+
+    bool isDirty() const {
+        return !m_added.empty();
+    }
+
+    //Writes the merged index next to the binary
+    bool save();
+};
+
+}
+
+#endif
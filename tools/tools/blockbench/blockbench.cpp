@@ -0,0 +1,147 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+
+#define __STDC_FORMAT_MACROS 1
+
+#include "llvm/Support/CommandLine.h"
+
+#include <s2e/S2EBlockOverlay.h>
+
+#include <sys/time.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <inttypes.h>
+#include <stdlib.h>
+
+using namespace llvm;
+using namespace s2e;
+
+namespace {
+
+cl::opt<std::string>
+Pattern("pattern", cl::desc("Access pattern: seq or random"), cl::init("seq"));
+
+cl::opt<unsigned>
+DiskSizeMB("disk-size", cl::desc("Size of the simulated disk, in MB"), cl::init(1024));
+
+cl::opt<unsigned>
+OpCount("ops", cl::desc("Number of write and read requests"), cl::init(100000));
+
+cl::opt<unsigned>
+SectorsPerOp("sectors", cl::desc("Number of sectors per request"), cl::init(8));
+
+cl::opt<unsigned>
+ForkInterval("fork-interval", cl::desc("Fork the overlay every N writes (0 to disable)"), cl::init(1000));
+
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint64_t nextSector(uint64_t previous, uint64_t diskSectors)
+{
+    if (Pattern == "random") {
+        return ((uint64_t) rand() * RAND_MAX + rand()) % (diskSectors - SectorsPerOp);
+    }
+
+    uint64_t next = previous + SectorsPerOp;
+    return next + SectorsPerOp > diskSectors ? 0 : next;
+}
+
+static void report(const char *phase, double seconds)
+{
+    double mb = (double) OpCount * SectorsPerOp * BlockDeviceOverlay::SECTOR_SIZE / (1024 * 1024);
+    std::cout << std::setw(6) << phase << ": "
+              << std::fixed << std::setprecision(3) << seconds << "s, "
+              << std::setprecision(1) << mb / seconds << " MB/s, "
+              << std::setprecision(0) << OpCount / seconds << " req/s" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, (char**) argv, " block overlay benchmark");
+
+    if (Pattern != "seq" && Pattern != "random") {
+        std::cerr << "Unknown access pattern " << Pattern << std::endl;
+        return -1;
+    }
+
+    uint64_t diskSectors = (uint64_t) DiskSizeMB * 1024 * 1024 / BlockDeviceOverlay::SECTOR_SIZE;
+    if (SectorsPerOp == 0 || diskSectors <= SectorsPerOp) {
+        std::cerr << "The disk is too small for the request size" << std::endl;
+        return -1;
+    }
+
+    std::vector<uint8_t> buffer(SectorsPerOp * BlockDeviceOverlay::SECTOR_SIZE, 0xab);
+
+    /* Forked overlays stay alive, as the states of a symbolic execution would */
+    std::vector<BlockDeviceOverlay> forks;
+    BlockDeviceOverlay overlay;
+
+    srand(0);
+    uint64_t sector = 0;
+    double start = now();
+    for (unsigned i = 0; i < OpCount; ++i) {
+        sector = nextSector(sector, diskSectors);
+        overlay.write(sector, &buffer[0], SectorsPerOp);
+        if (ForkInterval && (i + 1) % ForkInterval == 0) {
+            forks.push_back(overlay);
+        }
+    }
+    report("write", now() - start);
+
+    srand(0);
+    sector = 0;
+    uint64_t found = 0;
+    start = now();
+    for (unsigned i = 0; i < OpCount; ++i) {
+        sector = nextSector(sector, diskSectors);
+        found += overlay.read(sector, &buffer[0], SectorsPerOp);
+    }
+    report("read", now() - start);
+
+    std::cout << "Sectors found in the overlay: " << found << std::endl
+              << "Overlay nodes: " << overlay.getNodeCount()
+              << ", forks: " << forks.size() << std::endl;
+
+    return 0;
+}
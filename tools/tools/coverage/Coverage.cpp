@@ -49,6 +49,9 @@
 #include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
 
 #include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
 #include <ostream>
 #include <fstream>
 #include <iostream>
@@ -77,6 +80,9 @@ ModDir("moddir", cl::desc("Directory containing binary modules, the basic block
 cl::opt<bool>
     Compact("compact", cl::desc("Do not display non-covered blocks"), cl::init(false));
 
+cl::opt<unsigned>
+    Jobs("jobs", cl::desc("Process the traces independently in this many worker processes and merge their coverage"), cl::init(1));
+
 
 //cl::opt<std::string>
 //    CovType("covtype", cl::desc("Coverage type"), cl::init("basicblock"));
@@ -86,54 +92,119 @@ cl::opt<bool>
 
 namespace s2etools
 {
-BasicBlockCoverage::BasicBlockCoverage(const std::string &moduleDir,
-           const std::string &moduleName)
+
+bool BasicBlockIndex::load(const std::string &moduleDir,
+                           const std::string &moduleName)
 {
     llvm::sys::Path basicBlockListFile(moduleDir);
     basicBlockListFile.appendComponent(moduleName + ".bblist");
 
-    FILE *fp = fopen(basicBlockListFile.str().c_str(), "r");
-    if (!fp) {
-        std::cerr << "Could not open file " << basicBlockListFile.str() << std::endl;
-        return;
+    //Overlapping blocks are reported and skipped by the parser
+    BasicBlockListParser::BasicBlocks blocks;
+    BasicBlockListParser::parseListing(basicBlockListFile, blocks);
+    if (blocks.empty()) {
+        return false;
     }
 
-    char buffer[512];
-    while (fgets(buffer, sizeof(buffer), fp)) {
-        uint64_t start, end;
-        char name[512];
-        sscanf(buffer, "0x%"PRIx64" 0x%"PRIx64" %[^\r\t\n]s", &start, &end, name);
-        //std::cout << "Read 0x" << std::hex << start << " 0x" << end << " " << name << std::endl;
-
-        unsigned prevCount = m_allBbs.size();
-        std::pair<BasicBlocks::iterator, bool> result = m_allBbs.insert(BasicBlock(start, end));
-        if (!result.second) {
-           std::cout << "Won't insert this block : existing block: " << (*result.first).start << std::endl;
-           continue;
+    std::map<std::string, BlockIndices> functions;
+
+    //The parser's ordering is by address, so the index comes out sorted
+    BasicBlockListParser::BasicBlocks::const_iterator it;
+    for (it = blocks.begin(); it != blocks.end(); ++it) {
+        Entry entry;
+        entry.start = (*it).start;
+        entry.end = (*it).start + (*it).size - 1;
+        entry.function = 0;
+        functions[(*it).function].push_back(m_blocks.size());
+        m_blocks.push_back(entry);
+    }
+
+    std::map<std::string, BlockIndices>::iterator fit;
+    for (fit = functions.begin(); fit != functions.end(); ++fit) {
+        unsigned function = m_functionNames.size();
+        m_functionNames.push_back((*fit).first);
+        m_functionBlocks.push_back((*fit).second);
+
+        const BlockIndices &indices = (*fit).second;
+        for (unsigned i = 0; i < indices.size(); ++i) {
+            m_blocks[indices[i]].function = function;
         }
+    }
+
+    return true;
+}
 
-        BasicBlocks &bbs = m_functions[name];
-        //XXX: the +1 is here to compensate the broken extraction script, which
-        //does not take into account the whole size of the last instruction.
-        prevCount = bbs.size();
-        bbs.insert(BasicBlock(start, end));
-        assert(prevCount == bbs.size()-1);
+unsigned BasicBlockIndex::lowerBound(uint64_t address) const
+{
+    unsigned low = 0, high = m_blocks.size();
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        if (m_blocks[mid].end < address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
+    return low;
+}
 
-    Functions::iterator fit;
-    unsigned fcnBbCount = 0;
-    for (fit = m_functions.begin(); fit != m_functions.end() ; ++fit) {
-        fcnBbCount += (*fit).second.size();
+CoverageBitmap::CoverageBitmap(unsigned size)
+    : m_bits((size + 63) / 64, 0), m_timeStamps(size, 0)
+{
+    m_coveredCount = 0;
+}
+
+bool CoverageBitmap::cover(unsigned index, uint64_t ts)
+{
+    if (!isCovered(index)) {
+        m_bits[index / 64] |= 1ULL << (index % 64);
+        m_timeStamps[index] = ts;
+        ++m_coveredCount;
+        return true;
+    }
+
+    //Paths are not processed in chronological order
+    if (ts < m_timeStamps[index]) {
+        m_timeStamps[index] = ts;
     }
-    assert(fcnBbCount == m_allBbs.size());
+    return false;
+}
 
-    if (m_allBbs.size() == 0) {
+void CoverageBitmap::merge(const CoverageBitmap &other)
+{
+    assert(other.size() == size());
+
+    for (unsigned w = 0; w < other.m_bits.size(); ++w) {
+        uint64_t word = other.m_bits[w];
+        while (word) {
+            unsigned bit = __builtin_ctzll(word);
+            word &= word - 1;
+            unsigned index = w * 64 + bit;
+            cover(index, other.m_timeStamps[index]);
+        }
+    }
+}
+
+BasicBlockCoverage::BasicBlockCoverage(const std::string &moduleDir,
+           const std::string &moduleName)
+{
+    m_name = moduleName;
+    m_missingTbs = 0;
+
+    if (!m_index.load(moduleDir, moduleName)) {
         std::cerr << "No basic blocks found in the list for " << moduleName << ". Check the format of the file." << std::endl;
     }
 
+    m_covered = new CoverageBitmap(m_index.size());
+
     parseExcludeFile(moduleDir, moduleName);
 }
 
+BasicBlockCoverage::~BasicBlockCoverage()
+{
+    delete m_covered;
+}
+
 void BasicBlockCoverage::parseExcludeFile(const std::string &moduleDir,
                                           const std::string &moduleName)
 {
@@ -159,104 +230,85 @@ void BasicBlockCoverage::parseExcludeFile(const std::string &moduleDir,
 //Start and end must be local to the model
 bool BasicBlockCoverage::addTranslationBlock(uint64_t ts, uint64_t start, uint64_t end)
 {
-    Block tb(ts, start, end);
-    Blocks::iterator it = m_uniqueTbs.find(tb);
+    bool newBlocks = false;
+    bool overlaps = false;
 
-    if (it == m_uniqueTbs.end()) {
-        m_uniqueTbs.insert(tb);
-        return true;
-    }else {
-        if ((*it).timeStamp > ts) {
-            m_uniqueTbs.erase(*it);
-            m_uniqueTbs.insert(tb);
-            return true;
-        }
+    for (unsigned i = m_index.lowerBound(start);
+         i < m_index.size() && m_index.get(i).start <= end; ++i) {
+        overlaps = true;
+        newBlocks |= m_covered->cover(i, ts);
     }
 
-    return false;
-}
-
-void BasicBlockCoverage::convertTbToBb()
-{
-    BasicBlocks::iterator it;
-    Blocks::iterator tbit;
-
-    for(tbit = m_uniqueTbs.begin(); tbit != m_uniqueTbs.end(); ++tbit) {
-        const Block &tb = *tbit;
+    if (!overlaps) {
+        ++m_missingTbs;
+    }
 
-        for (uint64_t s = tb.start; s < tb.end; s++) {
+    return newBlocks;
+}
 
-            BasicBlock tbb(s, s+1);
-            it = m_allBbs.find(tbb);
-            if(it == m_allBbs.end()) {
-                std::cerr << "Missing TB: " << std::hex << "0x"
-                    << tb.start << ":0x" << tb.end << std::endl;
-                continue;
-            }
-            //assert(it != m_allBbs.end());
+namespace {
+    struct BlockTimeOrder {
+        const BasicBlockIndex &index;
+        const CoverageBitmap &bitmap;
 
-            BasicBlock newBlock;
-            newBlock.timeStamp = tb.timeStamp;
-            newBlock.start = (*it).start;
-            newBlock.end = (*it).end;
+        BlockTimeOrder(const BasicBlockIndex &i, const CoverageBitmap &b)
+            : index(i), bitmap(b) {}
 
-            if (m_coveredBbs.find(newBlock) == m_coveredBbs.end()) {
-                    m_coveredBbs.insert(newBlock);
+        bool operator()(unsigned a, unsigned b) const {
+            if (bitmap.getTimeStamp(a) != bitmap.getTimeStamp(b)) {
+                return bitmap.getTimeStamp(a) < bitmap.getTimeStamp(b);
             }
-
+            return index.get(a).start < index.get(b).start;
         }
-
-    }
-
+    };
 }
 
-
 void BasicBlockCoverage::printTimeCoverage(std::ostream &os) const
 {
-    BlocksByTime bbtime;
-    BlocksByTime::const_iterator tit;
-
-    bool timeInited = false;
-    uint64_t firstTime = 0;
-
-    BasicBlocks::const_iterator it;
-    for (it = m_coveredBbs.begin(); it != m_coveredBbs.end(); ++it) {
-        bbtime.insert(*it);
+    std::vector<unsigned> covered;
+    covered.reserve(m_covered->getCoveredCount());
+    for (unsigned i = 0; i < m_index.size(); ++i) {
+        if (m_covered->isCovered(i)) {
+            covered.push_back(i);
+        }
     }
 
-    unsigned i = 0;
-    for (tit = bbtime.begin(); tit != bbtime.end(); ++tit) {
-        const BasicBlock &b = *tit;
+    std::sort(covered.begin(), covered.end(),
+              BlockTimeOrder(m_index, *m_covered));
 
-        if (!timeInited) {
-            firstTime = b.timeStamp;
-            timeInited = true;
-        }
+    uint64_t firstTime = covered.empty() ? 0 : m_covered->getTimeStamp(covered[0]);
+
+    for (unsigned i = 0; i < covered.size(); ++i) {
+        const BasicBlockIndex::Entry &b = m_index.get(covered[i]);
 
         //DO NOT TOUCH THE FORMAT, USED BY SCRIPTS TO BUILD THE PAPER
-        os << std::dec << (b.timeStamp - firstTime)/1000000 //Timestamp
+        os << std::dec << (m_covered->getTimeStamp(covered[i]) - firstTime)/1000000 //Timestamp
            << std::dec << " " << i << " " //Cumulative block count
            << std::hex << " 0x" << b.start << " 0x" << b.end << std::endl; //Addresses
-        ++i;
     }
 }
 
 //Returns the time in seconds of the last covered block
 uint64_t BasicBlockCoverage::getTimeCoverage() const
 {
-    BlocksByTime bbtime;
-    BlocksByTime::const_iterator tfirst;
-    BlocksByTime::const_reverse_iterator tit;
+    bool timeInited = false;
+    uint64_t firstTime = 0, lastTime = 0;
 
-    BasicBlocks::const_iterator it;
-    for (it = m_coveredBbs.begin(); it != m_coveredBbs.end(); ++it) {
-        bbtime.insert(*it);
-    }
+    for (unsigned i = 0; i < m_index.size(); ++i) {
+        if (!m_covered->isCovered(i)) {
+            continue;
+        }
 
-    tfirst = bbtime.begin();
-    tit = bbtime.rbegin();
+        uint64_t ts = m_covered->getTimeStamp(i);
+        if (!timeInited) {
+            firstTime = lastTime = ts;
+            timeInited = true;
+        }
+        firstTime = std::min(firstTime, ts);
+        lastTime = std::max(lastTime, ts);
+    }
 
-    return ((*tit).timeStamp - (*tfirst).timeStamp)/1000000;
+    return (lastTime - firstTime)/1000000;
 }
 
 
@@ -268,21 +320,20 @@ void BasicBlockCoverage::printReport(std::ostream &os, uint64_t pathCount,
     unsigned touchedFunctionsBb = 0;
     unsigned touchedFunctionsTotalBb = 0;
     unsigned allFunctionsBb = 0;
-    Functions::const_iterator fit;
 
-    for(fit = m_functions.begin(); fit != m_functions.end(); ++fit) {
+    for (unsigned f = 0; f < m_index.getFunctionCount(); ++f) {
+        const std::string &name = m_index.getFunctionName(f);
         if (useIgnoreList) {
-            if (m_ignoredFunctions.find((*fit).first) != m_ignoredFunctions.end()) {
+            if (m_ignoredFunctions.find(name) != m_ignoredFunctions.end()) {
                 continue;
             }
         }
 
-        const BasicBlocks &fcnbb = (*fit).second;
-        BasicBlocks uncovered;
-        BasicBlocks::const_iterator bbit;
-        for (bbit = fcnbb.begin(); bbit != fcnbb.end(); ++bbit) {
-            if (m_coveredBbs.find(*bbit) == m_coveredBbs.end()) {
-                uncovered.insert(*bbit);
+        const BasicBlockIndex::BlockIndices &fcnbb = m_index.getFunctionBlocks(f);
+        BasicBlockIndex::BlockIndices uncovered;
+        for (unsigned i = 0; i < fcnbb.size(); ++i) {
+            if (!m_covered->isCovered(fcnbb[i])) {
+                uncovered.push_back(fcnbb[i]);
             }
         }
 
@@ -292,11 +343,11 @@ void BasicBlockCoverage::printReport(std::ostream &os, uint64_t pathCount,
         if (csv) {
             snprintf(line, sizeof(line), "%u,%u,%u,%s,",
                      (unsigned)(coveredCount*100/fcnbb.size()), coveredCount, (unsigned)fcnbb.size(),
-                     (*fit).first.c_str());
+                     name.c_str());
         } else {
             snprintf(line, sizeof(line), "(%3u%%) %03u/%03u %-50s ",
                      (unsigned)(coveredCount*100/fcnbb.size()), coveredCount, (unsigned)fcnbb.size(),
-                     (*fit).first.c_str());
+                     name.c_str());
         }
 
         os << line;
@@ -310,8 +361,8 @@ void BasicBlockCoverage::printReport(std::ostream &os, uint64_t pathCount,
             }else {
                 if (!Compact) {
                     char delim = csv ? ',' : ' ';
-                    for (bbit = uncovered.begin(); bbit != uncovered.end(); ++bbit) {
-                        os << std::hex << "0x" << (*bbit).start << delim;
+                    for (unsigned i = 0; i < uncovered.size(); ++i) {
+                        os << std::hex << "0x" << m_index.get(uncovered[i]).start << delim;
                     }
                 }
             }
@@ -327,13 +378,17 @@ void BasicBlockCoverage::printReport(std::ostream &os, uint64_t pathCount,
     }
     os << std::endl;
 
+    unsigned coveredBbs = m_covered->getCoveredCount();
+    unsigned allBbs = m_index.size();
+    unsigned functionCount = m_index.getFunctionCount();
+
     if (useIgnoreList) {
         os << "Basic block coverage:    " << std::dec << touchedFunctionsBb << "/" << allFunctionsBb <<
                 "(" << (touchedFunctionsBb*100/allFunctionsBb) << "%)"  << std::endl;
 
     } else {
-        os << "Basic block coverage:    " << std::dec << m_coveredBbs.size() << "/" << m_allBbs.size() <<
-                "(" << (m_coveredBbs.size()*100/m_allBbs.size()) << "%)"  << std::endl;
+        os << "Basic block coverage:    " << std::dec << coveredBbs << "/" << allBbs <<
+                "(" << (coveredBbs*100/allBbs) << "%)"  << std::endl;
 
         os << "Function block coverage: " << std::dec << touchedFunctionsBb << "/" << touchedFunctionsTotalBb <<
                 "(" << (touchedFunctionsBb*100/touchedFunctionsTotalBb) << "%)"  << std::endl;
@@ -346,11 +401,11 @@ void BasicBlockCoverage::printReport(std::ostream &os, uint64_t pathCount,
         os << "Fully covered functions: " << std::dec << fullyCoveredFunctions << "/" << touchedFunctions <<
                 "(" << (fullyCoveredFunctions*100/touchedFunctions) << "%)"  << std::endl;
     } else {
-        os << "Total touched functions: " << std::dec << touchedFunctions << "/" << m_functions.size() <<
-                "(" << (touchedFunctions*100/m_functions.size()) << "%)"  << std::endl;
+        os << "Total touched functions: " << std::dec << touchedFunctions << "/" << functionCount <<
+                "(" << (touchedFunctions*100/functionCount) << "%)"  << std::endl;
 
-        os << "Fully covered functions: " << std::dec << fullyCoveredFunctions << "/" << m_functions.size() <<
-                "(" << (fullyCoveredFunctions*100/m_functions.size()) << "%)"  << std::endl;
+        os << "Fully covered functions: " << std::dec << fullyCoveredFunctions << "/" << functionCount <<
+                "(" << (fullyCoveredFunctions*100/functionCount) << "%)"  << std::endl;
     }
 
 
@@ -361,21 +416,17 @@ void BasicBlockCoverage::printReport(std::ostream &os, uint64_t pathCount,
 
 void BasicBlockCoverage::printBBCov(std::ostream &os) const
 {
-    Functions::const_iterator fit;
-
-    for(fit = m_functions.begin(); fit != m_functions.end(); ++fit) {
-        const BasicBlocks &fcnbb = (*fit).second;
-        BasicBlocks uncovered;
-        BasicBlocks::const_iterator bbit;
-        for (bbit = fcnbb.begin(); bbit != fcnbb.end(); ++bbit) {
-            Block b(0, (*bbit).start, 0);
-            if (m_uniqueTbs.find(b) == m_uniqueTbs.end())
+    for (unsigned f = 0; f < m_index.getFunctionCount(); ++f) {
+        const BasicBlockIndex::BlockIndices &fcnbb = m_index.getFunctionBlocks(f);
+        for (unsigned i = 0; i < fcnbb.size(); ++i) {
+            const BasicBlockIndex::Entry &bb = m_index.get(fcnbb[i]);
+            if (!m_covered->isCovered(fcnbb[i]))
                 os << std::setw(0) << "-";
             else
                 os << std::setw(0) << "+";
 
-            os << std::hex << "0x" << std::setfill('0') << std::setw(8) << (*bbit).start << std::setw(0)
-                   << ":0x" << std::setw(8) << (*bbit).end << std::endl;
+            os << std::hex << "0x" << std::setfill('0') << std::setw(8) << bb.start << std::setw(0)
+                   << ":0x" << std::setw(8) << bb.end << std::endl;
         }
         os << std::endl;
 
@@ -394,6 +445,15 @@ Coverage::Coverage(Library *lib, ModuleCache *cache, LogEvents *events)
     m_unknownModuleCount = 0;
 }
 
+Coverage::Coverage(Library *lib)
+{
+    m_events = NULL;
+    m_cache = NULL;
+    m_library = lib;
+    m_pathCount = 0;
+    m_unknownModuleCount = 0;
+}
+
 Coverage::~Coverage()
 {
     m_connection.disconnect();
@@ -404,23 +464,22 @@ Coverage::~Coverage()
     }
 }
 
-BasicBlockCoverage *Coverage::loadCoverage(const ModuleInstance *mi)
+BasicBlockCoverage *Coverage::loadCoverage(const std::string &moduleName)
 {
     BasicBlockCoverage *bbcov = NULL;
-    assert(mi);
 
-    BbCoverageMap::iterator it = m_bbCov.find(mi->Name);
+    BbCoverageMap::iterator it = m_bbCov.find(moduleName);
     if (it == m_bbCov.end()) {
         //Look for the file containing the bbs.
         std::string path;
-        if (m_library->findLibrary(mi->Name, path)) {
+        if (m_library->findLibrary(moduleName, path)) {
             llvm::sys::Path modPath(path);
             modPath.eraseComponent();
-            BasicBlockCoverage *bb = new BasicBlockCoverage(modPath.str(), mi->Name);
-            m_bbCov[mi->Name] = bb;
+            BasicBlockCoverage *bb = new BasicBlockCoverage(modPath.str(), moduleName);
+            m_bbCov[moduleName] = bb;
             bbcov = bb;
         } else {
-            m_notFoundModuleImages.insert(mi->Name);
+            m_notFoundModuleImages.insert(moduleName);
         }
     }else {
         bbcov = (*it).second;
@@ -453,15 +512,13 @@ void Coverage::onItem(unsigned traceIndex,
         return;
     }
 
-    BasicBlockCoverage *bbcov = loadCoverage(mi);
+    BasicBlockCoverage *bbcov = loadCoverage(mi->Name);
     if (!bbcov) {
         return;
     }
 
     uint64_t relPc = te->pc - mi->LoadBase + mi->ImageBase;
 
-
-
     bbcov->addTranslationBlock(hdr.timeStamp, relPc, relPc+te->size-1);
 }
 
@@ -474,7 +531,6 @@ void Coverage::outputCoverage(const std::string &path) const
         ss << path << "/" << (*it).first << ".timecov";
         std::ofstream timecov(ss.str().c_str());
 
-        (*it).second->convertTbToBb();
         (*it).second->printTimeCoverage(timecov);
 
         std::stringstream ss1;
@@ -502,6 +558,122 @@ void Coverage::outputCoverage(const std::string &path) const
     }
 }
 
+static void writeString(FILE *fp, const std::string &s)
+{
+    uint32_t size = s.size();
+    fwrite(&size, sizeof(size), 1, fp);
+    fwrite(s.data(), 1, size, fp);
+}
+
+static bool readString(FILE *fp, std::string &s)
+{
+    uint32_t size;
+    if (fread(&size, sizeof(size), 1, fp) != 1) {
+        return false;
+    }
+    s.resize(size);
+    return size == 0 || fread(&s[0], 1, size, fp) == size;
+}
+
+/**
+ * Only the covered blocks are written, as (index, timestamp) pairs.
+ * The reader looks up the module's basic block list by name again.
+ */
+void Coverage::saveBitmaps(FILE *fp) const
+{
+    fwrite(&m_pathCount, sizeof(m_pathCount), 1, fp);
+    fwrite(&m_unknownModuleCount, sizeof(m_unknownModuleCount), 1, fp);
+
+    uint32_t count = m_notFoundModuleImages.size();
+    fwrite(&count, sizeof(count), 1, fp);
+    std::set<std::string>::const_iterator nit;
+    for (nit = m_notFoundModuleImages.begin(); nit != m_notFoundModuleImages.end(); ++nit) {
+        writeString(fp, *nit);
+    }
+
+    count = m_bbCov.size();
+    fwrite(&count, sizeof(count), 1, fp);
+
+    BbCoverageMap::const_iterator it;
+    for (it = m_bbCov.begin(); it != m_bbCov.end(); ++it) {
+        const CoverageBitmap &bitmap = (*it).second->getBitmap();
+        writeString(fp, (*it).first);
+
+        uint32_t size = bitmap.size(), covered = bitmap.getCoveredCount();
+        fwrite(&size, sizeof(size), 1, fp);
+        fwrite(&covered, sizeof(covered), 1, fp);
+
+        for (uint32_t i = 0; i < size; ++i) {
+            if (bitmap.isCovered(i)) {
+                uint64_t ts = bitmap.getTimeStamp(i);
+                fwrite(&i, sizeof(i), 1, fp);
+                fwrite(&ts, sizeof(ts), 1, fp);
+            }
+        }
+    }
+}
+
+bool Coverage::mergeBitmaps(FILE *fp)
+{
+    uint64_t pathCount, unknownModuleCount;
+    uint32_t count;
+    if (fread(&pathCount, sizeof(pathCount), 1, fp) != 1 ||
+        fread(&unknownModuleCount, sizeof(unknownModuleCount), 1, fp) != 1 ||
+        fread(&count, sizeof(count), 1, fp) != 1) {
+        return false;
+    }
+
+    m_pathCount += pathCount;
+    m_unknownModuleCount += unknownModuleCount;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string name;
+        if (!readString(fp, name)) {
+            return false;
+        }
+        m_notFoundModuleImages.insert(name);
+    }
+
+    if (fread(&count, sizeof(count), 1, fp) != 1) {
+        return false;
+    }
+
+    for (uint32_t m = 0; m < count; ++m) {
+        std::string name;
+        uint32_t size, covered;
+        if (!readString(fp, name) ||
+            fread(&size, sizeof(size), 1, fp) != 1 ||
+            fread(&covered, sizeof(covered), 1, fp) != 1) {
+            return false;
+        }
+
+        CoverageBitmap bitmap(size);
+        for (uint32_t i = 0; i < covered; ++i) {
+            uint32_t index;
+            uint64_t ts;
+            if (fread(&index, sizeof(index), 1, fp) != 1 ||
+                fread(&ts, sizeof(ts), 1, fp) != 1 || index >= size) {
+                return false;
+            }
+            bitmap.cover(index, ts);
+        }
+
+        BasicBlockCoverage *bbcov = loadCoverage(name);
+        if (!bbcov) {
+            continue;
+        }
+
+        if (bbcov->getBitmap().size() != size) {
+            std::cerr << "Basic block list of " << name << " changed while merging coverage" << std::endl;
+            continue;
+        }
+
+        bbcov->merge(bitmap);
+    }
+
+    return true;
+}
+
 void Coverage::printErrors() const
 {
     if (m_unknownModuleCount) {
@@ -519,6 +691,14 @@ void Coverage::printErrors() const
             std::cerr << *it << "\n";
         }
     }
+
+    BbCoverageMap::const_iterator it;
+    for (it = m_bbCov.begin(); it != m_bbCov.end(); ++it) {
+        if ((*it).second->getMissingTbCount()) {
+            std::cerr << (*it).second->getMissingTbCount() << " translation blocks of "
+                    << (*it).first << " are not in its basic block list\n";
+        }
+    }
 }
 
 CoverageTool::CoverageTool()
@@ -545,6 +725,75 @@ void CoverageTool::flatTrace()
     cov.outputCoverage(LogDir);
 }
 
+void CoverageTool::parallelTrace(unsigned jobs)
+{
+    Coverage merged(&m_binaries);
+    std::map<pid_t, FILE*> workers;
+    unsigned next = 0;
+
+    while (next < TraceFiles.size() || !workers.empty()) {
+        while (next < TraceFiles.size() && workers.size() < jobs) {
+            FILE *fp = tmpfile();
+            if (!fp) {
+                std::cerr << "Could not create temporary file" << std::endl;
+                exit(-1);
+            }
+
+            std::cout.flush();
+            std::cerr.flush();
+
+            pid_t pid = fork();
+            if (pid < 0) {
+                std::cerr << "Could not fork worker" << std::endl;
+                exit(-1);
+            }
+
+            if (pid == 0) {
+                LogParser parser;
+                PathBuilder pb(&parser);
+                if (!parser.parse(TraceFiles[next])) {
+                    std::cerr << "Could not parse " << TraceFiles[next] << std::endl;
+                    _exit(-1);
+                }
+
+                ModuleCache mc(&pb);
+                Coverage cov(&m_binaries, &mc, &pb);
+                pb.processTree();
+
+                cov.saveBitmaps(fp);
+                fclose(fp);
+                _exit(0);
+            }
+
+            workers[pid] = fp;
+            ++next;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            continue;
+        }
+
+        std::map<pid_t, FILE*>::iterator it = workers.find(pid);
+        if (it == workers.end()) {
+            continue;
+        }
+
+        FILE *fp = (*it).second;
+        workers.erase(it);
+
+        rewind(fp);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !merged.mergeBitmaps(fp)) {
+            std::cerr << "A coverage worker failed, its trace is not included" << std::endl;
+        }
+        fclose(fp);
+    }
+
+    merged.printErrors();
+    merged.outputCoverage(LogDir);
+}
+
 
 }
 
@@ -555,7 +804,11 @@ int main(int argc, char **argv)
 
     s2etools::CoverageTool cov;
 
-    cov.flatTrace();
+    if (Jobs > 1 && TraceFiles.size() > 1) {
+        cov.parallelTrace(Jobs);
+    } else {
+        cov.flatTrace();
+    }
 
     return 0;
 }
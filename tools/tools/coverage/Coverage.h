@@ -42,92 +42,122 @@
 #include <lib/BinaryReaders/Library.h>
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <ostream>
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
+
+#include <lib/Utils/BasicBlockListParser.h>
 
 namespace s2etools
 {
 
-struct BasicBlock
+/**
+ * The basic blocks of a module sorted by start address, so that the
+ * blocks overlapping a translation block can be found by binary search.
+ * Blocks are identified by their position in the index.
+ */
+class BasicBlockIndex
 {
-    uint64_t timeStamp;
-    uint64_t start;
-    uint64_t end;
-    bool operator()(const BasicBlock&b1, const BasicBlock &b2) const {
-        return b1.end < b2.start;
+public:
+    struct Entry {
+        uint64_t start;
+        uint64_t end; //Inclusive
+        unsigned function;
+    };
+
+    typedef std::vector<unsigned> BlockIndices;
+
+private:
+    std::vector<Entry> m_blocks;
+
+    //Sorted by name
+    std::vector<std::string> m_functionNames;
+    std::vector<BlockIndices> m_functionBlocks;
+
+public:
+    bool load(const std::string &moduleDir, const std::string &moduleName);
+
+    unsigned size() const {
+        return m_blocks.size();
     }
 
-    BasicBlock(uint64_t s, uint64_t e) {
-        start = s;
-        end = e;
-        timeStamp = 0;
+    const Entry &get(unsigned index) const {
+        return m_blocks[index];
     }
 
-    BasicBlock() {
-        timeStamp = 0;
-        start = end = 0;
+    //Index of the first block that ends at or after address
+    unsigned lowerBound(uint64_t address) const;
+
+    unsigned getFunctionCount() const {
+        return m_functionNames.size();
     }
 
-    struct SortByTime {
+    const std::string &getFunctionName(unsigned function) const {
+        return m_functionNames[function];
+    }
 
-        bool operator()(const BasicBlock&b1, const BasicBlock &b2) const {
-            if (b1.timeStamp < b2.timeStamp) {
-                return true;
-            }
-            return b1.start < b2.start;
-        }
-    };
+    const BlockIndices &getFunctionBlocks(unsigned function) const {
+        return m_functionBlocks[function];
+    }
 };
 
-//Either a BB or TB depending on the context
-struct Block
+/**
+ * One bit per basic block of a module, along with the earliest time
+ * at which each block was covered.
+ */
+class CoverageBitmap
 {
-    uint64_t timeStamp;
-    uint64_t start;
-    uint64_t end;
+private:
+    std::vector<uint64_t> m_bits;
+    std::vector<uint64_t> m_timeStamps;
+    unsigned m_coveredCount;
+
+public:
+    CoverageBitmap(unsigned size);
+
+    unsigned size() const {
+        return m_timeStamps.size();
+    }
 
-    bool operator()(const Block&b1, const Block &b2) const {
-        return b1.start < b2.start;
+    unsigned getCoveredCount() const {
+        return m_coveredCount;
     }
 
-    Block() {
-        timeStamp = start = end = 0;
+    bool isCovered(unsigned index) const {
+        return m_bits[index / 64] & (1ULL << (index % 64));
     }
 
-    Block(uint64_t ts, uint64_t s, uint64_t e) {
-        timeStamp = ts;
-        start = s;
-        end = e;
+    uint64_t getTimeStamp(unsigned index) const {
+        return m_timeStamps[index];
     }
 
+    //Returns true if the block was not covered before
+    bool cover(unsigned index, uint64_t ts);
 
+    void merge(const CoverageBitmap &other);
 };
 
 class BasicBlockCoverage
 {
 public:
-
-    typedef std::set<BasicBlock, BasicBlock> BasicBlocks;
-    typedef std::set<Block, Block> Blocks;
-    typedef std::set<BasicBlock, BasicBlock::SortByTime> BlocksByTime;
-    typedef std::map<std::string, BasicBlocks> Functions;
-
     typedef std::set<std::string> FunctionNames;
 
 private:
     std::string m_name;
-    BasicBlocks m_allBbs;
-    BasicBlocks m_coveredBbs;
-    Functions m_functions;
-
-    Functions m_coveredFunctions;
+    BasicBlockIndex m_index;
+    CoverageBitmap *m_covered;
     FunctionNames m_ignoredFunctions;
-    Blocks m_uniqueTbs;
+
+    //TBs that did not overlap any known basic block
+    uint64_t m_missingTbs;
+
 public:
     BasicBlockCoverage(const std::string &moduleDir,
                    const std::string &moduleName);
+    ~BasicBlockCoverage();
 
     void parseExcludeFile(const std::string &moduleDir,
                           const std::string &moduleName);
@@ -135,8 +165,16 @@ public:
     //Start and end must be local to the module
     //Returns true if the added block resulted in covering new basic blocks
     bool addTranslationBlock(uint64_t ts, uint64_t start, uint64_t end);
+
+    const CoverageBitmap &getBitmap() const {
+        return *m_covered;
+    }
+
+    void merge(const CoverageBitmap &bitmap) {
+        m_covered->merge(bitmap);
+    }
+
     uint64_t getTimeCoverage() const;
-    void convertTbToBb();
     void printTimeCoverage(std::ostream &os) const;
     void printReport(std::ostream &os, uint64_t pathCount, bool useIgnoreList = false, bool csv = false) const;
     void printBBCov(std::ostream &os) const;
@@ -146,6 +184,10 @@ public:
         return m_ignoredFunctions.size() > 0;
     }
 
+    uint64_t getMissingTbCount() const {
+        return m_missingTbs;
+    }
+
 };
 
 class Coverage
@@ -172,7 +214,7 @@ private:
     /* BB lists that were not found. */
     std::set<std::string> m_notFoundBbList;
 
-    BasicBlockCoverage *loadCoverage(const ModuleInstance *mi);
+    BasicBlockCoverage *loadCoverage(const std::string &moduleName);
 
     void onItem(unsigned traceIndex,
                 const s2e::plugins::ExecutionTraceItemHeader &hdr,
@@ -180,10 +222,17 @@ private:
 
 public:
     Coverage(Library *lib, ModuleCache *cache, LogEvents *events);
+
+    //Only accumulates the coverage computed by other instances
+    Coverage(Library *lib);
     virtual ~Coverage();
 
     void outputCoverage(const std::string &Path) const;
 
+    //Transfer the bitmaps between processes
+    void saveBitmaps(FILE *fp) const;
+    bool mergeBitmaps(FILE *fp);
+
     uint64_t getPathCount() const {
         return m_pathCount;
     }
@@ -203,8 +252,10 @@ public:
     CoverageTool();
     ~CoverageTool();
 
-    void process();
     void flatTrace();
+
+    //Processes each trace in a separate worker and merges the bitmaps
+    void parallelTrace(unsigned jobs);
 };
 
 
@@ -0,0 +1,343 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "ForkHotspots.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace s2etools
+{
+
+//Event types, as defined in klee/data/EventLogger.h
+static const int EVENT_KLEE_FORK = 101;
+static const int EVENT_KLEE_QUERY = 109;
+
+static const char *forks_sql =
+        "SELECT c.pc, c.stack_id, e.event, NULL"
+        " FROM events e JOIN callstacks c ON c.id = e.id"
+        " WHERE e.event = ?1;";
+
+static const char *forks_and_queries_sql =
+        "SELECT c.pc, c.stack_id, e.event, r.time_usec"
+        " FROM events e JOIN callstacks c ON c.id = e.id"
+        " LEFT JOIN queries q ON q.event_id = e.id"
+        " LEFT JOIN query_results r ON r.query_id = q.id AND r.label = 'recorded'"
+        " WHERE e.event IN (?1, ?2);";
+
+ForkHotspots::ForkHotspots(sqlite3 *db)
+{
+    m_db = db;
+    m_eventCount = 0;
+
+    Node root;
+    root.pc = 0;
+    root.parent = 0;
+    root.depth = 0;
+    root.forks = root.selfForks = 0;
+    root.solverTime = root.selfSolverTime = 0;
+    m_nodes.push_back(root);
+}
+
+bool ForkHotspots::hasTable(const std::string &name)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(m_db,
+            "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?1;",
+            -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+    bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+void ForkHotspots::createIndex(const char *sql)
+{
+    //The indexes are built once and kept in the database, but this fails
+    //harmlessly on read-only files, at the cost of a full scan
+    char *err_msg;
+    if (sqlite3_exec(m_db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        std::cerr << "Could not create index (" << err_msg << ")" << std::endl;
+        sqlite3_free(err_msg);
+    }
+}
+
+void ForkHotspots::loadNames()
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(m_db,
+            "SELECT pc, fn_name FROM debug_info WHERE fn_name IS NOT NULL;",
+            -1, &stmt, NULL) != SQLITE_OK) {
+        return;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        m_names[sqlite3_column_int64(stmt, 0)] =
+                (const char*) sqlite3_column_text(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+}
+
+bool ForkHotspots::loadFrames()
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(m_db,
+            "SELECT id, parent_id, pc FROM stack_frames;",
+            -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+
+    //Frame ids are allocated sequentially from 1
+    int result;
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        uint64_t id = sqlite3_column_int64(stmt, 0);
+        if (id >= m_frames.size()) {
+            StackFrame none = { 0, 0 };
+            m_frames.resize(id + 1, none);
+        }
+        m_frames[id].parent = sqlite3_column_int64(stmt, 1);
+        m_frames[id].pc = sqlite3_column_int64(stmt, 2);
+    }
+    sqlite3_finalize(stmt);
+
+    return result == SQLITE_DONE;
+}
+
+void ForkHotspots::getCallStack(uint64_t frame, std::vector<uint64_t> &stack) const
+{
+    //Walks from the innermost frame to the outermost one
+    stack.clear();
+    while (frame && frame < m_frames.size()) {
+        stack.push_back(m_frames[frame].pc);
+        frame = m_frames[frame].parent;
+    }
+}
+
+unsigned ForkHotspots::getChild(unsigned node, uint64_t pc)
+{
+    std::map<uint64_t, unsigned>::iterator it = m_nodes[node].children.find(pc);
+    if (it != m_nodes[node].children.end()) {
+        return (*it).second;
+    }
+
+    Node child;
+    child.pc = pc;
+    child.parent = node;
+    child.depth = m_nodes[node].depth + 1;
+    child.forks = child.selfForks = 0;
+    child.solverTime = child.selfSolverTime = 0;
+
+    unsigned index = m_nodes.size();
+    m_nodes.push_back(child);
+    m_nodes[node].children[pc] = index;
+    return index;
+}
+
+void ForkHotspots::addEvent(const uint64_t *stack, unsigned size,
+                            uint64_t forks, uint64_t solverTime)
+{
+    unsigned node = 0;
+    m_nodes[0].forks += forks;
+    m_nodes[0].solverTime += solverTime;
+
+    //The logged stacks start with the innermost frame
+    for (unsigned i = size; i > 0; --i) {
+        node = getChild(node, stack[i - 1]);
+        m_nodes[node].forks += forks;
+        m_nodes[node].solverTime += solverTime;
+    }
+
+    m_nodes[node].selfForks += forks;
+    m_nodes[node].selfSolverTime += solverTime;
+}
+
+bool ForkHotspots::process()
+{
+    if (!hasTable("events") || !hasTable("callstacks") ||
+        !hasTable("stack_frames")) {
+        std::cerr << "The database does not contain S2EEventLogger tables" << std::endl;
+        return false;
+    }
+
+    bool withQueries = hasTable("queries") && hasTable("query_results");
+
+    createIndex("CREATE INDEX IF NOT EXISTS events_event_idx ON events(event);");
+    if (withQueries) {
+        createIndex("CREATE INDEX IF NOT EXISTS queries_event_idx ON queries(event_id);");
+    }
+
+    loadNames();
+
+    if (!loadFrames()) {
+        std::cerr << "Could not read the stack frames (" << sqlite3_errmsg(m_db) << ")" << std::endl;
+        return false;
+    }
+
+    sqlite3_stmt *stmt;
+    const char *sql = withQueries ? forks_and_queries_sql : forks_sql;
+    if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "SQL error in " << sql << " ["
+                  << sqlite3_errmsg(m_db) << "]" << std::endl;
+        return false;
+    }
+
+    sqlite3_bind_int(stmt, 1, EVENT_KLEE_FORK);
+    if (withQueries) {
+        sqlite3_bind_int(stmt, 2, EVENT_KLEE_QUERY);
+    }
+
+    std::vector<uint64_t> stack;
+    int result;
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        getCallStack(sqlite3_column_int64(stmt, 1), stack);
+
+        //Stacks are not collected with -collect-event-stacks=false
+        if (stack.empty()) {
+            stack.assign(1, sqlite3_column_int64(stmt, 0));
+        }
+
+        if (sqlite3_column_int(stmt, 2) == EVENT_KLEE_QUERY) {
+            addEvent(&stack[0], stack.size(), 0, sqlite3_column_int64(stmt, 3));
+        } else {
+            addEvent(&stack[0], stack.size(), 1, 0);
+        }
+
+        if (++m_eventCount % 1000000 == 0) {
+            std::cout << "Processed " << m_eventCount << " events" << std::endl;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+
+    if (result != SQLITE_DONE) {
+        std::cerr << "Could not read the events (" << sqlite3_errmsg(m_db) << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+std::string ForkHotspots::getName(uint64_t pc) const
+{
+    Names::const_iterator it = m_names.find(pc);
+    if (it != m_names.end()) {
+        return (*it).second;
+    }
+
+    std::stringstream ss;
+    ss << "0x" << std::hex << pc;
+    return ss.str();
+}
+
+std::string ForkHotspots::getStack(unsigned node) const
+{
+    std::vector<unsigned> path;
+    for (; node != 0; node = m_nodes[node].parent) {
+        path.push_back(node);
+    }
+
+    std::string stack;
+    for (unsigned i = path.size(); i > 0; --i) {
+        if (!stack.empty()) {
+            stack += ";";
+        }
+        stack += getName(m_nodes[path[i - 1]].pc);
+    }
+    return stack;
+}
+
+void ForkHotspots::outputFolded(const std::string &path, bool solverTime) const
+{
+    std::stringstream ss;
+    ss << path << "/" << (solverTime ? "solvertime.folded" : "forks.folded");
+    std::ofstream folded(ss.str().c_str());
+
+    for (unsigned i = 1; i < m_nodes.size(); ++i) {
+        const Node &n = m_nodes[i];
+        uint64_t value = solverTime ? n.selfSolverTime : n.selfForks;
+        if (value) {
+            folded << getStack(i) << " " << value << std::endl;
+        }
+    }
+}
+
+namespace {
+    struct NodeForkOrder {
+        const std::vector<uint64_t> &forks;
+
+        NodeForkOrder(const std::vector<uint64_t> &_forks) : forks(_forks) {}
+
+        bool operator()(unsigned a, unsigned b) const {
+            if (forks[a] != forks[b]) {
+                return forks[a] > forks[b];
+            }
+            return a < b;
+        }
+    };
+}
+
+void ForkHotspots::outputHotspots(const std::string &path, unsigned count) const
+{
+    std::stringstream ss;
+    ss << path << "/" << "forkhotspots.txt";
+    std::ofstream hotspots(ss.str().c_str());
+
+    std::vector<uint64_t> forks(m_nodes.size());
+    std::vector<unsigned> order;
+    for (unsigned i = 1; i < m_nodes.size(); ++i) {
+        forks[i] = m_nodes[i].forks;
+        order.push_back(i);
+    }
+
+    count = std::min<unsigned>(count, order.size());
+    std::partial_sort(order.begin(), order.begin() + count, order.end(),
+                      NodeForkOrder(forks));
+
+    const Node &root = m_nodes[0];
+    hotspots << "#Events: " << m_eventCount << " Forks: " << root.forks
+             << " SolverTime: " << root.solverTime / 1000000.0 << "s" << std::endl;
+    hotspots << "#Forks\tSelfForks\tSolverTime\tDepth\tStack" << std::endl;
+
+    for (unsigned i = 0; i < count; ++i) {
+        const Node &n = m_nodes[order[i]];
+        hotspots << n.forks << "\t" << n.selfForks << "\t"
+                 << n.solverTime / 1000000.0 << "\t" << n.depth << "\t"
+                 << getStack(order[i]) << std::endl;
+    }
+}
+
+}
@@ -0,0 +1,111 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2015, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2ETOOLS_FORKHOTSPOTS_H
+#define S2ETOOLS_FORKHOTSPOTS_H
+
+#include <sqlite3.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+namespace s2etools
+{
+
+/**
+ *  Aggregates the fork events and the solver time recorded by
+ *  S2EEventLogger in the collected_data.db3 database, per call stack.
+ *
+ *  Stacks are inserted outermost frame first into a prefix tree, whose
+ *  nodes accumulate the counts of all the events below them. The tree is
+ *  built in a single pass over the events table, using an index on the
+ *  event type instead of scanning it.
+ */
+class ForkHotspots
+{
+    struct Node {
+        uint64_t pc;
+        unsigned parent;
+        unsigned depth;
+
+        //Events whose stack goes through / ends at this frame
+        uint64_t forks, selfForks;
+        uint64_t solverTime, selfSolverTime;
+
+        std::map<uint64_t, unsigned> children;
+    };
+
+    //Interned stack frame, as stored by S2EEventLogger
+    struct StackFrame {
+        uint64_t parent;
+        uint64_t pc;
+    };
+
+    typedef std::vector<Node> Nodes;
+    typedef std::map<uint64_t, std::string> Names;
+    typedef std::vector<StackFrame> StackFrames;
+
+    sqlite3 *m_db;
+    Nodes m_nodes;
+    Names m_names;
+    StackFrames m_frames;
+    uint64_t m_eventCount;
+
+    bool hasTable(const std::string &name);
+    void createIndex(const char *sql);
+    void loadNames();
+    bool loadFrames();
+    void getCallStack(uint64_t frame, std::vector<uint64_t> &stack) const;
+
+    unsigned getChild(unsigned node, uint64_t pc);
+    void addEvent(const uint64_t *stack, unsigned size,
+                  uint64_t forks, uint64_t solverTime);
+
+    std::string getName(uint64_t pc) const;
+    std::string getStack(unsigned node) const;
+
+public:
+    ForkHotspots(sqlite3 *db);
+
+    bool process();
+
+    //Writes the stacks in the folded format of flamegraph.pl
+    void outputFolded(const std::string &path, bool solverTime) const;
+
+    //Writes the call stack prefixes that fork the most
+    void outputHotspots(const std::string &path, unsigned count) const;
+};
+
+}
+
+#endif
@@ -52,6 +52,7 @@
 #include <inttypes.h>
 #include <iomanip>
 #include "forkprofiler.h"
+#include "ForkHotspots.h"
 
 using namespace llvm;
 using namespace s2etools;
@@ -70,6 +71,12 @@ cl::opt<std::string>
 cl::list<std::string>
     ModDir("moddir", cl::desc("Directory containing the binary modules"));
 
+cl::opt<std::string>
+    Database("db", cl::desc("Aggregate the fork events of the given S2E data collection database (collected_data.db3) instead of a trace"));
+
+cl::opt<unsigned>
+    HotspotCount("hotspots", cl::desc("Number of call stack prefixes listed in forkhotspots.txt"), cl::init(100));
+
 }
 
 namespace s2etools
@@ -280,6 +287,26 @@ int main(int argc, char **argv)
 {
     cl::ParseCommandLineOptions(argc, (char**) argv, " debugger");
 
+    if (!Database.empty()) {
+        sqlite3 *db;
+        if (sqlite3_open(Database.c_str(), &db) != SQLITE_OK) {
+            std::cerr << "Could not open " << Database << " ("
+                      << sqlite3_errmsg(db) << ")" << std::endl;
+            return -1;
+        }
+
+        ForkHotspots hotspots(db);
+        bool ok = hotspots.process();
+        if (ok) {
+            hotspots.outputFolded(LogDir, false);
+            hotspots.outputFolded(LogDir, true);
+            hotspots.outputHotspots(LogDir, HotspotCount);
+        }
+
+        sqlite3_close(db);
+        return ok ? 0 : -1;
+    }
+
     Library library;
     library.setPaths(ModDir);
 